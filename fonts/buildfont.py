@@ -21,6 +21,7 @@ def main():
     parser.add_argument("-o", "--output", help="Output BIN file (default: same name with .bin extension)")
     parser.add_argument("-c", "--color", default="1", help="Color mode for buildfont (default: 1)")
     parser.add_argument("-q", "--quiet", action="store_true", help="Quiet mode for buildfont")
+    parser.add_argument("-p", "--packed", action="store_true", help="Packed 1 bit per pixel output")
     parser.add_argument("--buildfont", default="./buildfont", help="Path to buildfont executable")
     args = parser.parse_args()
 
@@ -44,6 +45,8 @@ def main():
     ]
     if args.quiet:
         cmd.append("-q")
+    if args.packed:
+        cmd.append("-p")
 
     print("Running:", " ".join(cmd))
     result = subprocess.run(cmd)
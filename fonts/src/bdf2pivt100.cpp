@@ -79,7 +79,21 @@ bool parseBDFFile(const std::string& filename, std::vector<Character>& chars, in
     return true;
 }
 
-void writePiVT100Font(const std::vector<Character>& chars, const std::string& outputFile, int fontWidth, int fontHeight) {
+// Packs one glyph of 0x00/0xFF pixels into rows of (fontWidth+7)/8 bytes, leftmost pixel in bit 7
+std::vector<uint8_t> packGlyph(const std::vector<uint8_t>& pixels, int fontWidth, int fontHeight) {
+    const int rowBytes = (fontWidth + 7) / 8;
+    std::vector<uint8_t> packed(rowBytes * fontHeight, 0x00);
+    for (int y = 0; y < fontHeight; y++) {
+        for (int x = 0; x < fontWidth; x++) {
+            if (pixels[y * fontWidth + x]) {
+                packed[y * rowBytes + x / 8] |= 0x80 >> (x % 8);
+            }
+        }
+    }
+    return packed;
+}
+
+void writePiVT100Font(const std::vector<Character>& chars, const std::string& outputFile, int fontWidth, int fontHeight, bool packed) {
     std::ofstream out(outputFile, std::ios::binary);
     if (!out.is_open()) {
         std::cerr << "Error: Cannot create output file: " << outputFile << std::endl;
@@ -128,6 +142,9 @@ void writePiVT100Font(const std::vector<Character>& chars, const std::string& ou
     
     // Write all 256 characters to file
     for (int i = 0; i < 256; i++) {
+        if (packed) {
+            charData[i] = packGlyph(charData[i], fontWidth, fontHeight);
+        }
         out.write(reinterpret_cast<const char*>(charData[i].data()), charData[i].size());
     }
     
@@ -136,13 +153,15 @@ void writePiVT100Font(const std::vector<Character>& chars, const std::string& ou
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cout << "Usage: " << argv[0] << " <input.bdf> <output.bin>" << std::endl;
+    // -p writes the packed format: 1 bit per pixel instead of one 0x00/0xFF byte
+    bool packed = argc == 4 && std::string(argv[1]) == "-p";
+    if (argc != 3 && !packed) {
+        std::cout << "Usage: " << argv[0] << " [-p] <input.bdf> <output.bin>" << std::endl;
         return 1;
     }
     
-    std::string inputFile = argv[1];
-    std::string outputFile = argv[2];
+    std::string inputFile = argv[argc - 2];
+    std::string outputFile = argv[argc - 1];
     
     std::vector<Character> chars;
     int fontWidth, fontHeight;
@@ -153,7 +172,7 @@ int main(int argc, char* argv[]) {
     
     std::cout << "Parsed " << chars.size() << " characters from " << inputFile << std::endl;
     
-    writePiVT100Font(chars, outputFile, fontWidth, fontHeight);
+    writePiVT100Font(chars, outputFile, fontWidth, fontHeight, packed);
     
     return 0;
 }
@@ -31,6 +31,9 @@ using std::endl;
  *  -o <File>        : path to the output BIN file
  *  -c 0             : PNG displays black chareacters on white background
  *  -c 1             : PNG displays white characters on black background
+ *  -p               : packed output, 1 bit per pixel instead of one byte
+ *                     0xFF or 0x00; each glyph line takes (width+7)/8 bytes
+ *                     and its leftmost pixel is bit 7 of the first byte
  
  * Original program by Filippo Bergamasco.
  * Extension to more file and formats by Francis Pierot.
@@ -42,6 +45,7 @@ int main( int argc, char* argv[] )
 	int fontheight = 0;
 	bool black_ON = true; // black
 	bool quiet = false;
+	bool packed = false;
 	string pngfile;
 	string binfile;
 
@@ -90,6 +94,8 @@ int main( int argc, char* argv[] )
 			}
 		} else if (arg.compare("-q")==0) {
 			quiet = true;
+		} else if (arg.compare("-p")==0) {
+			packed = true;
 		} else {
 			if (arg.compare("-?") != 0) {
 				cout << "Unknown parameter " << arg << endl;
@@ -97,12 +103,13 @@ int main( int argc, char* argv[] )
 			}
 			cout << "Builds a PIGFX binary BIN font bitmap file from a PNG file. " << endl;
 			cout << "Syntax:" << endl;
-			cout << "    buildfont -i <pngpath> -o <binpath> -w <fontwidth> -h <fontheight> [-c <ONcolor>] [-q]" << endl;
+			cout << "    buildfont -i <pngpath> -o <binpath> -w <fontwidth> -h <fontheight> [-c <ONcolor>] [-p] [-q]" << endl;
 			cout << "    -i <pngpath>      Full path to the PNG file containing an image of the font" << endl;
 			cout << "    -o <binfile>      Full path to the output BIN file for PIGFX." << endl;
 			cout << "    -w <font width>   Number of horizontal pixels for each character" << endl;
 			cout << "    -h <font height>  Number of lines for each character" << endl;
 			cout << "    -c <ONcolor>      Color value to set a pixel ON, 0 for black (default) or 1 for anything not black" << endl;
+			cout << "    -p                Packed output, 1 bit per pixel (leftmost pixel in bit 7)" << endl;
 			cout << "    -q                Quiet mode (no ASCII output)" << endl;
 			cout << "Exit codes:" << endl;
 			cout << "    0    ok" << endl;
@@ -155,13 +162,24 @@ int main( int argc, char* argv[] )
         		//      column c to c+fontwidth
         		if (!quiet) cout << "Character: " << charnum << endl;
         		for (int y = curline ; y < curline + fontheight ; y++) {
+        			unsigned char bits = 0;
         			for (int x = c * fontwidth ; x < (c+1) * fontwidth ; x++) {
                         unsigned char v = fontimg( x,y );
                         if (black_ON)
                         	v = v==0 ? 0xFF : 0x0;
                         else
                         	v = v!=0 ? 0xFF : 0x0;
-                        ofs << v;
+                        if (packed) {
+                        	const int bit = (x - c * fontwidth) % 8;
+                        	if (v) bits |= 0x80 >> bit;
+                        	// a byte is full or the glyph line ends
+                        	if (bit == 7 || x == (c+1) * fontwidth - 1) {
+                        		ofs << bits;
+                        		bits = 0;
+                        	}
+                        } else {
+                        	ofs << v;
+                        }
                         if (!quiet) cout << (v==0xFF ? "*" : ".") ;
         			} // next pixel on line
         			if (!quiet) cout << endl;
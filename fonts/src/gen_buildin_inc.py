@@ -52,7 +52,7 @@ def main():
             reg_name = "System 8x16"
         else:
             reg_name = name
-        lines.append(f'    font_registry_register("{reg_name}", {w}, {h}, {symbol}, font_get_glyph_address);')
+        lines.append(f'    font_registry_register("{reg_name}", {w}, {h}, {symbol}, FONT_FORMAT_PACKED1, font_get_glyph_address);')
     lines.append("}")
     with open(OUTFILE, "w") as f:
         f.write("\n".join(lines) + "\n")
@@ -0,0 +1,290 @@
+//
+// config_test.c
+// Reading pivt100.txt from the SD card
+//
+// PiVT100 host tools. Builds disk images in memory: an MBR with one FAT16
+// or FAT32 partition whose root directory holds a volume label, a long file
+// name entry, a kernel, a deleted pivt100.txt and the configuration file,
+// which spans three clusters and has DOS line endings. ramdisk.c serves the
+// image as the SD card. Checks that
+//  - loadConfigFile() finds the file through the MBR, FAT and ini code and
+//    takes the valid values, keys in every cluster included, and ignores
+//    the values out of range
+//  - applyConfig() sets up the framebuffer, font, colors, UART and logging
+//  - a missing card, a disk without MBR and a volume without the file give
+//    their error codes
+//  - the pivt100.txt shipped in bin/ reads without errors
+//
+// Usage: config_test   (exit code is non-zero on failure)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/nmalloc.h"
+#include "../src/config.h"
+#include "../src/font_registry.h"
+#include "../src/debug_levels.h"
+#include "host_shims.h"
+
+#define SECTOR      512
+#define PART_START  8               // first sector of the partition
+#define HEAP_SIZE   (8*1024*1024)
+
+static unsigned char heap[HEAP_SIZE];
+
+/** A disk image with one FAT partition of one sector per cluster. */
+typedef struct
+{
+    unsigned char* image;
+    size_t size;
+    int fat32;
+    unsigned int fat_start;         // absolute sectors
+    unsigned int fat_size;
+    unsigned int root_start;
+    unsigned int data_start;
+    unsigned int next_cluster;      // first free cluster
+    unsigned int entries;           // root directory entries used
+} disk_t;
+
+static void put16(unsigned char* p, unsigned int v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(unsigned char* p, unsigned int v)
+{
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+/** Writes a FAT entry into both tables. */
+static void set_fat(disk_t* d, unsigned int cluster, unsigned int value)
+{
+    for (unsigned int copy = 0; copy < 2; copy++)
+    {
+        unsigned char* fat = d->image + (d->fat_start + copy * d->fat_size) * SECTOR;
+        if (d->fat32)
+            put32(fat + 4 * cluster, value);
+        else
+            put16(fat + 2 * cluster, value);
+    }
+}
+
+/** An empty FAT16 (8192 sectors) or FAT32 (70000 sectors) volume behind an MBR. */
+static void make_disk(disk_t* d, int fat32)
+{
+    const unsigned int sectors = fat32 ? 70000 : 8192;
+    const unsigned int reserved = fat32 ? 32 : 1;
+    const unsigned int root_entries = fat32 ? 0 : 512;
+
+    memset(d, 0, sizeof(*d));
+    d->fat32 = fat32;
+    d->size = (size_t)(PART_START + sectors) * SECTOR;
+    d->image = calloc(d->size, 1);
+    d->fat_start = PART_START + reserved;
+    d->fat_size = fat32 ? 548 : 32;
+    d->root_start = d->fat_start + 2 * d->fat_size;
+    d->data_start = d->root_start + root_entries * 32 / SECTOR;
+
+    unsigned char* mbr = d->image;
+    mbr[0x1be] = 0x80;
+    mbr[0x1be + 4] = fat32 ? 0x0c : 0x06;
+    put32(mbr + 0x1be + 8, PART_START);
+    put32(mbr + 0x1be + 12, sectors);
+    mbr[0x1fe] = 0x55;
+    mbr[0x1ff] = 0xaa;
+
+    unsigned char* bs = d->image + PART_START * SECTOR;
+    memcpy(bs, "\xeb\x58\x90MSWIN4.1", 11);
+    put16(bs + 11, SECTOR);
+    bs[13] = 1;                                 // sectors per cluster
+    put16(bs + 14, reserved);
+    bs[16] = 2;                                 // FATs
+    put16(bs + 17, root_entries);
+    put16(bs + 19, fat32 ? 0 : sectors);
+    bs[21] = 0xf8;
+    put16(bs + 22, fat32 ? 0 : d->fat_size);
+    put32(bs + 28, PART_START);
+    put32(bs + 32, fat32 ? sectors : 0);
+    if (fat32)
+    {
+        put32(bs + 36, d->fat_size);
+        put32(bs + 44, 2);                      // root directory cluster
+        bs[66] = 0x29;
+        memcpy(bs + 71, "PIVT100    FAT32   ", 19);
+    }
+    else
+    {
+        bs[38] = 0x29;
+        memcpy(bs + 43, "PIVT100    FAT16   ", 19);
+    }
+    bs[510] = 0x55;
+    bs[511] = 0xaa;
+
+    set_fat(d, 0, fat32 ? 0x0ffffff8 : 0xfff8);
+    set_fat(d, 1, fat32 ? 0x0fffffff : 0xffff);
+    d->next_cluster = 2;
+    if (fat32)
+        set_fat(d, d->next_cluster++, 0x0fffffff);
+}
+
+/** Adds a root directory entry; name is in 8.3 form, "PIVT100 TXT". */
+static void add_entry(disk_t* d, const char* name, unsigned char attr, const char* data, unsigned int len)
+{
+    unsigned int first = 0;
+    for (unsigned int offset = 0; offset < len; offset += SECTOR)
+    {
+        const unsigned int cluster = d->next_cluster++;
+        memcpy(d->image + (d->data_start + cluster - 2) * SECTOR, data + offset, (len - offset < SECTOR) ? len - offset : SECTOR);
+        set_fat(d, cluster, (offset + SECTOR < len) ? cluster + 1 : (d->fat32 ? 0x0fffffff : 0xffff));
+        if (first == 0)
+            first = cluster;
+    }
+
+    unsigned char* e = d->image + d->root_start * SECTOR + 32 * d->entries++;
+    memcpy(e, name, 11);
+    e[11] = attr;
+    put16(e + 20, first >> 16);
+    put16(e + 26, first);
+    put32(e + 28, len);
+}
+
+/** A configuration file of three clusters: the keys are spread over all of them. */
+static char* make_config(unsigned int* len)
+{
+    static const char* const keys[] =
+    {
+        "baudrate = 57600           ; comment after the value",
+        "foregroundColor = 10",
+        "fontSelection = 0",
+        "[display]",
+        "displayWidth = 800",
+        "displayHeight = 640",
+        "colorDepth = 16",
+        "maxFPS = 500               ; out of range, ignored",
+        "backgroundColor = 4",
+        "rowCompositor = 0",
+        "debugVerbosity = 1",
+        "keyboardLayout = us",
+    };
+    char* text = malloc(4096);
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < 12; i++)
+    {
+        n += sprintf(text + n, "%s\r\n", keys[i]);
+        n += sprintf(text + n, ";; padding, so that the keys of this file end up in all three clusters\r\n");
+    }
+    *len = n;
+    return text;
+}
+
+static char* read_file(const char* path, unsigned int* len)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* buf = malloc(*len);
+    if (fread(buf, 1, *len, f) != *len)
+    {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+    return buf;
+}
+
+/** Loads the configuration from the disk after resetting it to the defaults. */
+static unsigned char load(disk_t* d)
+{
+    host_sd_set_image(d ? d->image : 0, d ? d->size : 0);
+    setDefaultConfig();
+    PiVT100Config.hasChanged = 0;
+    return loadConfigFile();
+}
+
+int main()
+{
+    nmalloc_set_memory_area(heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+
+    unsigned int config_len;
+    char* config = make_config(&config_len);
+    CHECK(config_len > 2 * SECTOR && config_len <= 3 * SECTOR);
+    static const char kernel[3 * SECTOR] = { 1 };
+
+    for (int fat32 = 0; fat32 <= 1; fat32++)
+    {
+        disk_t d;
+        make_disk(&d, fat32);
+        add_entry(&d, "PIVT100    ", 0x08, 0, 0);
+        add_entry(&d, "Bp\0i\0v\0t\0\0\0", 0x0f, 0, 0);
+        add_entry(&d, "KERNEL  IMG", 0x20, kernel, sizeof(kernel));
+        add_entry(&d, "\xe5IVT100 TXT", 0x20, "baudrate = 300\r\n", 16);
+        add_entry(&d, "PIVT100 TXT", 0x20, config, config_len);
+
+        CHECK(load(&d) == errOK);
+        CHECK(PiVT100Config.hasChanged == 1);
+        CHECK(PiVT100Config.uartBaudrate == 57600);
+        CHECK(PiVT100Config.foregroundColor == 10);
+        CHECK(PiVT100Config.backgroundColor == 4);
+        CHECK(PiVT100Config.fontSelection == 0);
+        CHECK(PiVT100Config.displayWidth == 800);
+        CHECK(PiVT100Config.displayHeight == 640);
+        CHECK(PiVT100Config.colorDepth == 16);
+        CHECK(PiVT100Config.maxFPS == 60);
+        CHECK(PiVT100Config.rowCompositor == 0);
+        CHECK(PiVT100Config.debugVerbosity == 1);
+        CHECK(strcmp(PiVT100Config.keyboardLayout, "us") == 0);
+
+        applyConfig();
+        unsigned int width, height, rows, cols;
+        gfx_get_gfx_size(&width, &height);
+        gfx_get_term_size(&rows, &cols);
+        const font_descriptor_t* font = font_registry_get_info(0);
+        CHECK(host_fb_address() != 0);
+        CHECK(width == 800 && height == 640);
+        CHECK(font_registry_get_current_index() == 0);
+        CHECK(cols == 800u / font->width && rows == 640u / font->height);
+        CHECK(gfx_get_fg() == 10 && gfx_get_bg() == 4);
+        CHECK(host_uart_baudrate() == 57600);
+        CHECK(g_debug_severity == (LOG_ERROR_BIT | LOG_WARNING_BIT | LOG_NOTICE_BIT));
+        CHECK(PiVT100Config.hasChanged == 0);
+        g_debug_severity = 0;
+
+        // the shipped file
+        unsigned int shipped_len;
+        char* shipped = read_file("../bin/pivt100.txt", &shipped_len);
+        make_disk(&d, fat32);
+        add_entry(&d, "PIVT100 TXT", 0x20, shipped, shipped_len);
+        CHECK(load(&d) == errOK);
+        CHECK(PiVT100Config.hasChanged == 1);
+        free(shipped);
+        free(d.image);
+    }
+
+    // a missing card, a blank disk and a volume without pivt100.txt
+    CHECK(load(0) == errSDCARDINIT);
+    disk_t d;
+    make_disk(&d, 0);
+    add_entry(&d, "KERNEL  IMG", 0x20, kernel, sizeof(kernel));
+    CHECK(load(&d) == errLOCFILE);
+    memset(d.image, 0, SECTOR);
+    CHECK(load(&d) == errMBR);
+    CHECK(PiVT100Config.hasChanged == 0);
+    free(d.image);
+
+    free(config);
+    printf("pivt100.txt is read from FAT16 and FAT32 SD card images: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+//
+// cursor_test.c
+// Cursor drawing without framebuffer read-back
+//
+// PiVT100 host tools. The cursor is painted by drawing the cell under it
+// with swapped colors and removed by drawing the cell again. Checks that
+//  - a painted cursor is exactly the cell glyph in swapped colors, also on
+//    cells whose colors differ from the current ones
+//  - removing it gives back the screen without cursor
+//  - a cursor lifted after the cells scrolled (lazy scrolling) leaves the
+//    same screen as a redraw from the cells
+//
+// Usage: cursor_test   (exit code is non-zero on failure)
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/nmalloc.h"
+#include "../src/config.h"
+#include "../src/font_registry.h"
+#include "host_shims.h"
+
+#define FB_WIDTH    640
+#define FB_HEIGHT   480
+#define HEAP_SIZE   (4*1024*1024)
+
+static unsigned char heap[HEAP_SIZE];
+static unsigned char framebuffer[FB_WIDTH*FB_HEIGHT*FB_VIRTUAL_SCREENS];
+static unsigned char before[FB_WIDTH*FB_HEIGHT], after[FB_WIDTH*FB_HEIGHT];
+
+static const unsigned char* screen()
+{
+    return framebuffer + host_fb_yoffset() * FB_WIDTH;
+}
+
+/** Paints or removes the cursor at the cursor position. */
+static void show_cursor(int visible)
+{
+    gfx_term_set_cursor_visibility(visible);
+    gfx_term_render_cursor();
+}
+
+int main()
+{
+    nmalloc_set_memory_area(heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+    gfx_set_env(framebuffer, FB_WIDTH, FB_HEIGHT, 8, FB_WIDTH, sizeof(framebuffer));
+    gfx_set_bg(0);
+    gfx_set_fg(7);
+
+    unsigned int rows, cols;
+    gfx_get_term_size(&rows, &cols);
+    const unsigned int fw = FB_WIDTH / cols;
+    const unsigned int fh = FB_HEIGHT / rows;
+
+    // a red on blue 'A' with the current colors still white on black
+    gfx_term_set_cursor_visibility(0);
+    gfx_term_putstring("\x1b[2J\x1b[1;1Hxx\x1b[31;44mA\x1b[0mz\x1b[1;3H");
+    gfx_term_flush();
+    memcpy(before, screen(), sizeof(before));
+
+    show_cursor(1);
+    memcpy(after, screen(), sizeof(after));
+
+    // only the cursor cell changed, to red on blue with swapped pixels
+    int outside = 0, swapped = 0;
+    for (unsigned int y = 0; y < FB_HEIGHT; y++)
+        for (unsigned int x = 0; x < FB_WIDTH; x++)
+        {
+            const unsigned int i = y * FB_WIDTH + x;
+            if (y < fh && x >= 2 * fw && x < 3 * fw)
+                swapped += (before[i] == 1 && after[i] == 4) || (before[i] == 4 && after[i] == 1);
+            else
+                outside += before[i] != after[i];
+        }
+    CHECK(outside == 0);
+    CHECK(swapped == (int)(fw * fh));
+
+    show_cursor(0);
+    CHECK(memcmp(before, screen(), sizeof(before)) == 0);
+
+    // cursor on the last row, then a batch that scrolls before the cursor is lifted
+    show_cursor(1);
+    char line[64];
+    for (unsigned int i = 0; i < rows + 5; i++)
+    {
+        snprintf(line, sizeof(line), "\x1b[3%um%u line\x1b[0m\r\n", 1 + i % 6, i);
+        gfx_term_write(line, strlen(line));
+        gfx_term_flush();
+    }
+    show_cursor(0);
+    memcpy(before, screen(), sizeof(before));
+    gfx_term_redraw();
+    CHECK(memcmp(before, screen(), sizeof(before)) == 0);
+
+    printf("cursor drawn from the cells, no framebuffer read-back: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
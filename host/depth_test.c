@@ -0,0 +1,179 @@
+//
+// depth_test.c
+// Rendering at 16 and 32 bits per pixel
+//
+// PiVT100 host tools. Runs the same terminal output at 8 bpp and with the
+// 16 and 32 bpp back-ends and converts the 8 bpp screen through the
+// palette: RGB565 for 16 bpp, 4 bytes R, G, B, 0xFF in memory for 32 bpp,
+// red and blue swapped when the firmware reports the BGR pixel order.
+// Checks that
+//  - every pixel of the 16 and 32 bpp screens is the converted 8 bpp pixel,
+//    in both pixel orders,
+//    for every built-in font and a byte per pixel copy of the first one,
+//    with the CPU, immediate and deferred DMA, the row compositor, the
+//    glyph cache and page flipping
+//  - fills, scrolls and character shifts move whole pixels: the workload
+//    scrolls by panning and in a region, inserts and deletes characters and
+//    lines and shifts the screen sideways by an odd number of pixels
+//
+// Usage: depth_test   (exit code is non-zero on failure)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/nmalloc.h"
+#include "../src/config.h"
+#include "../src/font_registry.h"
+#include "../src/framebuffer.h"
+#include "../src/dma.h"
+#include "host_shims.h"
+
+#define FB_WIDTH    640
+#define FB_HEIGHT   480
+#define HEAP_SIZE   (8*1024*1024)
+
+static unsigned char heap[HEAP_SIZE];
+static unsigned char framebuffer[FB_WIDTH*FB_HEIGHT*4*FB_VIRTUAL_SCREENS];
+static unsigned char reference[FB_WIDTH*FB_HEIGHT];
+
+extern unsigned char* font_get_glyph_address(unsigned int c);
+extern void gfx_scroll_left(unsigned int npixels);
+extern void gfx_scroll_right(unsigned int npixels);
+
+static const unsigned char* screen(unsigned int bpp)
+{
+    return framebuffer + host_fb_yoffset() * FB_WIDTH * bpp / 8;
+}
+
+static void reset_terminal(unsigned int bpp, int font)
+{
+    gfx_set_env(framebuffer, FB_WIDTH, FB_HEIGHT, bpp, FB_WIDTH * bpp / 8, FB_WIDTH * bpp / 8 * FB_HEIGHT * FB_VIRTUAL_SCREENS);
+    gfx_term_set_font(font);
+    gfx_set_default_bg(0);
+    gfx_set_default_fg(7);
+    gfx_set_bg(0);
+    gfx_set_fg(7);
+    gfx_term_putstring("\x1b[2J");
+}
+
+/** Colored output in the 16 and the 256 color palette with scrolling, a
+ *  region, insert/delete character and line, erases and sideways shifts. */
+static void terminal_workload()
+{
+    char line[128];
+    for (unsigned int i = 0; i < 60; i++)
+    {
+        snprintf(line, sizeof(line), "\x1b[%um\x1b[38;5;%umline %u \x1b[48;5;%um colors \x1b[0m tail\r\n",
+                 31 + i % 7, 16 + (i * 37) % 240, i, 16 + (i * 11) % 240);
+        gfx_term_write(line, strlen(line));
+        host_advance_time(20000);
+        gfx_term_flush();
+    }
+    gfx_term_putstring("\x1b[3;12r\x1b[12;1H");
+    for (unsigned int i = 0; i < 15; i++)
+    {
+        snprintf(line, sizeof(line), "\x1b[4%um region %u\x1b[0m\r\n", 1 + i % 6, i);
+        gfx_term_putstring(line);
+    }
+    gfx_term_putstring("\x1b[r\x1b[5;3H\x1b[1@\x1b[1@\x1b[1P\x1b[7;1H\x1b[1L\x1b[9;1H\x1b[1M");
+    gfx_term_putstring("\x1b[15;20H\x1b[44m\x1b[K\x1b[16;5H\x1b[1K\x1b[0m\x1b[20;1Hend");
+    gfx_scroll_left(3);
+    gfx_scroll_right(5);
+    gfx_set_fg(196);
+    gfx_fill_rect(101, 33, 17, 9);
+    gfx_set_fg(7);
+    host_advance_time(20000);
+    gfx_term_flush();
+}
+
+/** Compares the screen of depth bpp pixel by pixel with the converted
+ *  reference, in the given pixel order. */
+static unsigned int count_differences(unsigned int bpp, unsigned int order)
+{
+    const unsigned int* rgb = fb_get_palette();
+    const unsigned char* p = screen(bpp);
+    unsigned int differ = 0;
+    for (unsigned int i = 0; i < FB_WIDTH * FB_HEIGHT; i++)
+    {
+        const unsigned int c = rgb[reference[i]];
+        const unsigned char r = c >> 16, g = c >> 8, b = c;
+        const unsigned char first = (order == FB_PIXEL_ORDER_RGB) ? r : b;
+        const unsigned char last = (order == FB_PIXEL_ORDER_RGB) ? b : r;
+        if (bpp == 16)
+        {
+            // the first color in the high bits
+            const unsigned int expected = ((first & 0xF8) << 8) | ((g & 0xFC) << 3) | (last >> 3);
+            differ += (((const unsigned short*)p)[i] != expected);
+        }
+        else
+        {
+            // the first color in the first byte
+            const unsigned char* px = p + 4 * i;
+            differ += (px[0] != first || px[1] != g || px[2] != last || px[3] != 0xFF);
+        }
+    }
+    return differ;
+}
+
+int main()
+{
+    PiVT100Config.maxFPS = 60;
+    nmalloc_set_memory_area(heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+
+    const int builtin = font_registry_get_count();
+    const font_descriptor_t* first = font_registry_get_info(0);
+    const int bytes_font = font_registry_register("bytes", first->width, first->height, unpack_font(first),
+                                                  FONT_FORMAT_BYTES, font_get_glyph_address);
+
+    static const char* const modes[] = { "cpu", "dma", "deferred dma + cache", "compose + cache", "flip + compose" };
+    static const char* const orders[] = { "BGR", "RGB" };
+    unsigned int checked = 0;
+    for (int font = 0; font < builtin + 1; font++)
+    {
+        const int index = (font < builtin) ? font : bytes_font;
+
+        // 8 bpp, drawn by the CPU glyph by glyph
+        PiVT100Config.disableGfxDMA = 1;
+        PiVT100Config.rowCompositor = 0;
+        PiVT100Config.glyphCacheSize = 0;
+        PiVT100Config.pageFlip = 0;
+        reset_terminal(8, index);
+        terminal_workload();
+        memcpy(reference, screen(8), sizeof(reference));
+
+        for (unsigned int order = FB_PIXEL_ORDER_BGR; order <= FB_PIXEL_ORDER_RGB; order++)
+        {
+            host_fb_set_pixel_order(order);
+            for (unsigned int bpp = 16; bpp <= 32; bpp += 16)
+                for (int mode = 0; mode < 5; mode++)
+                {
+                    PiVT100Config.disableGfxDMA = (mode == 0 || mode == 3);
+                    PiVT100Config.glyphCacheSize = (mode == 2 || mode == 3) ? 64 : 0;
+                    PiVT100Config.rowCompositor = (mode >= 3);
+                    PiVT100Config.pageFlip = (mode == 4);
+                    host_dma_set_deferred(mode == 2);
+                    reset_terminal(bpp, index);
+                    terminal_workload();
+                    dma_execute_queue();
+                    host_dma_set_deferred(0);
+
+                    const unsigned int differ = count_differences(bpp, order);
+                    if (differ)
+                        printf("FAIL %s %u bpp %s %s: %u pixels differ\n", font_registry_get_info(index)->name, bpp, orders[order],
+                               modes[mode], differ);
+                    CHECK(differ == 0);
+                    checked++;
+                }
+        }
+    }
+
+    host_fb_set_pixel_order(FB_PIXEL_ORDER_RGB);
+
+    printf("16 and 32 bpp render the 8 bpp screen in RGB and BGR order, %u runs: %s\n", checked, failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
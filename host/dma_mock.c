@@ -0,0 +1,182 @@
+//
+// dma_mock.c
+// Software DMA engine behind the dma.h interface
+//
+// PiVT100 host tools. Control blocks are executed by the CPU with the
+// BCM2835 semantics used by gfx.c. Like the DMA engine every row is copied
+// front to back, so a transfer onto its own source shows the damage a real
+// one would do. Batches complete in submission order;
+// in deferred mode nothing runs before its fence is waited for, so a CPU
+// access that forgets to wait sees (or loses against) stale data.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../src/dma.h"
+#include "host_shims.h"
+
+typedef struct
+{
+    unsigned char* src;
+    unsigned char* dst;
+    unsigned int len;
+    unsigned int stride;
+    unsigned int ti;
+    unsigned int fill;      // source word of dma_fill_rect()
+    dma_fence_t fence;      // 0 while the batch is still open
+} mock_op;
+
+static mock_op* ops = 0;
+static unsigned int ops_count = 0;      // enqueued operations
+static unsigned int ops_cap = 0;
+static unsigned int ops_done = 0;       // operations executed
+static dma_fence_t fence_submitted = 0;
+static dma_fence_t fence_completed = 0;
+static int deferred = 0;
+static unsigned char bounce[4096];     // small, so dma_move_rect() needs several bands
+
+/** 2D mode follows the BCM2835 layout: len = (ylen-1) << 16 | xlen,
+ *  stride = dst stride << 16 | src stride (signed 16 bit each). */
+static void mock_run(const mock_op* op)
+{
+    const unsigned char* s = op->src ? op->src : (const unsigned char*)&op->fill;
+    unsigned char* d = op->dst;
+    unsigned int rows = 1;
+    unsigned int xlen = op->len;
+
+    if (op->ti & DMA_TI_2DMODE)
+    {
+        rows = ((op->len >> 16) & 0x3FFF) + 1;
+        xlen = op->len & 0xFFFF;
+    }
+    for (unsigned int r = 0; r < rows; r++)
+    {
+        if (op->ti & DMA_TI_SRC_INC)
+            for (unsigned int i = 0; i < xlen; i++)
+                d[i] = s[i];
+        else
+            for (unsigned int i = 0; i < xlen; i += 4)
+                memcpy(d + i, s, xlen - i < 4 ? xlen - i : 4);
+        if (op->ti & DMA_TI_SRC_INC)
+            s += (int)xlen + (int16_t)(op->stride & 0xFFFF);
+        d += (int)xlen + (int16_t)(op->stride >> 16);
+    }
+}
+
+/** Runs all submitted operations up to fence, oldest first. */
+static void mock_complete(dma_fence_t fence)
+{
+    while (ops_done < ops_count && ops[ops_done].fence && ops[ops_done].fence <= fence)
+    {
+        mock_run(&ops[ops_done]);
+        fence_completed = ops[ops_done].fence;
+        ops_done++;
+    }
+    if (fence_completed < fence && fence <= fence_submitted)
+        fence_completed = fence;    // empty batches
+    if (ops_done == ops_count)
+    {
+        ops_count = ops_done = 0;
+    }
+}
+
+void host_dma_set_deferred(int on)
+{
+    deferred = on;
+}
+
+unsigned int host_dma_pending()
+{
+    unsigned int n = 0;
+    for (unsigned int i = ops_done; i < ops_count; i++)
+        if (ops[i].fence) n++;
+    return n;
+}
+
+void dma_init()
+{
+    mock_complete(fence_submitted);
+}
+
+int dma_enqueue_operation(void* src, void* dst, unsigned int len, unsigned int stride, unsigned int TRANSFER_INFO)
+{
+    if (ops_count == ops_cap)
+    {
+        ops_cap = ops_cap ? 2 * ops_cap : 256;
+        ops = realloc(ops, ops_cap * sizeof(mock_op));
+    }
+    mock_op* op = &ops[ops_count++];
+    op->src = src;
+    op->dst = dst;
+    op->len = len;
+    op->stride = stride;
+    op->ti = TRANSFER_INFO;
+    op->fill = 0;
+    op->fence = 0;
+
+    unsigned int open = 0;
+    for (unsigned int i = ops_count; i > ops_done && ops[i-1].fence == 0; i--)
+        open++;
+    return open;
+}
+
+dma_fence_t dma_submit()
+{
+    int open = 0;
+    for (unsigned int i = ops_count; i > ops_done && ops[i-1].fence == 0; i--)
+    {
+        ops[i-1].fence = fence_submitted + 1;
+        open = 1;
+    }
+    if (open) fence_submitted++;
+    if (!deferred) mock_complete(fence_submitted);
+    return fence_submitted;
+}
+
+int dma_fence_done(dma_fence_t fence)
+{
+    return fence <= fence_completed;
+}
+
+void dma_wait(dma_fence_t fence)
+{
+    mock_complete(fence);
+}
+
+void dma_execute_queue()
+{
+    dma_wait(dma_submit());
+}
+
+int dma_running()
+{
+    return fence_completed != fence_submitted;
+}
+
+void dma_memcpy_32(void* src, void *dst, unsigned int size)
+{
+    dma_enqueue_operation(src, dst, size, 0, DMA_TI_SRC_INC | DMA_TI_DEST_INC);
+    dma_execute_queue();
+}
+
+int dma_fill_rect(void* dst, unsigned int width, unsigned int height, unsigned int pitch, unsigned int color32)
+{
+    const int queued = dma_enqueue_operation(0, dst, (((height-1) & 0x3FFF) << 16) | (width & 0xFFFF),
+                                             ((pitch - width) & 0xFFFF) << 16, DMA_TI_DEST_INC | DMA_TI_2DMODE);
+    ops[ops_count-1].fill = color32;
+    return queued;
+}
+
+void dma_clean_source(const void* src, unsigned int size)
+{
+    // the mock reads the same memory the CPU wrote, nothing to write back
+    (void)src;
+    (void)size;
+}
+
+void* dma_get_bounce_buffer(unsigned int* size)
+{
+    *size = sizeof(bounce);
+    return bounce;
+}
@@ -0,0 +1,251 @@
+//
+// dma_test.c
+// Ordering tests for the DMA interface and its use in gfx.c
+//
+// PiVT100 host tools. Runs against the software DMA engine in dma_mock.c:
+//  - fences complete in submission order, transfers of a batch run in
+//    enqueue order and nothing moves before it is waited for
+//  - constant fills cover exactly their rectangle
+//  - dma_move_rect() gives the result of a memmove for overlapping
+//    rectangles in every direction, dma_copy_rect() copies between
+//    different pitches
+//  - the same terminal output rendered with the CPU, with DMA completing
+//    immediately and with DMA completing only when waited for gives the
+//    same screen, so gfx.c never touches pixels a transfer still owns;
+//    with and without the row compositor
+//
+// Usage: dma_test   (exit code is non-zero on failure)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/dma.h"
+#include "../src/nmalloc.h"
+#include "../src/config.h"
+#include "../src/font_registry.h"
+#include "host_shims.h"
+
+#define FB_WIDTH    640
+#define FB_HEIGHT   480
+#define HEAP_SIZE   (4*1024*1024)
+
+static unsigned char heap[HEAP_SIZE];
+static unsigned char framebuffer[FB_WIDTH*FB_HEIGHT*FB_VIRTUAL_SCREENS];
+static unsigned char screens[6][FB_WIDTH*FB_HEIGHT];
+
+static void test_fences()
+{
+    static unsigned int a[64], b[64], c[64];
+    for (unsigned int i = 0; i < 64; i++)
+    {
+        a[i] = i + 1;
+        b[i] = c[i] = 0;
+    }
+
+    host_dma_set_deferred(1);
+    CHECK(dma_fence_done(0));
+
+    dma_enqueue_operation(a, b, sizeof(a), 0, DMA_TI_SRC_INC | DMA_TI_DEST_INC);
+    const dma_fence_t f1 = dma_submit();
+    dma_enqueue_operation(b, c, sizeof(b), 0, DMA_TI_SRC_INC | DMA_TI_DEST_INC);
+    const dma_fence_t f2 = dma_submit();
+    CHECK(f1 != 0 && f2 != f1);
+    CHECK(!dma_fence_done(f1) && !dma_fence_done(f2));
+    CHECK(dma_running());
+    CHECK(b[0] == 0 && c[0] == 0);
+
+    // the second batch reads what the first one wrote
+    dma_wait(f2);
+    CHECK(dma_fence_done(f1) && dma_fence_done(f2));
+    CHECK(memcmp(a, c, sizeof(a)) == 0);
+    CHECK(!dma_running());
+
+    // transfers of one batch run in enqueue order
+    memset(b, 0, sizeof(b));
+    memset(c, 0, sizeof(c));
+    dma_enqueue_operation(a, b, 32, 0, DMA_TI_SRC_INC | DMA_TI_DEST_INC);
+    dma_enqueue_operation(b, c, 32, 0, DMA_TI_SRC_INC | DMA_TI_DEST_INC);
+    CHECK(dma_enqueue_operation(c, b + 8, 32, 0, DMA_TI_SRC_INC | DMA_TI_DEST_INC) == 3);
+    const dma_fence_t f3 = dma_submit();
+    CHECK(host_dma_pending() == 3);
+    dma_wait(f3);
+    CHECK(host_dma_pending() == 0);
+    CHECK(c[0] == 1 && c[7] == 8 && b[8] == 1 && b[15] == 8);
+
+    // more transfers than control blocks in the ring
+    memset(b, 0, sizeof(b));
+    for (unsigned int i = 0; i < 4 * DMA_CB_COUNT; i++)
+        dma_enqueue_operation(&a[i % 64], &b[i % 64], 4, 0, DMA_TI_SRC_INC | DMA_TI_DEST_INC);
+    dma_execute_queue();
+    CHECK(memcmp(a, b, sizeof(a)) == 0);
+
+    // constant fills: every queued fill keeps its own color
+    static unsigned char rect[32*16];
+    memset(rect, 0xEE, sizeof(rect));
+    dma_fill_rect(rect + 32 + 3, 13, 5, 32, 0x11111111);
+    const dma_fence_t f4 = dma_submit();
+    dma_fill_rect(rect + 8*32 + 1, 30, 2, 32, 0x22222222);
+    dma_submit();
+    CHECK(!dma_fence_done(f4) && rect[32+3] == 0xEE);
+    dma_execute_queue();
+    unsigned int filled = 0;
+    for (unsigned int y = 0; y < 16; y++)
+        for (unsigned int x = 0; x < 32; x++)
+        {
+            const unsigned char v = rect[y*32 + x];
+            const unsigned char expect = (y >= 1 && y < 6 && x >= 3 && x < 16) ? 0x11 :
+                                         (y >= 8 && y < 10 && x >= 1 && x < 31) ? 0x22 : 0xEE;
+            filled += (v == expect);
+        }
+    CHECK(filled == sizeof(rect));
+
+    // an empty submit returns the last fence
+    CHECK(dma_fence_done(dma_submit()));
+
+    host_dma_set_deferred(0);
+    printf("fences and transfer order: %s\n", failures ? "FAIL" : "ok");
+}
+
+/** Moves random rectangles inside one buffer, often overlapping, and
+ *  compares with a copy through a separate buffer. */
+static void test_move_rect()
+{
+    enum { PITCH = 200, LINES = 120 };
+    static unsigned char buf[PITCH*LINES], ref[PITCH*LINES], tmp[PITCH*LINES];
+    int errors = 0;
+
+    srand(1);
+    for (unsigned int i = 0; i < sizeof(buf); i++)
+        buf[i] = ref[i] = rand();
+
+    for (unsigned int n = 0; n < 2000; n++)
+    {
+        const unsigned int w = 1 + rand() % (PITCH - 1);
+        const unsigned int h = 1 + rand() % (LINES - 1);
+        const unsigned int sx = rand() % (PITCH - w + 1), sy = rand() % (LINES - h + 1);
+        // mostly small distances, so source and destination overlap
+        int dx = (n & 1) ? rand() % 9 - 4 : rand() % (PITCH - w + 1) - (int)sx;
+        int dy = (n & 2) ? rand() % 5 - 2 : rand() % (LINES - h + 1) - (int)sy;
+        if ((int)sx + dx < 0 || sx + dx + w > PITCH) dx = 0;
+        if ((int)sy + dy < 0 || sy + dy + h > LINES) dy = 0;
+
+        for (unsigned int y = 0; y < h; y++)
+            memcpy(tmp + y * w, ref + (sy + y) * PITCH + sx, w);
+        for (unsigned int y = 0; y < h; y++)
+            memcpy(ref + (sy + dy + y) * PITCH + sx + dx, tmp + y * w, w);
+
+        host_dma_set_deferred(n & 4);
+        dma_move_rect(buf + (sy + dy) * PITCH + sx + dx, buf + sy * PITCH + sx, w, h, PITCH);
+        dma_execute_queue();
+        if (memcmp(buf, ref, sizeof(buf)) != 0)
+        {
+            if (errors++ == 0)
+                printf("FAIL move %ux%u from %u,%u by %d,%d\n", w, h, sx, sy, dx, dy);
+            memcpy(buf, ref, sizeof(buf));
+        }
+    }
+    host_dma_set_deferred(0);
+    CHECK(errors == 0);
+    printf("overlapping rectangle moves: %s\n", errors ? "FAIL" : "ok");
+}
+
+/** Copies random rectangles from a packed buffer into a wider one, like the
+ *  row compositor flushing into the framebuffer. */
+static void test_copy_rect()
+{
+    enum { SRC_PITCH = 64, DST_PITCH = 200, LINES = 40 };
+    static unsigned char src[SRC_PITCH*LINES], buf[DST_PITCH*LINES], ref[DST_PITCH*LINES];
+    int errors = 0;
+
+    srand(2);
+    for (unsigned int i = 0; i < sizeof(src); i++)
+        src[i] = rand();
+    for (unsigned int n = 0; n < 1000; n++)
+    {
+        const unsigned int w = 1 + rand() % SRC_PITCH;
+        const unsigned int h = 1 + rand() % LINES;
+        const unsigned int sx = rand() % (SRC_PITCH - w + 1);
+        const unsigned int dx = rand() % (DST_PITCH - w + 1), dy = rand() % (LINES - h + 1);
+        memset(buf, 0x5A, sizeof(buf));
+        memset(ref, 0x5A, sizeof(ref));
+        for (unsigned int y = 0; y < h; y++)
+            memcpy(ref + (dy + y) * DST_PITCH + dx, src + y * SRC_PITCH + sx, w);
+
+        host_dma_set_deferred(n & 1);
+        dma_copy_rect(buf + dy * DST_PITCH + dx, DST_PITCH, src + sx, SRC_PITCH, w, h);
+        dma_execute_queue();
+        if (memcmp(buf, ref, sizeof(buf)) != 0 && errors++ == 0)
+            printf("FAIL copy %ux%u from %u to %u,%u\n", w, h, sx, dx, dy);
+    }
+    host_dma_set_deferred(0);
+    CHECK(errors == 0);
+    printf("rectangle copies between pitches: %s\n", errors ? "FAIL" : "ok");
+}
+
+/** Output exercising every DMA path of gfx.c: clear, panned scrolling with
+ *  wrap around, scrolling regions, insert/delete line and character. */
+static void terminal_workload()
+{
+    char line[128];
+    gfx_term_putstring("\x1b[2J");
+    for (unsigned int i = 0; i < 300; i++)
+    {
+        snprintf(line, sizeof(line), "\x1b[%um%4u some text for the scroll test\x1b[0m\r\n", 31 + i % 7, i);
+        gfx_term_write(line, strlen(line));
+        if (i % 7 == 0) gfx_term_flush();
+    }
+    gfx_term_putstring("\x1b[3;15r\x1b[15;1H");
+    for (unsigned int i = 0; i < 40; i++)
+    {
+        snprintf(line, sizeof(line), "region %u\r\n", i);
+        gfx_term_write(line, strlen(line));
+        gfx_term_flush();
+    }
+    gfx_term_putstring("\x1b[5;1H\x1b[1L\x1b[1L\x1b[8;1H\x1b[1M\x1b[5;3Hinserted\x1b[5;3H\x1b[1@\x1b[1@\x1b[1P");
+    gfx_term_putstring("\x1b[r\x1b[20;1H\x1b[44mblue\x1b[K\r\n\x1b[0m\x1b[1;1H\x1b[2Kdone\x1b[2;10H\x1b[1J\x1b[9;4H\x1b[1K\x1b[7;7Hend");
+    gfx_term_flush();
+}
+
+static void run(int cpu, int deferred, int compose, unsigned char* screen)
+{
+    PiVT100Config.disableGfxDMA = cpu;
+    PiVT100Config.rowCompositor = compose;
+    host_dma_set_deferred(deferred);
+    gfx_set_env(framebuffer, FB_WIDTH, FB_HEIGHT, 8, FB_WIDTH, sizeof(framebuffer));
+    gfx_set_default_bg(0);
+    gfx_set_default_fg(7);
+    gfx_set_bg(0);
+    gfx_set_fg(7);
+    terminal_workload();
+    dma_execute_queue();
+    memcpy(screen, framebuffer + host_fb_yoffset() * FB_WIDTH, FB_WIDTH*FB_HEIGHT);
+    host_dma_set_deferred(0);
+}
+
+int main()
+{
+    nmalloc_set_memory_area(heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+
+    test_fences();
+    test_move_rect();
+    test_copy_rect();
+
+    int same = 1;
+    for (int compose = 0; compose < 2; compose++)
+    {
+        run(1, 0, compose, screens[3 * compose + 0]);
+        run(0, 0, compose, screens[3 * compose + 1]);
+        run(0, 1, compose, screens[3 * compose + 2]);
+    }
+    for (int i = 1; i < 6; i++)
+        same &= memcmp(screens[0], screens[i], sizeof(screens[0])) == 0;
+    CHECK(same);
+    printf("cpu, immediate and deferred DMA render the same screen, with and without row compositor: %s\n", same ? "ok" : "FAIL");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,194 @@
+//
+// flip_test.c
+// Page flipping with dirty line spans
+//
+// PiVT100 host tools. With pageFlip set the terminal draws on a hidden back
+// page and gfx_term_flush() shows it; the other page then catches up by
+// copying only the line spans drawn since. Checks that
+//  - after every flush the display shows exactly the screen a run without
+//    page flipping has at that point, with the CPU, immediate and deferred
+//    DMA, with and without row compositor, so no half drawn page is shown
+//  - a flush with nothing drawn does not flip, nor does one within a
+//    display refresh of the last flip; that one follows later
+//  - updating a few cells copies a few cells, not the screen
+//  - the setup overlay still opens and closes on the right page
+//
+// Usage: flip_test   (exit code is non-zero on failure)
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/nmalloc.h"
+#include "../src/config.h"
+#include "../src/font_registry.h"
+#include "../src/dma.h"
+#include "host_shims.h"
+
+#define FB_WIDTH    640
+#define FB_HEIGHT   480
+#define HEAP_SIZE   (4*1024*1024)
+#define MAX_FRAMES  1024
+
+static unsigned char heap[HEAP_SIZE];
+static unsigned char framebuffer[FB_WIDTH*FB_HEIGHT*FB_VIRTUAL_SCREENS];
+static unsigned int reference[MAX_FRAMES];
+static unsigned int frames;
+static int recording, mismatches;
+
+static const unsigned char* screen()
+{
+    return framebuffer + host_fb_yoffset() * FB_WIDTH;
+}
+
+/** FNV-1a hash of the screen shown. */
+static unsigned int screen_hash()
+{
+    const unsigned char* p = screen();
+    unsigned int h = 2166136261u;
+    for (unsigned int i = 0; i < FB_WIDTH * FB_HEIGHT; i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+/** Ends a frame: flushes and records the screen shown, or compares it with the recording.
+ *  Frames are 20 ms apart, longer than a display refresh. */
+static void frame()
+{
+    host_advance_time(20000);
+    gfx_term_flush();
+    if (frames >= MAX_FRAMES) return;
+    if (recording)
+        reference[frames] = screen_hash();
+    else if (reference[frames] != screen_hash())
+        mismatches++;
+    frames++;
+}
+
+static void write_frame(const char* text)
+{
+    gfx_term_write(text, strlen(text));
+    frame();
+}
+
+/** Scrolling output with wrap around, a scrolling region, insert/delete
+ *  line and character, erases and a full screen application updating a few cells. */
+static void terminal_workload()
+{
+    char line[128];
+    write_frame("\x1b[2J");
+    for (unsigned int i = 0; i < 200; i++)
+    {
+        snprintf(line, sizeof(line), "\x1b[%um%4u some text for the flip test\x1b[0m\r\n", 31 + i % 7, i);
+        gfx_term_write(line, strlen(line));
+        if (i % 3 == 0) frame();
+    }
+    write_frame("\x1b[3;15r\x1b[15;1H");
+    for (unsigned int i = 0; i < 30; i++)
+    {
+        snprintf(line, sizeof(line), "region %u\r\n", i);
+        write_frame(line);
+    }
+    write_frame("\x1b[5;1H\x1b[1L\x1b[1L\x1b[8;1H\x1b[1M\x1b[5;3Hinserted\x1b[5;3H\x1b[1@\x1b[1@\x1b[1P");
+    write_frame("\x1b[r\x1b[20;1H\x1b[44mblue\x1b[K\r\n\x1b[0m\x1b[1;1H\x1b[2Kdone\x1b[2;10H\x1b[1J\x1b[9;4H\x1b[1K\x1b[7;7Hend");
+
+    write_frame("\x1b[2J\x1b[1;1H\x1b[7m top - load average: 0.00 \x1b[K\x1b[0m");
+    for (unsigned int i = 0; i < 100; i++)
+    {
+        snprintf(line, sizeof(line), "\x1b[1;60H12:34:%02u\x1b[%u;10H%5u%%", i % 60, 5 + i % 10, i);
+        write_frame(line);
+    }
+}
+
+/** Resets the terminal, frames are counted from here on. */
+static void reset_terminal(int flip, int cpu, int deferred, int compose)
+{
+    PiVT100Config.pageFlip = flip;
+    PiVT100Config.disableGfxDMA = cpu;
+    PiVT100Config.rowCompositor = compose;
+    host_dma_set_deferred(deferred);
+    gfx_set_env(framebuffer, FB_WIDTH, FB_HEIGHT, 8, FB_WIDTH, sizeof(framebuffer));
+    gfx_set_default_bg(0);
+    gfx_set_default_fg(7);
+    gfx_set_bg(0);
+    gfx_set_fg(7);
+    frames = 0;
+    mismatches = 0;
+}
+
+int main()
+{
+    nmalloc_set_memory_area(heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+
+    // the screens without page flipping, drawn by the CPU
+    reset_terminal(0, 1, 0, 0);
+    recording = 1;
+    terminal_workload();
+    recording = 0;
+    const unsigned int reference_frames = frames;
+
+    for (int compose = 0; compose < 2; compose++)
+        for (int mode = 0; mode < 3; mode++)
+        {
+            reset_terminal(1, mode == 0, mode == 2, compose);
+            gfx_reset_stats();
+            terminal_workload();
+            if (mismatches)
+                printf("FAIL %s DMA%s: %d of %u frames differ\n", mode == 0 ? "without" : mode == 1 ? "immediate" : "deferred",
+                       compose ? " + compose" : "", mismatches, frames);
+            CHECK(mismatches == 0 && frames == reference_frames);
+            dma_execute_queue();
+            host_dma_set_deferred(0);
+        }
+
+    // nothing drawn, no flip
+    gfx_stats_t before, after;
+    gfx_get_stats(&before);
+    const unsigned int shown = host_fb_yoffset();
+    gfx_term_flush();
+    gfx_get_stats(&after);
+    CHECK(after.page_flips == before.page_flips);
+    CHECK(host_fb_yoffset() == shown);
+
+    // two flushes within a refresh: the second frame waits for a later flush
+    write_frame("\x1b[1;60H12:34:58");
+    const unsigned int first_hash = screen_hash();
+    gfx_term_putstring("\x1b[1;60H12:34:59");
+    gfx_term_flush();
+    CHECK(screen_hash() == first_hash);
+    host_advance_time(20000);
+    gfx_term_flush();
+    CHECK(screen_hash() != first_hash);
+
+    // a status line update flips and copies the cells drawn, plus the cursor
+    write_frame("\x1b[1;60H12:35:00");
+    write_frame("\x1b[1;60H12:35:01");
+    gfx_get_stats(&before);
+    write_frame("\x1b[1;60H12:35:02");
+    gfx_get_stats(&after);
+    const unsigned long long copied = after.page_copied - before.page_copied;
+    printf("status line update: %llu flip, %llu bytes copied to the back page (screen %u bytes)\n",
+           after.page_flips - before.page_flips, copied, FB_WIDTH * FB_HEIGHT);
+    CHECK(after.page_flips - before.page_flips == 1);
+    CHECK(copied > 0 && copied <= 10 * 8 * 24);
+    CHECK(host_fb_yoffset() != shown);
+
+    // the overlay leaves the display on the overlay page, closing shows the last flipped page
+    reset_terminal(1, 1, 0, 1);
+    write_frame("\x1b[2Jbefore setup\r\n");
+    CHECK(gfx_overlay_open(0));
+    const unsigned int overlay_offset = host_fb_yoffset();
+    write_frame("during setup\r\n");
+    CHECK(host_fb_yoffset() == overlay_offset);
+    gfx_overlay_close();
+    const unsigned int hash = screen_hash();
+    reset_terminal(0, 1, 0, 1);
+    write_frame("\x1b[2Jbefore setup\r\nduring setup\r\n");
+    CHECK(screen_hash() == hash);
+
+    printf("page flips show complete frames and copy only the damage: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+//
+// font_bench.c
+// Glyph rendering benchmark for the font formats
+//
+// PiVT100 host tools. For every built-in font (packed, 1 bit per pixel) a
+// copy in the byte per pixel format is registered, then both are used to
+// draw the same pseudo random text; fonts with random glyphs cover the other
+// glyph kernel widths. Prints glyphs/s, the size of the glyph
+// data and, where the kernel allows perf_event_open(), the L1 data cache
+// and last level cache misses per glyph. Both formats must give the same
+// framebuffer content.
+//
+// Usage: font_bench   (exit code is non-zero if the formats render differently)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/nmalloc.h"
+#include "../src/font_registry.h"
+#include "host_shims.h"
+
+#define FB_WIDTH    640
+#define FB_HEIGHT   480
+#define HEAP_SIZE   (4*1024*1024)
+#define SCREENS     200
+
+static unsigned char heap[HEAP_SIZE];
+static unsigned char framebuffer[FB_WIDTH*FB_HEIGHT*FB_VIRTUAL_SCREENS];
+static unsigned char reference[FB_WIDTH*FB_HEIGHT];
+
+extern unsigned char* font_get_glyph_address(unsigned int c);
+
+/** Opens a hardware cache counter for this process, -1 if not available. */
+static int open_counter(unsigned int type, unsigned long long config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** Draws SCREENS screens of text with changing colors. */
+static void draw_screens(unsigned int rows, unsigned int cols)
+{
+    unsigned int seed = 1;
+    for (unsigned int n = 0; n < SCREENS; n++)
+        for (unsigned int row = 0; row < rows; row++)
+            for (unsigned int col = 0; col < cols; col++)
+            {
+                seed = seed * 1103515245 + 12345;
+                gfx_set_fg(1 + (seed >> 24) % 15);
+                gfx_putc(row, col, 32 + (seed >> 16) % 224);
+            }
+}
+
+/** Renders with one font and prints a result line. */
+static void run(int index, const char* format, int fd_l1, int fd_llc)
+{
+    const font_descriptor_t* font = font_registry_get_info(index);
+    unsigned int rows, cols;
+    long long l1 = -1, llc = -1;
+
+    gfx_term_set_font(index);
+    gfx_get_term_size(&rows, &cols);
+    draw_screens(1, cols);      // warm up
+
+    if (fd_l1 >= 0) { ioctl(fd_l1, PERF_EVENT_IOC_RESET, 0); ioctl(fd_l1, PERF_EVENT_IOC_ENABLE, 0); }
+    if (fd_llc >= 0) { ioctl(fd_llc, PERF_EVENT_IOC_RESET, 0); ioctl(fd_llc, PERF_EVENT_IOC_ENABLE, 0); }
+    const double t0 = now();
+    draw_screens(rows, cols);
+    const double seconds = now() - t0;
+    if (fd_l1 >= 0) { ioctl(fd_l1, PERF_EVENT_IOC_DISABLE, 0); if (read(fd_l1, &l1, sizeof(l1)) != sizeof(l1)) l1 = -1; }
+    if (fd_llc >= 0) { ioctl(fd_llc, PERF_EVENT_IOC_DISABLE, 0); if (read(fd_llc, &llc, sizeof(llc)) != sizeof(llc)) llc = -1; }
+
+    const double glyphs = (double)SCREENS * rows * cols;
+    const unsigned int size = 256 * font->height * (strcmp(format, "packed") == 0 ? (font->width + 7) / 8 : font->width);
+    printf("%-14s %-6s %6u B font | %7.2f Mglyphs/s", font->name, format, size, glyphs / seconds / 1e6);
+    if (l1 >= 0) printf(" | L1D misses %6.2f/glyph", l1 / glyphs);
+    if (llc >= 0) printf(" | cache misses %6.3f/glyph", llc / glyphs);
+    printf("\n");
+}
+
+int main()
+{
+    nmalloc_set_memory_area(heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+    gfx_set_env(framebuffer, FB_WIDTH, FB_HEIGHT, 8, FB_WIDTH, sizeof(framebuffer));
+    gfx_set_bg(0);
+
+    const int fd_l1 = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                   (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    const int fd_llc = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    if (fd_l1 < 0 && fd_llc < 0)
+        printf("(no hardware cache counters available, only timing)\n");
+
+    int same = 1;
+    const int builtin = font_registry_get_count();
+    for (int i = 0; i < builtin; i++)
+    {
+        const font_descriptor_t* font = font_registry_get_info(i);
+        if (font->format != FONT_FORMAT_PACKED1) continue;
+        const int bytes = font_registry_register(font->name, font->width, font->height, unpack_font(font),
+                                                 FONT_FORMAT_BYTES, font_get_glyph_address);
+
+        run(bytes, "bytes", fd_l1, fd_llc);
+        memcpy(reference, framebuffer + host_fb_yoffset() * FB_WIDTH, sizeof(reference));
+        run(i, "packed", fd_l1, fd_llc);
+        if (memcmp(reference, framebuffer + host_fb_yoffset() * FB_WIDTH, sizeof(reference)) != 0)
+        {
+            printf("%s: packed and byte format render differently\n", font->name);
+            same = 0;
+        }
+    }
+
+    // random glyphs for the widths without a built-in font (the registry holds 16 fonts)
+    static const int widths[][2] = { { 6, 12 }, { 12, 24 }, { 16, 32 }, { 32, 64 } };
+    srand(1);
+    for (unsigned int n = 0; n < sizeof(widths) / sizeof(widths[0]); n++)
+    {
+        const int w = widths[n][0], h = widths[n][1];
+        const unsigned int size = 256 * h * ((w + 7) / 8);
+        unsigned char* packed = malloc(size);
+        for (unsigned int i = 0; i < size; i++)
+            packed[i] = rand();
+        for (int line = 0; line < 256 * h; line++)
+            if (w % 8) packed[line * ((w + 7) / 8) + w / 8] &= 0xFF00 >> (w % 8);     // padding bits are 0
+
+        char name[32];
+        snprintf(name, sizeof(name), "Random %dx%d", w, h);
+        const int p = font_registry_register(name, w, h, packed, FONT_FORMAT_PACKED1, font_get_glyph_address);
+        const int b = font_registry_register(name, w, h, unpack_font(font_registry_get_info(p)),
+                                             FONT_FORMAT_BYTES, font_get_glyph_address);
+        run(b, "bytes", fd_l1, fd_llc);
+        memcpy(reference, framebuffer + host_fb_yoffset() * FB_WIDTH, sizeof(reference));
+        run(p, "packed", fd_l1, fd_llc);
+        if (memcmp(reference, framebuffer + host_fb_yoffset() * FB_WIDTH, sizeof(reference)) != 0)
+        {
+            printf("%s: packed and byte format render differently\n", name);
+            same = 0;
+        }
+    }
+    printf("packed and byte formats render the same: %s\n", same ? "yes" : "NO");
+    return same ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+//
+// gfx_bench.c
+// Framebuffer traffic benchmark for the terminal core
+//
+// PiVT100 host tools. Feeds a byte stream through gfx.c:
+//  - per-byte: every byte is written on its own and the cursor is redrawn
+//    after it, like the main loop did before cursor rendering was deferred
+//  - span:     the stream is handed over in UART ring sized spans and the
+//    cursor is drawn once at the end of the batch
+//  - lines:    one line per batch, like a slow sender; drawing glyph by
+//    glyph, through the row compositor and with page flipping, which shows
+//    at most one frame per display refresh at the line rate of 115200 baud;
+//    the first two again at 16 and 32 bits per pixel
+// and prints framebuffer bytes read/written and write runs (separate runs
+// of consecutive framebuffer bytes) per input byte.
+// Finally the screen is redrawn from the character cells and compared
+// with the framebuffer.
+//
+// Usage: gfx_bench [file]   (without file a colored "ls" listing is generated)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/nmalloc.h"
+#include "../src/config.h"
+#include "../src/font_registry.h"
+#include "host_shims.h"
+
+#define FB_WIDTH    640
+#define FB_HEIGHT   480
+#define SPAN_SIZE   4096
+#define HEAP_SIZE   (4*1024*1024)
+
+static unsigned char heap[HEAP_SIZE];
+static unsigned char framebuffer[FB_WIDTH*FB_HEIGHT*4*FB_VIRTUAL_SCREENS];
+static unsigned int pitch = FB_WIDTH;
+
+/** Builds a listing similar to "ls --color -l" on a source tree. */
+static char* make_listing(size_t* len)
+{
+    static const char* names[] = { "gfx.c", "gfx.h", "dma.c", "fonts", "pivt100.c", "uart.c", "bin", "setup.c" };
+    size_t cap = 1 << 20, n = 0;
+    char* buf = malloc(cap);
+    for (unsigned int i = 0; n + 256 < cap; i++)
+    {
+        const char* name = names[i % 8];
+        int dir = (name[0] == 'f' || name[0] == 'b');
+        n += snprintf(buf + n, cap - n, "%s 1 pi pi %6u Oct 16 12:%02u %s%s\x1b[0m\r\n",
+                      dir ? "drwxr-xr-x" : "-rw-r--r--", (i * 7919) % 100000, i % 60,
+                      dir ? "\x1b[01;34m" : "\x1b[00m", name);
+    }
+    *len = n;
+    return buf;
+}
+
+static char* read_file(const char* path, size_t* len)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* buf = malloc(*len);
+    if (fread(buf, 1, *len, f) != *len)
+    {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+    return buf;
+}
+
+static void reset_terminal(unsigned int bpp)
+{
+    pitch = FB_WIDTH * bpp / 8;
+    gfx_set_env(framebuffer, FB_WIDTH, FB_HEIGHT, bpp, pitch, pitch * FB_HEIGHT * FB_VIRTUAL_SCREENS);
+    gfx_set_bg(0);
+    gfx_set_fg(7);
+    gfx_term_putstring("\x1b[2J");
+    gfx_reset_stats();
+}
+
+static void report(const char* name, double seconds)
+{
+    gfx_stats_t s;
+    gfx_get_stats(&s);
+    double in = s.bytes_in ? (double)s.bytes_in : 1.0;
+    printf("%-20s %10llu bytes %9llu glyphs %7llu scrolls %9llu cursor draws | fb read %7.1f B/byte, fb written %7.1f B/byte in %5.2f runs/byte | %.1f MB/s, %.2f Mglyphs/s\n",
+           name, s.bytes_in, s.glyphs, s.scrolls, s.cursor_draws,
+           s.fb_read / in, s.fb_written / in, s.fb_write_runs / in, s.bytes_in / seconds / 1e6, s.glyphs / seconds / 1e6);
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char** argv)
+{
+    size_t len;
+    char* data = (argc > 1) ? read_file(argv[1], &len) : make_listing(&len);
+
+    PiVT100Config.disableGfxDMA = 1;
+    nmalloc_set_memory_area(heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+
+    reset_terminal(8);
+    double t0 = now();
+    for (size_t i = 0; i < len; i++)
+    {
+        gfx_term_write(data + i, 1);
+        gfx_term_flush();
+    }
+    report("per-byte", now() - t0);
+
+    reset_terminal(8);
+    t0 = now();
+    for (size_t i = 0; i < len; i += SPAN_SIZE)
+    {
+        gfx_term_write(data + i, (len - i < SPAN_SIZE) ? len - i : SPAN_SIZE);
+    }
+    gfx_term_flush();
+    report("span", now() - t0);
+
+    static const char* const line_runs[] = { "lines", "lines+compose", "lines+flip",
+                                             "lines 16bpp", "lines+compose 16bpp", "lines 32bpp", "lines+compose 32bpp" };
+    for (int run = 0; run < 7; run++)
+    {
+        PiVT100Config.rowCompositor = (run == 1 || run == 2 || run == 4 || run == 6);
+        PiVT100Config.pageFlip = (run == 2);
+        reset_terminal(run < 3 ? 8 : (run < 5 ? 16 : 32));
+        t0 = now();
+        size_t start = 0;
+        for (size_t i = 0; i < len; i++)
+        {
+            if (data[i] != '\n' && i + 1 < len)
+                continue;
+            gfx_term_write(data + start, i + 1 - start);
+            host_advance_time((i + 1 - start) * 87);    // line time at 115200 baud
+            gfx_term_flush();
+            start = i + 1;
+        }
+        report(line_runs[run], now() - t0);
+    }
+
+    // The cells must describe exactly what is on screen
+    static unsigned char rendered[FB_WIDTH*4*FB_HEIGHT];
+    memcpy(rendered, framebuffer + host_fb_yoffset() * pitch, pitch * FB_HEIGHT);
+    gfx_term_redraw();
+    gfx_term_flush();
+    int same = (memcmp(rendered, framebuffer + host_fb_yoffset() * pitch, pitch * FB_HEIGHT) == 0);
+    printf("redraw from cells matches framebuffer: %s\n", same ? "yes" : "NO");
+
+    free(data);
+    return same ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+//
+// glyph_cache_bench.c
+// Colored glyph cache benchmark
+//
+// PiVT100 host tools. Replays a generated "ls -l --color" listing (directory,
+// executable, link, archive and setuid colors, as with the default
+// LS_COLORS) line by line, flushing after every line like the main loop does
+// when the UART delivers one line at a time. It runs once without the glyph
+// cache and once for each cache size, printing glyphs/s and the hit rate.
+// All runs must leave the same framebuffer. A second pass switches fonts and
+// colors in the middle of the stream to check that the cache does not
+// return glyphs of the previous font or colors.
+//
+// Usage: glyph_cache_bench [file]   (exit code is non-zero if a run differs)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/nmalloc.h"
+#include "../src/config.h"
+#include "../src/font_registry.h"
+#include "host_shims.h"
+
+#define FB_WIDTH    640
+#define FB_HEIGHT   480
+#define HEAP_SIZE   (4*1024*1024)
+#define LINES       20000
+
+static unsigned char heap[HEAP_SIZE];
+static unsigned char framebuffer[FB_WIDTH*FB_HEIGHT*FB_VIRTUAL_SCREENS];
+static unsigned char reference[FB_WIDTH*FB_HEIGHT];
+
+/** Builds a listing like "ls -l --color" on a source tree. */
+static char* make_listing(size_t* len)
+{
+    static const struct { const char* name; const char* mode; const char* color; } files[] =
+    {
+        { "gfx.c",       "-rw-r--r--", "\x1b[00m" },
+        { "fonts",       "drwxr-xr-x", "\x1b[01;34m" },
+        { "build.sh",    "-rwxr-xr-x", "\x1b[01;32m" },
+        { "kernel.img",  "-rw-r--r--", "\x1b[00m" },
+        { "latest",      "lrwxrwxrwx", "\x1b[01;36m" },
+        { "fonts.tgz",   "-rw-r--r--", "\x1b[01;31m" },
+        { "sudo-helper", "-rwsr-xr-x", "\x1b[37;41m" },
+        { "tmp",         "drwxrwxrwt", "\x1b[30;42m" },
+        { "README.md",   "-rw-r--r--", "\x1b[00m" },
+    };
+    const unsigned int n_files = sizeof(files) / sizeof(files[0]);
+    size_t cap = LINES * 80, n = 0;
+    char* buf = malloc(cap);
+    for (unsigned int i = 0; i < LINES; i++)
+    {
+        const unsigned int f = (i * 7) % n_files;
+        n += snprintf(buf + n, cap - n, "%s 1 pi pi %6u Oct 16 12:%02u %s%s\x1b[0m\r\n",
+                      files[f].mode, (i * 7919) % 100000, i % 60, files[f].color, files[f].name);
+    }
+    *len = n;
+    return buf;
+}
+
+static char* read_file(const char* path, size_t* len)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* buf = malloc(*len);
+    if (fread(buf, 1, *len, f) != *len)
+    {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+    return buf;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** The glyph cache is sized when the font is set, which gfx_set_env() does. */
+static void reset_terminal(unsigned int cache_size)
+{
+    PiVT100Config.glyphCacheSize = cache_size;
+    gfx_set_env(framebuffer, FB_WIDTH, FB_HEIGHT, 8, FB_WIDTH, sizeof(framebuffer));
+    gfx_set_bg(0);
+    gfx_set_fg(7);
+    gfx_term_putstring("\x1b[2J");
+    gfx_term_flush();
+    gfx_reset_stats();
+}
+
+/** Writes data one line at a time with a flush after each line. With
+ *  switches set, font and default colors change every 1000 lines. */
+static void replay(const char* data, size_t len, int switches)
+{
+    size_t start = 0;
+    unsigned int line = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (data[i] != '\n' && i + 1 < len)
+            continue;
+        gfx_term_write(data + start, i + 1 - start);
+        gfx_term_flush();
+        start = i + 1;
+        if (switches && ++line % 1000 == 0)
+        {
+            gfx_term_set_font(line / 1000 % 2 ? 0 : 1);
+            gfx_set_fg(1 + line / 1000 % 15);
+            gfx_term_putstring("\x1b[2J");
+        }
+    }
+}
+
+/** Runs the replay with a cache size and compares the screen with reference. */
+static int run(const char* data, size_t len, unsigned int cache_size, int switches)
+{
+    reset_terminal(cache_size);
+    const double t0 = now();
+    replay(data, len, switches);
+    const double seconds = now() - t0;
+
+    gfx_stats_t s;
+    gfx_get_stats(&s);
+    const unsigned long long lookups = s.glyph_cache_hits + s.glyph_cache_misses;
+    printf("%-8s cache %4u | %9llu glyphs %7.2f Mglyphs/s", switches ? "switches" : "listing",
+           cache_size, s.glyphs, s.glyphs / seconds / 1e6);
+    if (lookups)
+        printf(" | %9llu hits %7llu misses, %5.1f%% hit rate", s.glyph_cache_hits, s.glyph_cache_misses,
+               100.0 * s.glyph_cache_hits / lookups);
+
+    const unsigned char* screen = framebuffer + host_fb_yoffset() * FB_WIDTH;
+    if (cache_size == 0)
+    {
+        memcpy(reference, screen, sizeof(reference));
+        printf("\n");
+        return 1;
+    }
+    const int same = memcmp(reference, screen, sizeof(reference)) == 0;
+    printf("%s\n", same ? "" : " | DIFFERS from the uncached run");
+    return same;
+}
+
+int main(int argc, char** argv)
+{
+    static const unsigned int sizes[] = { 0, 16, 64, 128, 1024 };
+    size_t len;
+    char* data = (argc > 1) ? read_file(argv[1], &len) : make_listing(&len);
+
+    setvbuf(stdout, 0, _IONBF, 0);
+    PiVT100Config.disableGfxDMA = 1;
+    nmalloc_set_memory_area(heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+
+    int same = 1;
+    for (int switches = 0; switches < 2; switches++)
+        for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+            same &= run(data, len, sizes[i], switches);
+    printf("cached and uncached rendering match: %s\n", same ? "yes" : "NO");
+
+    free(data);
+    return same ? 0 : 1;
+}
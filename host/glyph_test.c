@@ -0,0 +1,134 @@
+//
+// glyph_test.c
+// Bit exact comparison of the glyph composition code with a reference
+//
+// PiVT100 host tools. Built three times against src/glyph_blend.c:
+//  - glyph_test         the plain C code of the host build
+//  - glyph_test_simd32  the ARMv6 USUB8/SEL code, the two instructions
+//                       emulated with their GE flag semantics
+//  - glyph_test_neon    the NEON code, intrinsics from neon_emu.h
+// Random glyphs in both font formats are drawn at every alignment, width
+// 1..40 and odd pitches, and compared byte for byte with a per pixel
+// reference, including the bytes around the glyph which must not change.
+// The same for the 16 and 32 bpp kernels, at every pixel alignment.
+//
+// Usage: glyph_test   (exit code is non-zero on failure)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/glyph_blend.h"
+
+#if defined(GLYPH_BLEND_NEON)
+#define VARIANT "neon"
+#elif defined(GLYPH_BLEND_SIMD32_EMULATION)
+#define VARIANT "simd32"
+#else
+#define VARIANT "c"
+#endif
+
+#define PITCH_MAX   (64*4)
+#define LINES       40
+
+#if defined(GLYPH_BLEND_SIMD32_EMULATION)
+/** USUB8 mask, #0x01010101 sets GE[i] where byte i of mask is not 0;
+ *  SEL takes byte i of fg where GE[i] is set, of bg otherwise. */
+unsigned int glyph_emu_usub8_sel(unsigned int mask, unsigned int fg, unsigned int bg)
+{
+    unsigned int pix = 0;
+    for (int i = 0; i < 32; i += 8)
+    {
+        const int ge = (int)((mask >> i) & 0xFF) - 1 >= 0;
+        pix |= ((ge ? fg : bg) >> i & 0xFF) << i;
+    }
+    return pix;
+}
+#endif
+
+/** Reference: one pixel of bytes bytes at a time, pixel on is foreground. */
+static void reference(unsigned char* dst, unsigned int pitch, const unsigned char* glyph, int packed,
+                      unsigned int width, unsigned int height, unsigned int fg32, unsigned int bg32, unsigned int bytes)
+{
+    for (unsigned int y = 0; y < height; y++)
+        for (unsigned int x = 0; x < width; x++)
+        {
+            const int on = packed ? (glyph[y * ((width + 7) / 8) + x / 8] >> (7 - x % 8)) & 1
+                                  : glyph[y * width + x] != 0;
+            for (unsigned int b = 0; b < bytes; b++)
+                dst[y * pitch + x * bytes + b] = (on ? fg32 : bg32) >> (8 * b);
+        }
+}
+
+/** A random color as pattern word of a depth. */
+static unsigned int random_color(unsigned int bytes)
+{
+    const unsigned int c = (unsigned int)rand() ^ ((unsigned int)rand() << 16);
+    if (bytes == 1)
+        return (c & 0xFF) * 0x01010101u;
+    if (bytes == 2)
+        return (c & 0xFFFF) * 0x00010001u;
+    return c;
+}
+
+int main()
+{
+    static unsigned char glyph[LINES * PITCH_MAX];
+    static unsigned char got[LINES * PITCH_MAX + 8], want[LINES * PITCH_MAX + 8];
+    int failures = 0, checked = 0;
+
+    static glyph_blend_fun* const kernels[3][2] =
+    {
+        { glyph_blend_bytes,   glyph_blend_packed   },
+        { glyph_blend_bytes16, glyph_blend_packed16 },
+        { glyph_blend_bytes32, glyph_blend_packed32 },
+    };
+
+    srand(1);
+    for (unsigned int n = 0; n < 60000; n++)
+    {
+        const unsigned int depth = n / 20000;
+        const unsigned int bytes = 1u << depth;
+        const unsigned int width = 1 + rand() % 40;
+        const unsigned int height = 1 + rand() % (LINES - 1);
+        const unsigned int pitch = bytes * (width + rand() % (PITCH_MAX / bytes - width + 1));
+        const unsigned int offset = (rand() % 4) & ~(bytes - 1);
+        const int packed = n & 1;
+        const unsigned int fg32 = random_color(bytes);
+        const unsigned int bg32 = random_color(bytes);
+
+        const unsigned int row_bytes = packed ? (width + 7) / 8 : width;
+        for (unsigned int i = 0; i < row_bytes * height; i++)
+            glyph[i] = packed ? rand() : (rand() & 1) * 0xFF;
+        if (packed && (width & 7))
+            for (unsigned int y = 0; y < height; y++)
+                glyph[y * row_bytes + width / 8] &= 0xFF00 >> (width & 7);
+
+        // the buffers are 4-aligned, offset gives the alignment of the glyph
+        memset(got, 0x5A, sizeof(got));
+        memset(want, 0x5A, sizeof(want));
+        reference(want + offset, pitch, glyph, packed, width, height, fg32, bg32, bytes);
+        kernels[depth][packed](got + offset, pitch, glyph, width, height, fg32, bg32);
+
+        checked++;
+        if (memcmp(got, want, sizeof(got)) != 0)
+        {
+            if (failures++ < 5)
+                printf("FAIL %s %u bpp %ux%u pitch %u offset %u\n", packed ? "packed" : "bytes", 8 * bytes, width, height, pitch, offset);
+        }
+    }
+
+    for (unsigned int m = 0; m < 16; m++)
+    {
+        const unsigned int fg = 0x11223344, bg = 0xAABBCCDD;
+        const unsigned int want = (glyph_nibble_mask[m] & fg) | (~glyph_nibble_mask[m] & bg);
+        if (glyph_select4(glyph_nibble_mask[m], fg, bg) != want)
+        {
+            printf("FAIL glyph_select4 mask %08x\n", glyph_nibble_mask[m]);
+            failures++;
+        }
+    }
+
+    printf("glyph composition (%s) matches the reference in %d cases: %s\n", VARIANT, checked, failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,372 @@
+//
+// golden_test.c
+// Golden frames: rendering regression corpus with framebuffer hashes
+//
+// PiVT100 host tools. Every input of the corpus (golden/*.vt and the vim
+// and top sessions in streams/) is rendered with every built-in font at
+// several resolutions, first by the reference path: the fonts unpacked to
+// one byte per pixel, so every glyph goes through gfx_putc_NORMAL(), CPU
+// fills and moves, no glyph cache, no row compositor, no page flipping.
+// The FNV-1a hash of that screen in RGB must be the one recorded in
+// golden/hashes.txt. Then the same input is rendered with the optimized
+// paths - packed font kernels, immediate and deferred DMA, row compositor,
+// glyph cache, page flipping, 32 bpp and all of them together - and each
+// screen must be pixel identical to the reference. The input is handed
+// over line by line with a flush after each line, so the lazy scroll and
+// the batching see the same chunks as on the device.
+// `make test` also builds it with the SIMD glyph composition emulated
+// (golden_test_simd32, golden_test_neon); those check against the same
+// hashes, which therefore always come from the plain C build.
+// On a mismatch the reference and the differing screen are written as PNG
+// to golden/failed/.
+//
+// Usage: golden_test [-u] [-w dir]
+//   -u  rewrites golden/hashes.txt and the reference images golden/*.png
+//       (System 8x16 at 640x480) from the reference path
+//   -w  writes the reference screen of every input, font and resolution
+//       to dir
+//   (exit code is non-zero on failure)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/dma.h"
+#include "../src/nmalloc.h"
+#include "../src/config.h"
+#include "../src/font_registry.h"
+#include "../src/debug_levels.h"
+#include "host_shims.h"
+
+#if defined(GLYPH_BLEND_NEON_EMULATION)
+#define KERNELS     "neon"
+#elif defined(GLYPH_BLEND_SIMD32_EMULATION)
+#define KERNELS     "simd32"
+#else
+#define KERNELS     "c"
+#endif
+
+#define HASH_FILE   "golden/hashes.txt"
+#define MAX_HASHES  1024
+#define HEAP_SIZE   (16*1024*1024)
+
+static unsigned char heap[HEAP_SIZE];
+
+static const char* const corpus[] =
+{
+    "golden/glyphs.vt",     // every glyph, tabs, backspace, carriage return
+    "golden/colors.vt",     // 16 and 256 colors, bold, dim, reverse
+    "golden/scroll.vt",     // scrolling past the end of the virtual framebuffer
+    "golden/region.vt",     // scrolling regions
+    "golden/edit.vt",       // insert and delete line and character
+    "golden/erase.vt",      // erase in line and display with background colors
+    "golden/cursor.vt",     // cursor movement, wrap, save/restore, strings, CAN/SUB
+    "streams/vim.vt",
+    "streams/top.vt",
+};
+#define CORPUS_SIZE     (sizeof(corpus) / sizeof(corpus[0]))
+
+typedef struct
+{
+    unsigned int width;
+    unsigned int height;
+} resolution_t;
+
+// 720x400 leaves a partial text row and column with every font
+static const resolution_t resolutions[] = { { 640, 480 }, { 800, 600 }, { 1024, 768 }, { 720, 400 } };
+#define RESOLUTIONS     (sizeof(resolutions) / sizeof(resolutions[0]))
+
+/** A rendering path; the first one is the reference. */
+typedef struct
+{
+    const char* name;
+    int bytes_font;             // unpacked font, gfx_putc_NORMAL()
+    int dma;
+    int deferred;               // DMA completes only when waited for
+    int compositor;
+    unsigned int glyph_cache;   // entries
+    int page_flip;
+    unsigned int depth;
+} variant_t;
+
+static const variant_t variants[] =
+{
+    { "reference",      1, 0, 0, 0,   0, 0,  8 },
+    { "packed",         0, 0, 0, 0,   0, 0,  8 },
+    { "dma",            0, 1, 0, 0,   0, 0,  8 },
+    { "dma-deferred",   0, 1, 1, 0,   0, 0,  8 },
+    { "row-compositor", 0, 1, 1, 1,   0, 0,  8 },
+    { "glyph-cache",    0, 0, 0, 0, 128, 0,  8 },
+    { "page-flip",      0, 1, 1, 0,   0, 1,  8 },
+    { "all",            0, 1, 1, 1, 128, 1,  8 },
+    { "32bpp",          0, 0, 0, 0,   0, 0, 32 },
+    { "32bpp-all",      0, 1, 1, 1, 128, 1, 32 },
+};
+#define VARIANTS        (sizeof(variants) / sizeof(variants[0]))
+
+/** One line of golden/hashes.txt. */
+typedef struct
+{
+    char input[32];
+    int font;
+    unsigned int width, height;
+    unsigned long long hash;
+} golden_t;
+
+static golden_t golden[MAX_HASHES];
+static unsigned int golden_count = 0;
+static int builtin_fonts;
+
+extern unsigned char* font_get_glyph_address(unsigned int c);
+
+#if defined(GLYPH_BLEND_SIMD32_EMULATION)
+/** USUB8/SEL with the GE flag semantics, as in glyph_test.c. */
+unsigned int glyph_emu_usub8_sel(unsigned int mask, unsigned int fg, unsigned int bg)
+{
+    unsigned int pix = 0;
+    for (int i = 0; i < 32; i += 8)
+    {
+        const int ge = (int)((mask >> i) & 0xFF) - 1 >= 0;
+        pix |= ((ge ? fg : bg) >> i & 0xFF) << i;
+    }
+    return pix;
+}
+#endif
+
+static char* read_file(const char* path, size_t* len)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* buf = malloc(*len);
+    if (fread(buf, 1, *len, f) != *len)
+    {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+    return buf;
+}
+
+static unsigned long long fnv1a(const unsigned char* data, size_t len)
+{
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    while (len--)
+        h = (h ^ *data++) * 0x100000001b3ULL;
+    return h;
+}
+
+static const char* base_name(const char* path)
+{
+    return strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+}
+
+static void load_hashes()
+{
+    FILE* f = fopen(HASH_FILE, "r");
+    if (!f)
+        return;
+    char line[256];
+    while (fgets(line, sizeof(line), f) && golden_count < MAX_HASHES)
+    {
+        golden_t* g = &golden[golden_count];
+        if (line[0] != '#' && sscanf(line, "%31s %d %ux%u %llx", g->input, &g->font, &g->width, &g->height, &g->hash) == 5)
+            golden_count++;
+    }
+    fclose(f);
+}
+
+static const golden_t* find_hash(const char* input, int font, const resolution_t* r)
+{
+    for (unsigned int i = 0; i < golden_count; i++)
+        if (!strcmp(golden[i].input, input) && golden[i].font == font &&
+            golden[i].width == r->width && golden[i].height == r->height)
+            return &golden[i];
+    return 0;
+}
+
+/** Renders the input with the variant and converts the screen shown to RGB. */
+static void render(const variant_t* v, int font, const resolution_t* r, const char* data, size_t len, unsigned char* rgb)
+{
+    setDefaultConfig();
+    PiVT100Config.displayWidth = r->width;
+    PiVT100Config.displayHeight = r->height;
+    PiVT100Config.colorDepth = v->depth;
+    PiVT100Config.fontSelection = v->bytes_font ? builtin_fonts + font : font;
+    PiVT100Config.disableGfxDMA = !v->dma;
+    PiVT100Config.rowCompositor = v->compositor;
+    PiVT100Config.glyphCacheSize = v->glyph_cache;
+    PiVT100Config.pageFlip = v->page_flip;
+    PiVT100Config.hasChanged = 1;
+    host_dma_set_deferred(v->deferred);
+    applyConfig();
+    g_debug_severity = 0;
+
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (data[i] != '\n' && i + 1 < len)
+            continue;
+        gfx_term_write(data + start, i + 1 - start);
+        host_advance_time(1000);
+        gfx_term_flush();
+        start = i + 1;
+    }
+    host_advance_time(HOST_VSYNC_US);
+    gfx_term_flush();
+    dma_execute_queue();
+    host_dma_set_deferred(0);
+
+    const unsigned int pitch = r->width * v->depth / 8;
+    host_screen_rgb(rgb, host_fb_address() + host_fb_yoffset() * pitch, r->width, r->height, v->depth, pitch);
+}
+
+/** Writes an RGB screen as PNG through the 32 bpp path of host_write_image(),
+ *  in the RGB pixel order the golden frames are rendered with. */
+static void write_rgb(const char* path, const unsigned char* rgb, const resolution_t* r)
+{
+    const size_t pixels = (size_t)r->width * r->height;
+    unsigned int* xrgb = malloc(4 * pixels);
+    for (size_t i = 0; i < pixels; i++)
+        xrgb[i] = rgb[3 * i] | (rgb[3 * i + 1] << 8) | (rgb[3 * i + 2] << 16);
+    host_write_image(path, (const unsigned char*)xrgb, r->width, r->height, 32, 4 * r->width);
+    free(xrgb);
+}
+
+int main(int argc, char** argv)
+{
+    int update = 0;
+    const char* image_dir = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-u"))
+            update = 1;
+        else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+            image_dir = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: golden_test [-u] [-w dir]\n");
+            return 2;
+        }
+    }
+    if (update && strcmp(KERNELS, "c") != 0)
+    {
+        fprintf(stderr, "golden_test: the hashes come from the plain C build, not from %s\n", KERNELS);
+        return 2;
+    }
+
+    nmalloc_set_memory_area(heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+    builtin_fonts = font_registry_get_count();
+    for (int i = 0; i < builtin_fonts; i++)
+    {
+        const font_descriptor_t* font = font_registry_get_info(i);
+        font_registry_register(font->name, font->width, font->height, unpack_font(font), FONT_FORMAT_BYTES, font_get_glyph_address);
+    }
+    load_hashes();
+
+    FILE* hashes = 0;
+    if (update)
+    {
+        hashes = fopen(HASH_FILE, "w");
+        if (!hashes)
+        {
+            perror(HASH_FILE);
+            return 1;
+        }
+        fprintf(hashes, "# Golden frames, written by golden_test -u: input, font, resolution and the\n"
+                        "# FNV-1a hash of the screen in RGB rendered by the reference path.\n");
+    }
+    if (image_dir)
+        mkdir(image_dir, 0755);
+
+    const size_t rgb_size = 3 * 1024 * 768;
+    unsigned char* reference = malloc(rgb_size);
+    unsigned char* screen = malloc(rgb_size);
+    unsigned int frames = 0, mismatches = 0;
+    for (unsigned int c = 0; c < CORPUS_SIZE; c++)
+    {
+        size_t len;
+        char* data = read_file(corpus[c], &len);
+        const char* input = base_name(corpus[c]);
+        for (int font = 0; font < builtin_fonts; font++)
+            for (unsigned int res = 0; res < RESOLUTIONS; res++)
+            {
+                const resolution_t* r = &resolutions[res];
+                char path[256];
+                render(&variants[0], font, r, data, len, reference);
+                const unsigned long long hash = fnv1a(reference, 3 * r->width * r->height);
+                frames++;
+
+                if (update)
+                {
+                    fprintf(hashes, "%-12s %d %4ux%-4u %016llx\n", input, font, r->width, r->height, hash);
+                    if (font == 0 && res == 0)
+                    {
+                        snprintf(path, sizeof(path), "golden/%.*s.png", (int)(strlen(input) - 3), input);
+                        write_rgb(path, reference, r);
+                    }
+                }
+                else
+                {
+                    const golden_t* g = find_hash(input, font, r);
+                    if (!g)
+                    {
+                        printf("FAIL %s, font %d, %ux%u: no golden hash, run golden_test -u\n", input, font, r->width, r->height);
+                        failures++;
+                    }
+                    else if (g->hash != hash)
+                    {
+                        printf("FAIL %s, font %d, %ux%u: reference screen hash %016llx, golden %016llx\n",
+                               input, font, r->width, r->height, hash, g->hash);
+                        failures++;
+                        mkdir("golden/failed", 0755);
+                        snprintf(path, sizeof(path), "golden/failed/%s-%d-%ux%u-reference.png", input, font, r->width, r->height);
+                        write_rgb(path, reference, r);
+                    }
+                }
+                if (image_dir)
+                {
+                    snprintf(path, sizeof(path), "%s/%s-%d-%ux%u.png", image_dir, input, font, r->width, r->height);
+                    write_rgb(path, reference, r);
+                }
+
+                for (unsigned int v = 1; v < VARIANTS; v++)
+                {
+                    render(&variants[v], font, r, data, len, screen);
+                    frames++;
+                    if (memcmp(screen, reference, 3 * r->width * r->height) == 0)
+                        continue;
+                    printf("FAIL %s, font %d, %ux%u: %s differs from the reference\n", input, font, r->width, r->height, variants[v].name);
+                    mismatches++;
+                    mkdir("golden/failed", 0755);
+                    snprintf(path, sizeof(path), "golden/failed/%s-%d-%ux%u-reference.png", input, font, r->width, r->height);
+                    write_rgb(path, reference, r);
+                    snprintf(path, sizeof(path), "golden/failed/%s-%d-%ux%u-%s.png", input, font, r->width, r->height, variants[v].name);
+                    write_rgb(path, screen, r);
+                }
+            }
+        free(data);
+    }
+    CHECK(mismatches == 0);
+    if (hashes)
+        fclose(hashes);
+    free(reference);
+    free(screen);
+
+    printf("golden frames (%s): %u inputs, %d fonts, %u resolutions, %u paths, %u frames%s: %s\n",
+           KERNELS, (unsigned int)CORPUS_SIZE, builtin_fonts, (unsigned int)RESOLUTIONS, (unsigned int)VARIANTS, frames,
+           update ? ", hashes written" : "", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,177 @@
+//
+// host_shims.c
+// Stand-ins for the hardware services used by gfx.c on a Linux host
+//
+// PiVT100 host tools. The terminal core (gfx.c, font registry, nmalloc)
+// is linked unchanged against these functions so it can be exercised and
+// benchmarked without a Raspberry Pi.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/config.h"
+#include "../src/framebuffer.h"
+#include "../src/timer.h"
+#include "../src/pwm.h"
+#include "../src/palette.h"
+#include "../src/gfx.h"
+#include "../src/font_registry.h"
+#include "host_shims.h"
+
+tPiVT100Config PiVT100Config;
+unsigned g_debug_severity = 0;
+int failures = 0;
+
+static unsigned int host_time_us = 0;
+
+/** Logging ends up on stderr when enabled by g_debug_severity. */
+void LogWriteInternal(unsigned Severity, const char *pFile, int nLine, const char *pMessage, ...)
+{
+    (void)Severity; (void)pFile; (void)nLine;
+    va_list args;
+    va_start(args, pMessage);
+    vfprintf(stderr, pMessage, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+void SetDebugSeverity(unsigned severity)
+{
+    g_debug_severity = severity;
+}
+
+void ee_printf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+/* Timers: never fire on the host, time only advances when asked to */
+unsigned attach_timer_handler(unsigned hz, _TimerHandler* handler, void *pParam, void* pContext)
+{
+    (void)hz; (void)handler; (void)pParam; (void)pContext;
+    return 1;
+}
+
+void remove_timer(unsigned hnd)
+{
+    (void)hnd;
+}
+
+unsigned int time_microsec()
+{
+    return host_time_us;
+}
+
+void host_advance_time(unsigned int usec)
+{
+    host_time_us += usec;
+}
+
+/* Bell */
+void pwm800_start(uint8_t duty_percent, uint32_t duration_ms)
+{
+    (void)duty_percent; (void)duration_ms;
+}
+
+void pwm800_stop(void)
+{
+}
+
+int pwm800_is_active(void)
+{
+    return 0;
+}
+
+void *quick_memcpy(void *dest, void *src, size_t n)
+{
+    return memcpy(dest, src, n);
+}
+
+/* Virtual Y offset last set through the mailbox */
+static unsigned int host_yoffset = 0;
+
+FB_RETURN_TYPE fb_switch_framebuffer(unsigned int yOffset)
+{
+    host_yoffset = yOffset;
+    return FB_SUCCESS;
+}
+
+/* A 60 Hz display: the fake clock moves on to the next vertical sync */
+FB_RETURN_TYPE fb_wait_vsync()
+{
+    host_time_us += HOST_VSYNC_US - host_time_us % HOST_VSYNC_US;
+    return FB_SUCCESS;
+}
+
+/* Pixel order of the 16 and 32 bpp modes, RGB as requested by fb_init() */
+static unsigned int host_pixel_order = FB_PIXEL_ORDER_RGB;
+
+unsigned int fb_get_pixel_order()
+{
+    return host_pixel_order;
+}
+
+void host_fb_set_pixel_order(unsigned int order)
+{
+    host_pixel_order = order;
+}
+
+/* The xterm palette, as set by initialize_framebuffer() */
+const unsigned int* fb_get_palette()
+{
+    return &palette[pal_xterm][0];
+}
+
+unsigned int host_fb_yoffset()
+{
+    return host_yoffset;
+}
+
+/* Framebuffer: plain memory, FB_VIRTUAL_SCREENS screens high like on the device */
+static unsigned char* host_fb = 0;
+
+void initialize_framebuffer(unsigned int width, unsigned int height, unsigned int bpp)
+{
+    const unsigned int pitch = width * bpp / 8;
+    const unsigned int size = pitch * height * FB_VIRTUAL_SCREENS;
+    free(host_fb);
+    host_fb = calloc(size, 1);
+    host_yoffset = 0;
+    gfx_set_env(host_fb, width, height, bpp, pitch, size);
+}
+
+unsigned char* host_fb_address()
+{
+    return host_fb;
+}
+
+/* UART: nothing is sent or received, the baudrate is kept for the tests */
+static unsigned int host_baudrate = 0;
+
+void uart_init(unsigned int baudrate)
+{
+    host_baudrate = baudrate;
+}
+
+unsigned int host_uart_baudrate()
+{
+    return host_baudrate;
+}
+
+unsigned char* unpack_font(const font_descriptor_t* font)
+{
+    const unsigned int row_bytes = (font->width + 7) / 8;
+    unsigned char* bytes = malloc(256 * font->width * font->height);
+    unsigned char* p = bytes;
+    for (unsigned int line = 0; line < 256u * font->height; line++)
+        for (int x = 0; x < font->width; x++)
+            *p++ = (font->data[line * row_bytes + x / 8] & (0x80 >> (x % 8))) ? 0xFF : 0x00;
+    return bytes;
+}
@@ -0,0 +1,63 @@
+//
+// host_shims.h
+// Helpers only available in the host build
+//
+// PiVT100 host tools.
+
+#ifndef _PIVT100_HOST_SHIMS_H_
+#define _PIVT100_HOST_SHIMS_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include "../src/font_registry.h"
+
+/** Failed CHECK()s of a test, printed with file, line and condition. */
+extern int failures;
+
+#define CHECK( COND ) do { if (!(COND)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #COND); failures++; } } while (0)
+
+/** Expands a packed font into one byte per pixel, malloc()ed. */
+extern unsigned char* unpack_font(const font_descriptor_t* font);
+
+/** Advances the fake microsecond clock returned by time_microsec(). */
+extern void host_advance_time(unsigned int usec);
+
+/** Refresh period of the display modelled by fb_wait_vsync(), 60 Hz. */
+#define HOST_VSYNC_US   16667
+
+/** Virtual line the display would show on top, as set by fb_switch_framebuffer(). */
+extern unsigned int host_fb_yoffset();
+
+/** Pixel order (FB_PIXEL_ORDER_*) fb_get_pixel_order() reports, as the firmware
+ *  would for the next framebuffer; RGB unless set otherwise. */
+extern void host_fb_set_pixel_order(unsigned int order);
+
+/** Framebuffer allocated by the last initialize_framebuffer(), 0 before. */
+extern unsigned char* host_fb_address();
+
+/** Baudrate of the last uart_init(), 0 before. */
+extern unsigned int host_uart_baudrate();
+
+/** SD card stand-in (ramdisk.c): sd_card_init() finds a card holding this disk
+ *  image, an MBR partitioned FAT16 or FAT32 volume. 0 removes the card. */
+extern void host_sd_set_image(const void* data, size_t size);
+
+/** Snapshots (snapshot.c): converts a screen of bpp 8 (xterm palette), 16 or 32
+ *  in the pixel order of fb_get_pixel_order() to 3 bytes per pixel RGB,
+ *  width * height * 3 bytes at rgb. */
+extern void host_screen_rgb(unsigned char* rgb, const unsigned char* pixels, unsigned int width, unsigned int height,
+                            unsigned int bpp, unsigned int pitch);
+
+/** Writes the screen to path as PNG if it ends in ".png", else as binary PPM. 0 on success. */
+extern int host_write_image(const char* path, const unsigned char* pixels, unsigned int width, unsigned int height,
+                            unsigned int bpp, unsigned int pitch);
+
+/** DMA mock (dma_mock.c): with deferred set, submitted transfers only run when a
+ *  fence is waited for, like a DMA engine that is slower than the CPU.
+ *  Otherwise they run in dma_submit(). */
+extern void host_dma_set_deferred(int deferred);
+
+/** Transfers submitted but not run yet. */
+extern unsigned int host_dma_pending();
+
+#endif
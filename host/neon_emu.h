@@ -0,0 +1,93 @@
+//
+// neon_emu.h
+// Plain C stand-ins for the NEON intrinsics used by glyph_blend.c
+//
+// PiVT100 host tools. Lets the NEON code path of glyph_blend.c run on the
+// build machine (GLYPH_BLEND_NEON_EMULATION), lane by lane with the
+// semantics of the ARM intrinsics, so glyph_test can compare it with the
+// reference.
+
+#ifndef _PIVT100_NEON_EMU_H_
+#define _PIVT100_NEON_EMU_H_
+
+#include <stdint.h>
+
+typedef struct { uint8_t v[8]; } uint8x8_t;
+typedef struct { uint8_t v[16]; } uint8x16_t;
+
+static inline uint8x8_t vld1_u8(const uint8_t* p)
+{
+    uint8x8_t r;
+    for (int i = 0; i < 8; i++) r.v[i] = p[i];
+    return r;
+}
+
+static inline uint8x16_t vld1q_u8(const uint8_t* p)
+{
+    uint8x16_t r;
+    for (int i = 0; i < 16; i++) r.v[i] = p[i];
+    return r;
+}
+
+static inline void vst1_u8(uint8_t* p, uint8x8_t a)
+{
+    for (int i = 0; i < 8; i++) p[i] = a.v[i];
+}
+
+static inline void vst1q_u8(uint8_t* p, uint8x16_t a)
+{
+    for (int i = 0; i < 16; i++) p[i] = a.v[i];
+}
+
+static inline uint8x8_t vdup_n_u8(uint8_t x)
+{
+    uint8x8_t r;
+    for (int i = 0; i < 8; i++) r.v[i] = x;
+    return r;
+}
+
+static inline uint8x16_t vdupq_n_u8(uint8_t x)
+{
+    uint8x16_t r;
+    for (int i = 0; i < 16; i++) r.v[i] = x;
+    return r;
+}
+
+static inline uint8x8_t vget_low_u8(uint8x16_t a)
+{
+    uint8x8_t r;
+    for (int i = 0; i < 8; i++) r.v[i] = a.v[i];
+    return r;
+}
+
+static inline uint8x16_t vcombine_u8(uint8x8_t lo, uint8x8_t hi)
+{
+    uint8x16_t r;
+    for (int i = 0; i < 8; i++) { r.v[i] = lo.v[i]; r.v[i + 8] = hi.v[i]; }
+    return r;
+}
+
+/** Lanes with a common bit set become 0xFF, others 0x00. */
+static inline uint8x8_t vtst_u8(uint8x8_t a, uint8x8_t b)
+{
+    uint8x8_t r;
+    for (int i = 0; i < 8; i++) r.v[i] = (a.v[i] & b.v[i]) ? 0xFF : 0x00;
+    return r;
+}
+
+/** Bitwise select: bits of b where m is set, bits of c elsewhere. */
+static inline uint8x8_t vbsl_u8(uint8x8_t m, uint8x8_t b, uint8x8_t c)
+{
+    uint8x8_t r;
+    for (int i = 0; i < 8; i++) r.v[i] = (m.v[i] & b.v[i]) | (~m.v[i] & c.v[i]);
+    return r;
+}
+
+static inline uint8x16_t vbslq_u8(uint8x16_t m, uint8x16_t b, uint8x16_t c)
+{
+    uint8x16_t r;
+    for (int i = 0; i < 16; i++) r.v[i] = (m.v[i] & b.v[i]) | (~m.v[i] & c.v[i]);
+    return r;
+}
+
+#endif
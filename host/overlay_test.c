@@ -0,0 +1,124 @@
+//
+// overlay_test.c
+// Setup dialog on the overlay page
+//
+// PiVT100 host tools. The setup dialog is drawn on the last screen of the
+// virtual framebuffer and shown by moving the display offset. Checks that
+//  - opening and closing the overlay only moves the display offset and
+//    allocates nothing
+//  - text received while the overlay is shown is drawn on the terminal
+//    page, also when it scrolls, and leaves the overlay page alone
+//  - after closing, the terminal shows the same screen as without overlay
+//  - a framebuffer of a single screen has no overlay page
+//
+// Usage: overlay_test   (exit code is non-zero on failure)
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/nmalloc.h"
+#include "../src/config.h"
+#include "../src/font_registry.h"
+#include "host_shims.h"
+
+#define FB_WIDTH    640
+#define FB_HEIGHT   480
+#define HEAP_SIZE   (4*1024*1024)
+
+static unsigned char heap[HEAP_SIZE];
+static unsigned char framebuffer[FB_WIDTH*FB_HEIGHT*FB_VIRTUAL_SCREENS];
+static unsigned char reference[FB_WIDTH*FB_HEIGHT], dialog[FB_WIDTH*FB_HEIGHT];
+
+static const unsigned char* screen()
+{
+    return framebuffer + host_fb_yoffset() * FB_WIDTH;
+}
+
+static void reset_terminal(unsigned int screens)
+{
+    gfx_set_env(framebuffer, FB_WIDTH, FB_HEIGHT, 8, FB_WIDTH, FB_WIDTH * FB_HEIGHT * screens);
+    gfx_set_bg(0);
+    gfx_set_fg(7);
+    gfx_term_putstring("\x1b[2J");
+    gfx_term_flush();
+}
+
+/** Writes count colored lines, flushed line by line like the main loop does. */
+static void write_lines(unsigned int first, unsigned int count)
+{
+    char line[64];
+    for (unsigned int i = first; i < first + count; i++)
+    {
+        snprintf(line, sizeof(line), "\x1b[3%um%u line\x1b[0m\r\n", 1 + i % 6, i);
+        gfx_term_write(line, strlen(line));
+        gfx_term_flush();
+    }
+}
+
+/** Draws a box with some text like the setup dialog does. */
+static void draw_dialog()
+{
+    unsigned int width, height;
+    gfx_get_gfx_size(&width, &height);
+    gfx_set_fg(4);
+    gfx_fill_rect(0, 0, width, height);
+    gfx_set_fg(7);
+    gfx_set_bg(4);
+    const char* text = "Pi VT100 Setup";
+    for (unsigned int i = 0; text[i]; i++)
+        gfx_putc(2, 10 + i, text[i]);
+}
+
+int main()
+{
+    nmalloc_set_memory_area(heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+
+    // without overlay
+    reset_terminal(FB_VIRTUAL_SCREENS);
+    write_lines(0, 50);
+    write_lines(50, 30);
+    memcpy(reference, screen(), sizeof(reference));
+
+    // the same text, the second part arrives while the dialog is shown
+    reset_terminal(FB_VIRTUAL_SCREENS);
+    write_lines(0, 50);
+    const unsigned int terminal_offset = host_fb_yoffset();
+    void* const probe = nmalloc_malloc(16);
+    nmalloc_free(probe);
+
+    CHECK(gfx_overlay_open(0));
+    void* const probe_open = nmalloc_malloc(16);   // the same block if nothing was allocated
+    nmalloc_free(probe_open);
+    CHECK(probe_open == probe);
+    CHECK(host_fb_yoffset() == FB_HEIGHT * (FB_VIRTUAL_SCREENS - 1));
+    gfx_overlay_begin();
+    draw_dialog();
+    unsigned int rows, cols;
+    gfx_get_term_size(&rows, &cols);
+    CHECK(rows == FB_HEIGHT / 16 && cols == FB_WIDTH / 8);     // the 8x16 font of the dialog
+    gfx_overlay_end();
+    memcpy(dialog, screen(), sizeof(dialog));
+
+    write_lines(50, 30);
+    CHECK(host_fb_yoffset() == FB_HEIGHT * (FB_VIRTUAL_SCREENS - 1));
+    CHECK(memcmp(dialog, screen(), sizeof(dialog)) == 0);
+    gfx_get_term_size(&rows, &cols);
+    CHECK(rows == FB_HEIGHT / 24);                              // the terminal keeps its 8x24 font
+
+    gfx_overlay_close();
+    CHECK(host_fb_yoffset() != terminal_offset);                // it panned meanwhile
+    CHECK(memcmp(reference, screen(), sizeof(reference)) == 0);
+
+    // a single screen leaves no room for the overlay
+    reset_terminal(1);
+    const unsigned int single_offset = host_fb_yoffset();
+    CHECK(!gfx_overlay_open(0));
+    CHECK(host_fb_yoffset() == single_offset);
+
+    printf("setup overlay page flips without copies or allocation: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,241 @@
+//
+// parser_bench.c
+// Throughput of the escape sequence parser
+//
+// PiVT100 host tools. Hands byte streams of different kinds to
+// gfx_term_write() in UART ring sized spans and shows the screen once at
+// the end, so the time goes into parsing and filling character cells:
+//  - text:     plain source code lines, printable runs only
+//  - ls:       a colored "ls -l" listing, a few SGR sequences per line
+//  - cursor:   a full screen program redrawing fields with cursor
+//              addressing, erase and colors between short runs of text
+//  - strings:  text with xterm window titles (OSC) and DCS strings
+// and prints MB/s. Checks that
+//  - every stream gives the same screen when handed over one byte at a time,
+//    so sequences and printable runs may be split anywhere
+//  - the strings are swallowed: "strings" gives the screen of the same text
+//    without them
+//
+// Usage: parser_bench [file]   (the file is timed as a fifth stream)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/nmalloc.h"
+#include "../src/config.h"
+#include "../src/font_registry.h"
+#include "host_shims.h"
+
+#define FB_WIDTH    640
+#define FB_HEIGHT   480
+#define SPAN_SIZE   4096
+#define STREAM_SIZE (1 << 20)
+#define HEAP_SIZE   (4*1024*1024)
+
+static unsigned char heap[HEAP_SIZE];
+static unsigned char framebuffer[FB_WIDTH*FB_HEIGHT*FB_VIRTUAL_SCREENS];
+static unsigned char reference[FB_WIDTH*FB_HEIGHT];
+
+typedef struct
+{
+    char* data;
+    size_t len;
+    size_t cap;
+} stream_t;
+
+static void append(stream_t* s, const char* text)
+{
+    const size_t n = strlen(text);
+    if (s->len + n > s->cap)
+    {
+        s->cap = 2 * s->cap + n;
+        s->data = realloc(s->data, s->cap);
+    }
+    memcpy(s->data + s->len, text, n);
+    s->len += n;
+}
+
+/** Source code lines without escape sequences. */
+static void make_text(stream_t* s, int with_strings)
+{
+    static const char* const lines[] =
+    {
+        "    for (unsigned int row = 0; row < ctx.term.HEIGHT; row++)",
+        "    {",
+        "        gfx_term_blank_cells(row, 0, ctx.term.WIDTH);",
+        "    }",
+        "/** Moves the cursor one row down. On the bottom margin the region scrolls. */",
+        "",
+        "static const unsigned char table[16] = { 0, 1, 2, 3 };   // comment",
+    };
+    char line[160];
+    for (unsigned int i = 0; s->len < STREAM_SIZE; i++)
+    {
+        if (with_strings && i % 7 == 0)
+        {
+            snprintf(line, sizeof(line), "\x1b]0;pi@pivt100: ~/src line %u\x07", i);
+            append(s, line);
+        }
+        if (with_strings && i % 29 == 0)
+            append(s, "\x1bP1$r0;1;32m\x1b\\\x1b]2;title with ST\x1b\\");
+        snprintf(line, sizeof(line), "%s\r\n", lines[i % 7]);
+        append(s, line);
+    }
+}
+
+/** A listing like "ls -l --color". */
+static void make_listing(stream_t* s)
+{
+    static const char* const colors[] = { "\x1b[00m", "\x1b[01;34m", "\x1b[01;32m", "\x1b[01;36m", "\x1b[01;31m" };
+    char line[160];
+    for (unsigned int i = 0; s->len < STREAM_SIZE; i++)
+    {
+        snprintf(line, sizeof(line), "-rw-r--r-- 1 pi pi %6u Oct 16 12:%02u %sfile%u.c\x1b[0m\r\n",
+                 (i * 7919) % 100000, i % 60, colors[i % 5], i);
+        append(s, line);
+    }
+}
+
+/** A full screen program updating fields like "top". */
+static void make_cursor(stream_t* s)
+{
+    char field[160];
+    for (unsigned int i = 0; s->len < STREAM_SIZE; i++)
+    {
+        snprintf(field, sizeof(field), "\x1b[%u;%uH\x1b[K\x1b[%u;%um%5u %4.1f%%\x1b[m \x1b[7mS\x1b[27m",
+                 1 + i % 30, 1 + (i * 13) % 60, 30 + i % 8, 40 + (i / 8) % 8, i % 99999, (i % 1000) / 10.0);
+        append(s, field);
+    }
+}
+
+static char* read_file(const char* path, size_t* len)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* buf = malloc(*len);
+    if (fread(buf, 1, *len, f) != *len)
+    {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+    return buf;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const unsigned char* screen()
+{
+    return framebuffer + host_fb_yoffset() * FB_WIDTH;
+}
+
+static void reset_terminal()
+{
+    gfx_set_env(framebuffer, FB_WIDTH, FB_HEIGHT, 8, FB_WIDTH, sizeof(framebuffer));
+    gfx_set_default_bg(0);
+    gfx_set_default_fg(7);
+    gfx_set_bg(0);
+    gfx_set_fg(7);
+    gfx_term_putstring("\x1b[2J");
+}
+
+/** Feeds the stream in spans of span bytes and shows the screen. */
+static void feed(const char* data, size_t len, size_t span)
+{
+    reset_terminal();
+    for (size_t i = 0; i < len; i += span)
+        gfx_term_write(data + i, (len - i < span) ? len - i : span);
+    gfx_term_flush();
+}
+
+/** Times the stream, then checks it byte by byte against the screen. */
+static void run(const char* name, const char* data, size_t len)
+{
+    double best = 1e9;
+    for (int pass = 0; pass < 5; pass++)
+    {
+        const double t0 = now();
+        feed(data, len, SPAN_SIZE);
+        if (now() - t0 < best)
+            best = now() - t0;
+    }
+    printf("%-8s %8zu bytes | %7.1f MB/s, %5.1f ns/byte\n", name, len, len / best / 1e6, best * 1e9 / len);
+
+    memcpy(reference, screen(), sizeof(reference));
+    feed(data, len, 1);
+    const int same = (memcmp(reference, screen(), sizeof(reference)) == 0);
+    if (!same)
+        printf("FAIL %s: one byte at a time gives another screen\n", name);
+    CHECK(same);
+}
+
+int main(int argc, char** argv)
+{
+    PiVT100Config.disableGfxDMA = 1;
+    PiVT100Config.rowCompositor = 1;
+    nmalloc_set_memory_area(heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+
+    stream_t text = { 0 }, listing = { 0 }, cursor = { 0 }, strings = { 0 };
+    make_text(&text, 0);
+    make_listing(&listing);
+    make_cursor(&cursor);
+    make_text(&strings, 1);
+
+    run("text", text.data, text.len);
+    run("ls", listing.data, listing.len);
+    run("cursor", cursor.data, cursor.len);
+    run("strings", strings.data, strings.len);
+
+    // the same lines without the strings
+    stream_t plain = { malloc(strings.len), 0, strings.len };
+    for (size_t i = 0; i < strings.len; )
+    {
+        if (strings.data[i] == 0x1b && (strings.data[i + 1] == ']' || strings.data[i + 1] == 'P'))
+        {
+            while (strings.data[i] != 0x07 && !(strings.data[i] == 0x1b && strings.data[i + 1] == '\\'))
+                i++;
+            i += (strings.data[i] == 0x07) ? 1 : 2;
+            continue;
+        }
+        plain.data[plain.len++] = strings.data[i++];
+    }
+    feed(plain.data, plain.len, SPAN_SIZE);
+    const int swallowed = (memcmp(reference, screen(), sizeof(reference)) == 0);
+    if (!swallowed)
+        printf("FAIL strings: OSC and DCS strings are shown\n");
+    CHECK(swallowed);
+
+    if (argc > 1)
+    {
+        size_t len;
+        char* data = read_file(argv[1], &len);
+        run(argv[1], data, len);
+        free(data);
+    }
+
+    printf("parser gives the same screen in any span size and swallows strings: %s\n", failures ? "FAIL" : "ok");
+    free(text.data);
+    free(listing.data);
+    free(cursor.data);
+    free(strings.data);
+    free(plain.data);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+//
+// parser_fuzz.c
+// Fuzz harness for the escape sequence parser
+//
+// PiVT100 host tools. Every input goes through gfx_term_write() and
+// gfx_term_flush() on a RAM framebuffer, then the terminal must still work:
+//  - the bytes around the framebuffer and the heap are untouched
+//  - after "ESC[H ESC[0m ESC[2J" and two characters the top left cells
+//    hold them, so the parser is back in normal text and the cursor and
+//    the cells are consistent
+// Built three ways:
+//  - parser_fuzz: with AddressSanitizer and UndefinedBehaviorSanitizer
+//    (SAN_FLAGS in the Makefile). Without arguments it runs pseudo random
+//    inputs built from sequence fragments: long digit runs, many
+//    parameters, strings, cancels and random bytes. With files it runs
+//    each file as one input, which is what AFL does: build with
+//    CC=afl-clang-fast and run afl-fuzz -i seeds -o findings ./parser_fuzz @@
+//  - parser_fuzz_libfuzzer (make fuzz, needs clang): LLVMFuzzerTestOneInput()
+//    for libFuzzer
+// It prints the parser throughput in bytes/s over all inputs.
+//
+// Usage: parser_fuzz [-n inputs] [-s seed] [file...]   (exit code is non-zero on failure)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/nmalloc.h"
+#include "../src/config.h"
+#include "../src/font_registry.h"
+#include "host_shims.h"
+
+#define FB_WIDTH    320
+#define FB_HEIGHT   240
+#define HEAP_SIZE   (2*1024*1024)
+#define GUARD       4096
+#define MAX_INPUT   4096
+
+/** Heap and framebuffer with guard bytes on both sides. */
+static struct
+{
+    unsigned char before[GUARD];
+    unsigned char heap[HEAP_SIZE];
+    unsigned char between[GUARD];
+    unsigned char framebuffer[FB_WIDTH*FB_HEIGHT*FB_VIRTUAL_SCREENS];
+    unsigned char after[GUARD];
+} mem;
+
+static int initialized = 0;
+static unsigned long long bytes_parsed = 0;
+static double parse_seconds = 0;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int guard_intact(const unsigned char* guard)
+{
+    for (unsigned int i = 0; i < GUARD; i++)
+        if (guard[i] != 0xA5)
+            return 0;
+    return 1;
+}
+
+static void setup()
+{
+    memset(mem.before, 0xA5, GUARD);
+    memset(mem.between, 0xA5, GUARD);
+    memset(mem.after, 0xA5, GUARD);
+    PiVT100Config.disableGfxDMA = 1;
+    PiVT100Config.rowCompositor = 1;
+    PiVT100Config.glyphCacheSize = 32;
+    nmalloc_set_memory_area(mem.heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+    gfx_set_env(mem.framebuffer, FB_WIDTH, FB_HEIGHT, 8, FB_WIDTH, sizeof(mem.framebuffer));
+    initialized = 1;
+}
+
+/** Runs one input, aborts if the terminal is broken afterwards. */
+static void run_input(const uint8_t* data, size_t size)
+{
+    if (!initialized)
+        setup();
+
+    const double t0 = now();
+    gfx_term_write((const char*)data, size);
+    gfx_term_flush();
+    parse_seconds += now() - t0;
+    bytes_parsed += size;
+
+    // leaves any string or sequence, then writes a probe
+    gfx_term_putstring("\x18\x1b[H\x1b[0m\x1b[2Jok");
+    const GFX_CELL* top = gfx_term_get_cells(0);
+    if (!guard_intact(mem.before) || !guard_intact(mem.between) || !guard_intact(mem.after) ||
+        top == 0 || top[0].glyph != 'o' || top[1].glyph != 'k')
+    {
+        printf("FAIL: the terminal is broken after an input of %zu bytes\n", size);
+        abort();
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    run_input(data, size);
+    return 0;
+}
+
+#if !defined(PARSER_FUZZ_LIBFUZZER)
+
+static unsigned int rng = 1;
+
+static unsigned int next_random()
+{
+    // xorshift32
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+/** Appends text at *len if it fits. */
+static void put(uint8_t* buf, size_t* len, const char* text, size_t n)
+{
+    if (*len + n > MAX_INPUT) return;
+    memcpy(buf + *len, text, n);
+    *len += n;
+}
+
+/** A pseudo random input from sequence fragments. */
+static size_t make_input(uint8_t* buf)
+{
+    static const char finals[] = "ABCDHJKLMPfhlbmrsu@78c\\[]PX^_";
+    static const char* const starts[] = { "\x1b", "\x1b[", "\x1b[?", "\x1b[=", "\x1b[#", "\x1b]", "\x1bP", "\x1b#", "\x1b(" };
+    char tmp[64];
+    size_t len = 0;
+    const unsigned int pieces = 1 + next_random() % 64;
+    for (unsigned int i = 0; i < pieces; i++)
+    {
+        switch (next_random() % 10)
+        {
+            case 0:
+            case 1:
+            {
+                const char* s = starts[next_random() % 9];
+                put(buf, &len, s, strlen(s));
+                break;
+            }
+            case 2:
+                // numbers up to far beyond 32 bits
+                for (unsigned int n = next_random() % 40; n > 0; n--)
+                {
+                    tmp[0] = '0' + next_random() % 10;
+                    put(buf, &len, tmp, 1);
+                }
+                break;
+            case 3:
+                // many parameters
+                for (unsigned int n = next_random() % 64; n > 0; n--)
+                {
+                    const int k = snprintf(tmp, sizeof(tmp), "%u;", next_random() % 300);
+                    put(buf, &len, tmp, k);
+                }
+                break;
+            case 4:
+                tmp[0] = finals[next_random() % (sizeof(finals) - 1)];
+                put(buf, &len, tmp, 1);
+                break;
+            case 5:
+                tmp[0] = "\x07\x18\x1a\x1b\x7f\r\n\t\b\x0c:;<>"[next_random() % 14];
+                put(buf, &len, tmp, 1);
+                break;
+            case 6:
+            {
+                const int k = snprintf(tmp, sizeof(tmp), "\x1b[%u;%uH", next_random(), next_random() % 100);
+                put(buf, &len, tmp, k);
+                break;
+            }
+            case 7:
+            {
+                const int k = snprintf(tmp, sizeof(tmp), "\x1b[%u;%um", 30 + next_random() % 80, next_random() % 512);
+                put(buf, &len, tmp, k);
+                break;
+            }
+            default:
+                for (unsigned int n = next_random() % 32; n > 0; n--)
+                {
+                    tmp[0] = next_random();
+                    put(buf, &len, tmp, 1);
+                }
+                break;
+        }
+    }
+    return len;
+}
+
+static uint8_t* read_file(const char* path, size_t* len)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* buf = malloc(*len + 1);
+    if (fread(buf, 1, *len, f) != *len)
+    {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+    return buf;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int inputs = 20000;
+    unsigned int files = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            inputs = strtoul(argv[++i], 0, 0);
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            rng = strtoul(argv[++i], 0, 0) | 1;
+        else
+        {
+            size_t len;
+            uint8_t* data = read_file(argv[i], &len);
+            run_input(data, len);
+            free(data);
+            files++;
+        }
+    }
+
+    if (files == 0)
+    {
+        static uint8_t buf[MAX_INPUT];
+        for (unsigned int i = 0; i < inputs; i++)
+            run_input(buf, make_input(buf));
+
+        // the cases that wrote past the parameter array and overflowed the numbers
+        static char worst[MAX_INPUT];
+        memset(worst, ';', sizeof(worst));
+        memcpy(worst, "\x1b[", 2);
+        worst[sizeof(worst) - 1] = 'm';
+        run_input((const uint8_t*)worst, sizeof(worst));
+        memset(worst + 2, '9', sizeof(worst) - 3);
+        for (const char* f = "ABCDHmr@"; *f; f++)
+        {
+            worst[sizeof(worst) - 1] = *f;
+            run_input((const uint8_t*)worst, sizeof(worst));
+        }
+        static const char* const huge[] =
+        {
+            "abc\x1b[2147483647C", "abc\x1b[4294967295D", "\n\x1b[2147483647B\x1b[2147483647A",
+            "\x1b[4294967295;4294967295H", "\x1b[4294967296;1r", "\x1b[38;5;4294967295m\x1b[48;6;65791m",
+        };
+        for (unsigned int i = 0; i < sizeof(huge) / sizeof(huge[0]); i++)
+            run_input((const uint8_t*)huge[i], strlen(huge[i]));
+        inputs += 9 + sizeof(huge) / sizeof(huge[0]);
+    }
+    else
+        inputs = files;
+
+    printf("%u inputs, %llu bytes, parser %.1f MB/s: ok\n", inputs, bytes_parsed, bytes_parsed / parse_seconds / 1e6);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,212 @@
+//
+// present_test.c
+// Frame pacing of the main loop
+//
+// PiVT100 host tools. Drives present.c like term_main_loop() does, on the
+// fake clock, with a 60 Hz display modelled by fb_wait_vsync():
+//  - trickle: a listing arrives at 115200 baud and the loop takes what has
+//    arrived, so the ring runs empty all the time
+//  - flood: it arrives in 256 byte spans at 921600 baud and the ring
+//    never runs empty
+// For each it counts frames and the longest time a received byte waited to
+// be shown, and compares glyphs drawn and framebuffer bytes written with
+// the loop before frame pacing, which flushed whenever the ring ran empty
+// and at least every 20 ms. Checks that
+//  - no more than maxFPS frames are shown per second
+//  - idle input is shown within a frame, flooding input within maxLatency
+//  - the screen is the same as without pacing
+// The host time of the flood runs is printed as parse throughput.
+//
+// Usage: present_test [file]   (exit code is non-zero on failure)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/nmalloc.h"
+#include "../src/config.h"
+#include "../src/font_registry.h"
+#include "../src/present.h"
+#include "../src/timer.h"
+#include "host_shims.h"
+
+#define FB_WIDTH    640
+#define FB_HEIGHT   480
+#define HEAP_SIZE   (4*1024*1024)
+#define LINES       4000
+
+static unsigned char heap[HEAP_SIZE];
+static unsigned char framebuffer[FB_WIDTH*FB_HEIGHT*FB_VIRTUAL_SCREENS];
+static unsigned char reference[FB_WIDTH*FB_HEIGHT];
+
+/** Builds a colored listing like "ls -l --color". */
+static char* make_listing(size_t* len)
+{
+    static const char* colors[] = { "\x1b[00m", "\x1b[01;34m", "\x1b[01;32m", "\x1b[01;36m", "\x1b[01;31m" };
+    size_t cap = LINES * 80, n = 0;
+    char* buf = malloc(cap);
+    for (unsigned int i = 0; i < LINES; i++)
+        n += snprintf(buf + n, cap - n, "-rw-r--r-- 1 pi pi %6u Oct 16 12:%02u %sfile%u.c\x1b[0m\r\n",
+                      (i * 7919) % 100000, i % 60, colors[i % 5], i);
+    *len = n;
+    return buf;
+}
+
+static char* read_file(const char* path, size_t* len)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* buf = malloc(*len);
+    if (fread(buf, 1, *len, f) != *len)
+    {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+    return buf;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const unsigned char* screen()
+{
+    return framebuffer + host_fb_yoffset() * FB_WIDTH;
+}
+
+static void reset_terminal()
+{
+    gfx_set_env(framebuffer, FB_WIDTH, FB_HEIGHT, 8, FB_WIDTH, sizeof(framebuffer));
+    gfx_set_default_bg(0);
+    gfx_set_default_fg(7);
+    gfx_set_bg(0);
+    gfx_set_fg(7);
+    gfx_term_putstring("\x1b[2J");
+    gfx_reset_stats();
+}
+
+/** Feeds data arriving every us_per_byte. With idle set the loop is faster
+ *  than the line: it takes what has arrived and the ring runs empty.
+ *  Otherwise it gets span bytes at a time and the ring never runs empty.
+ *  paced selects present.c, otherwise the old loop. */
+static void run(const char* name, const char* data, size_t len, size_t span, unsigned int us_per_byte, int idle, int paced)
+{
+    reset_terminal();
+    present_init();
+    unsigned int frames = 0, max_wait = 0, last_flush = time_microsec(), first_unshown = 0;
+    const unsigned int start = time_microsec();
+    const double t0 = now();
+
+    size_t pos = 0;
+    while (pos < len)
+    {
+        size_t n = span;
+        if (idle)
+        {
+            // byte i arrives at start + (i + 1) * us_per_byte
+            const size_t arrived = (time_microsec() - start) / us_per_byte;
+            if (arrived <= pos)
+            {
+                host_advance_time(start + (pos + 1) * us_per_byte - time_microsec());
+                continue;
+            }
+            n = arrived - pos;
+        }
+        else
+            host_advance_time(n * us_per_byte);
+        if (n > len - pos)
+            n = len - pos;
+        if (!first_unshown)
+            first_unshown = start + (pos + 1) * us_per_byte;
+        if (paced)
+            present_input();
+        gfx_term_write(data + pos, n);
+        pos += n;
+
+        int shown;
+        const int empty = idle || pos >= len;
+        if (paced)
+            shown = present_poll(empty);
+        else
+        {
+            shown = empty || time_microsec() - last_flush > 20000;
+            if (shown)
+            {
+                gfx_term_flush();
+                last_flush = time_microsec();
+            }
+        }
+        if (shown && first_unshown)
+        {
+            frames++;
+            if (time_microsec() - first_unshown > max_wait)
+                max_wait = time_microsec() - first_unshown;
+            first_unshown = 0;
+        }
+    }
+    // the rest is shown when the frame period is over
+    while (paced && !present_poll(1))
+        host_advance_time(1000);
+    if (first_unshown && time_microsec() - first_unshown > max_wait)
+        max_wait = time_microsec() - first_unshown;
+
+    const double seconds = now() - t0;
+    const double duration = (time_microsec() - start) / 1e6;
+    gfx_stats_t s;
+    gfx_get_stats(&s);
+    printf("%-8s %-6s | %6.1f s at the line rate, %5u frames, %6.1f frames/s, longest wait %5.1f ms | "
+           "%5.2f glyphs/byte, %6.1f fb bytes written/byte | host %6.1f MB/s\n",
+           name, paced ? "paced" : "old", duration, frames, frames / duration, max_wait / 1000.0,
+           (double)s.glyphs / len, (double)s.fb_written / len, len / seconds / 1e6);
+
+    if (!paced)
+    {
+        memcpy(reference, screen(), sizeof(reference));
+        return;
+    }
+    CHECK(memcmp(reference, screen(), sizeof(reference)) == 0);
+    CHECK(frames / duration <= PiVT100Config.maxFPS + 1);
+    if (idle)
+        CHECK(max_wait <= 1000000 / PiVT100Config.maxFPS + HOST_VSYNC_US);
+    else
+        CHECK(max_wait <= PiVT100Config.maxLatency * 1000 + 2 * span * us_per_byte);   // waiting in the ring, then parsed
+}
+
+int main(int argc, char** argv)
+{
+    size_t len;
+    char* data = (argc > 1) ? read_file(argv[1], &len) : make_listing(&len);
+
+    setvbuf(stdout, 0, _IONBF, 0);
+    PiVT100Config.disableGfxDMA = 1;
+    PiVT100Config.rowCompositor = 1;
+    PiVT100Config.glyphCacheSize = 128;
+    PiVT100Config.maxFPS = 60;
+    PiVT100Config.maxLatency = 50;
+    nmalloc_set_memory_area(heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+
+    for (int paced = 0; paced < 2; paced++)
+        run("trickle", data, len, 1, 87, 1, paced);
+    for (int paced = 0; paced < 2; paced++)
+        run("flood", data, len, 256, 11, 0, paced);
+
+    printf("frames paced to maxFPS and maxLatency, same screen: %s\n", failures ? "FAIL" : "ok");
+    free(data);
+    return failures ? 1 : 0;
+}
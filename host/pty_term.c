@@ -0,0 +1,275 @@
+//
+// pty_term.c
+// The terminal core attached to a Linux pseudo terminal
+//
+// PiVT100 host tools. Runs a program (by default $SHELL) in a pseudo
+// terminal of the size of the configured screen and hands everything it
+// writes to gfx_term_write(), with the main loop's frame pacing
+// (present.c) on the real clock. The framebuffer is memory; images of
+// the screen in the palette of palette.h are written
+//  - at the end, with -o (PNG if the name ends in ".png", else PPM)
+//  - every -i milliseconds and on SIGUSR1, numbered: screen-0001.png
+// When the program has exited and its output is drained, it prints the
+// time to drain, the share of it spent in the terminal core, glyphs,
+// scrolls, frames and framebuffer bytes written. With -b the program is
+// run once before with its output read and thrown away, which gives the
+// time the program itself needs.
+// If standard input is a terminal, keys are passed on to the program, so
+// a shell can be used interactively; -v copies the output to standard
+// output to see what happens.
+//
+// Usage: pty_term [-c key=value]... [-T term] [-o image] [-i ms] [-b] [-v] [command [arg...]]
+//   -c sets a pivt100.txt key, the default screen is 640x480 with the 8x16
+//   font (80x30); -T sets TERM for the program, xterm by default.
+//   The exit code is the program's.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/nmalloc.h"
+#include "../src/config.h"
+#include "../src/font_registry.h"
+#include "../src/ini.h"
+#include "../src/present.h"
+#include "../src/debug_levels.h"
+#include "host_shims.h"
+
+#define SPAN_SIZE   4096            // like the UART ring
+#define HEAP_SIZE   (8*1024*1024)
+
+static unsigned char heap[HEAP_SIZE];
+static char settings[4096] = "displayWidth=640\ndisplayHeight=480\nfontSelection=0\n";
+static const char* term = "xterm";
+static volatile sig_atomic_t snapshot_requested = 0;
+static struct termios saved_termios;
+
+extern unsigned int time_microsec();     // timer.h clashes with unistd.h
+extern int inihandler(void* user, const char* section, const char* name, const char* value);
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void on_usr1(int sig)
+{
+    (void)sig;
+    snapshot_requested = 1;
+}
+
+static void restore_terminal()
+{
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+}
+
+/** Starts the program in a pseudo terminal of rows x cols. Returns the master side. */
+static int start(char** command, unsigned int rows, unsigned int cols, pid_t* pid)
+{
+    struct winsize ws = { .ws_row = rows, .ws_col = cols };
+    int master;
+    *pid = forkpty(&master, 0, 0, &ws);
+    if (*pid < 0)
+    {
+        perror("forkpty");
+        exit(1);
+    }
+    if (*pid == 0)
+    {
+        setenv("TERM", term, 1);
+        execvp(command[0], command);
+        perror(command[0]);
+        _exit(127);
+    }
+    return master;
+}
+
+/** Writes the screen shown to path. */
+static void snapshot(const char* path)
+{
+    unsigned int width, height;
+    gfx_term_flush();
+    gfx_get_gfx_size(&width, &height);
+    const unsigned int pitch = width * PiVT100Config.colorDepth / 8;
+    if (host_write_image(path, host_fb_address() + host_fb_yoffset() * pitch, width, height,
+                         PiVT100Config.colorDepth, pitch) == 0)
+        fprintf(stderr, "pty_term: wrote %s\n", path);
+}
+
+/** path with -NNNN in front of the extension. */
+static void numbered_path(char* out, size_t size, const char* path, unsigned int n)
+{
+    const char* dot = strrchr(path, '.');
+    if (!dot || strchr(dot, '/'))
+        dot = path + strlen(path);
+    snprintf(out, size, "%.*s-%04u%s", (int)(dot - path), path, n, dot);
+}
+
+/** Runs the program with its output thrown away; returns the seconds until it is drained. */
+static double run_alone(char** command, unsigned int rows, unsigned int cols)
+{
+    pid_t pid;
+    const double t0 = now();
+    const int master = start(command, rows, cols, &pid);
+    char buf[SPAN_SIZE];
+    while (read(master, buf, sizeof(buf)) > 0)
+        ;
+    const double seconds = now() - t0;
+    close(master);
+    waitpid(pid, 0, 0);
+    return seconds;
+}
+
+int main(int argc, char** argv)
+{
+    const char* image = 0;
+    unsigned int interval_ms = 0;
+    int baseline = 0, echo = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (!strcmp(argv[i], "--"))
+        {
+            i++;
+            break;
+        }
+        else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+        {
+            strncat(settings, argv[++i], sizeof(settings) - strlen(settings) - 2);
+            strcat(settings, "\n");
+        }
+        else if (!strcmp(argv[i], "-T") && i + 1 < argc)
+            term = argv[++i];
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            image = argv[++i];
+        else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+            interval_ms = strtoul(argv[++i], 0, 0);
+        else if (!strcmp(argv[i], "-b"))
+            baseline = 1;
+        else if (!strcmp(argv[i], "-v"))
+            echo = 1;
+        else
+        {
+            fprintf(stderr, "usage: pty_term [-c key=value]... [-T term] [-o image] [-i ms] [-b] [-v] [command [arg...]]\n");
+            return 2;
+        }
+    }
+    char* shell[] = { getenv("SHELL") ? getenv("SHELL") : "/bin/sh", 0 };
+    char** command = (i < argc) ? argv + i : shell;
+
+    nmalloc_set_memory_area(heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+    setDefaultConfig();
+    ini_parse_string(settings, inihandler, 0);
+    applyConfig();
+    g_debug_severity = 0;
+    gfx_term_putstring("\x1b[H\x1b[2J");
+    gfx_term_flush();
+    gfx_reset_stats();
+
+    unsigned int rows, cols;
+    gfx_get_term_size(&rows, &cols);
+    const double alone = baseline ? run_alone(command, rows, cols) : 0;
+
+    const int interactive = isatty(STDIN_FILENO);
+    if (interactive)
+    {
+        struct termios raw;
+        tcgetattr(STDIN_FILENO, &saved_termios);
+        raw = saved_termios;
+        cfmakeraw(&raw);
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        atexit(restore_terminal);
+    }
+    signal(SIGUSR1, on_usr1);
+
+    pid_t pid;
+    const double t0 = now();
+    const unsigned int clock0 = time_microsec();
+    const int master = start(command, rows, cols, &pid);
+    present_init();
+
+    struct pollfd fds[2] = { { .fd = master, .events = POLLIN }, { .fd = STDIN_FILENO, .events = POLLIN } };
+    char buf[SPAN_SIZE];
+    unsigned long long received = 0;
+    unsigned int frames = 0, snapshots = 0;
+    double engine = 0, next_snapshot = interval_ms / 1000.0;
+    while (1)
+    {
+        // wakes up every millisecond for frames that become due
+        const int ready = poll(fds, interactive ? 2 : 1, 1);
+        if (ready < 0)
+            continue;           // a signal
+        if (fds[0].revents)
+        {
+            // EIO once the program and everything it started closed the terminal
+            const ssize_t n = read(master, buf, sizeof(buf));
+            if (n <= 0)
+                break;
+            const double t = now();
+            present_input();
+            gfx_term_write(buf, n);
+            engine += now() - t;
+            received += n;
+            if (echo)
+                fwrite(buf, 1, n, stdout);
+        }
+        if (interactive && (fds[1].revents & POLLIN))
+        {
+            const ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n > 0 && write(master, buf, n) < 0)
+                break;
+        }
+
+        // the fake clock follows the real one; fb_wait_vsync() may have moved it ahead
+        const unsigned int elapsed = (unsigned int)((now() - t0) * 1e6);
+        if ((int)(clock0 + elapsed - time_microsec()) > 0)
+            host_advance_time(clock0 + elapsed - time_microsec());
+        struct pollfd more = { .fd = master, .events = POLLIN };
+        const double t = now();
+        frames += present_poll(poll(&more, 1, 0) == 0);
+        engine += now() - t;
+
+        if (snapshot_requested || (interval_ms && now() - t0 >= next_snapshot))
+        {
+            char path[1024];
+            numbered_path(path, sizeof(path), image ? image : "pty_term.png", ++snapshots);
+            snapshot(path);
+            snapshot_requested = 0;
+            next_snapshot += interval_ms / 1000.0;
+        }
+    }
+    gfx_term_flush();
+    frames++;
+    const double drained = now() - t0;
+    close(master);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (interactive)
+        restore_terminal();
+    if (echo)
+        fflush(stdout);
+
+    gfx_stats_t s;
+    gfx_get_stats(&s);
+    fprintf(stderr, "%s: %llu bytes drained in %.3f s, %.2f MB/s | terminal %.3f s (%.0f%%): %llu glyphs, %llu scrolls, %u frames, fb written %.1f MB\n",
+            command[0], received, drained, received / drained / 1e6, engine, 100 * engine / drained,
+            s.glyphs, s.scrolls, frames, s.fb_written / 1e6);
+    if (baseline)
+        fprintf(stderr, "%s alone, output thrown away: %.3f s\n", command[0], alone);
+    if (image)
+        snapshot(image);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
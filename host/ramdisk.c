@@ -0,0 +1,55 @@
+//
+// ramdisk.c
+// SD card stand-in: a disk image in memory behind the block device interface
+//
+// PiVT100 host tools. sd_card_init() hands out the image set with
+// host_sd_set_image(), so config.c reads its configuration file through the
+// unchanged MBR, FAT and ini code. Without an image the card is missing.
+
+#include <string.h>
+#include <stdint.h>
+
+#include "../src/emmc.h"
+#include "host_shims.h"
+
+static const unsigned char* image = 0;
+static size_t image_size = 0;
+
+static char driver_name[] = "ramdisk";
+static char device_name[] = "emmc0";
+
+static int ramdisk_read(struct block_device *dev, uint8_t *buf, size_t buf_size, uint32_t block_num)
+{
+    const size_t offset = (size_t)block_num * dev->block_size;
+    if (offset >= image_size)
+        return -1;
+    if (buf_size > image_size - offset)
+        buf_size = image_size - offset;
+    memcpy(buf, image + offset, buf_size);
+    return (int)buf_size;
+}
+
+static struct block_device ramdisk =
+{
+    .driver_name = driver_name,
+    .device_name = device_name,
+    .supports_multiple_block_read = 1,
+    .read = ramdisk_read,
+    .block_size = 512,
+};
+
+void host_sd_set_image(const void* data, size_t size)
+{
+    image = data;
+    image_size = size;
+}
+
+int sd_card_init(struct block_device **dev)
+{
+    if (image == 0)
+        return -1;
+    ramdisk.num_blocks = image_size / ramdisk.block_size;
+    ramdisk.fs = 0;
+    *dev = &ramdisk;
+    return 0;
+}
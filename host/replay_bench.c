@@ -0,0 +1,184 @@
+//
+// replay_bench.c
+// Replays recorded terminal sessions through the terminal core
+//
+// PiVT100 host tools. The streams in streams/ are what real programs wrote
+// to an 80x30 terminal (see streams/record.py):
+//  - build.vt: a make run of the host tools
+//  - ls-lR.vt: a colored "ls -lR" of /usr/share
+//  - vim.vt:   vim paging, searching, scrolling and typing in gfx.c
+//  - top.vt:   top refreshing its screen fifteen times
+// The terminal is set up through setDefaultConfig() and applyConfig() like
+// the firmware does, at 640x480 with the 8x16 font, so the recorded screen
+// size fits. Every stream is handed over line by line while the fake clock
+// advances by the transmission time at the baudrate, so frames are paced
+// like on the device, and repeated up to 1 MB. Prints per stream the bytes
+// and glyphs per second, the scrolls and the framebuffer bytes read and
+// written. Afterwards the screen is redrawn from the character cells and
+// compared with the framebuffer; the exit code is non-zero if they differ.
+//
+// Usage: replay_bench [-b baudrate] [-c key=value]... [file...]
+//   -c sets a pivt100.txt key, e.g. -c rowCompositor=0 -c colorDepth=32;
+//   files are replayed instead of the recorded streams
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/pivt100_config.h"
+#include "../src/gfx.h"
+#include "../src/nmalloc.h"
+#include "../src/config.h"
+#include "../src/font_registry.h"
+#include "../src/ini.h"
+#include "../src/debug_levels.h"
+#include "host_shims.h"
+
+#define REPLAY_SIZE (1 << 20)
+#define HEAP_SIZE   (8*1024*1024)
+
+static unsigned char heap[HEAP_SIZE];
+static char settings[4096] = "displayWidth=640\ndisplayHeight=480\nfontSelection=0\n";
+static double usec_per_byte = 10e6 / 115200;     // 10 bits per byte on the line
+
+extern int inihandler(void* user, const char* section, const char* name, const char* value);
+
+static char* read_file(const char* path, size_t* len)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* buf = malloc(*len);
+    if (fread(buf, 1, *len, f) != *len)
+    {
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+    return buf;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** Sets the terminal up from the defaults and the -c settings, like the firmware at boot. */
+static void reset_terminal()
+{
+    setDefaultConfig();
+    ini_parse_string(settings, inihandler, 0);
+    applyConfig();
+    g_debug_severity = 0;
+    gfx_term_putstring("\x1b[H\x1b[2J");
+    host_advance_time(HOST_VSYNC_US);
+    gfx_term_flush();
+    gfx_reset_stats();
+}
+
+/** Hands the stream over line by line until REPLAY_SIZE bytes are replayed. */
+static void replay(const char* data, size_t len)
+{
+    double pending_us = 0;
+    for (size_t replayed = 0; replayed < REPLAY_SIZE; replayed += len)
+    {
+        size_t start = 0;
+        for (size_t i = 0; i < len; i++)
+        {
+            if (data[i] != '\n' && i + 1 < len)
+                continue;
+            gfx_term_write(data + start, i + 1 - start);
+            pending_us += (i + 1 - start) * usec_per_byte;
+            host_advance_time((unsigned int)pending_us);
+            pending_us -= (unsigned int)pending_us;
+            gfx_term_flush();
+            start = i + 1;
+        }
+    }
+}
+
+/** Times the stream, prints the counters and checks the screen. Returns 0 if the screen is wrong. */
+static int run(const char* name, const char* data, size_t len)
+{
+    double best = 1e9;
+    for (int pass = 0; pass < 3; pass++)
+    {
+        reset_terminal();
+        const double t0 = now();
+        replay(data, len);
+        if (now() - t0 < best)
+            best = now() - t0;
+    }
+
+    gfx_stats_t s;
+    gfx_get_stats(&s);
+    printf("%-20s %8llu bytes %8llu glyphs %6llu scrolls | fb read %7.1f MB, written %7.1f MB, %6.1f B/byte | %6.1f MB/s, %6.2f Mglyphs/s\n",
+           name, s.bytes_in, s.glyphs, s.scrolls, s.fb_read / 1e6, s.fb_written / 1e6,
+           (s.fb_read + s.fb_written) / (double)s.bytes_in, s.bytes_in / best / 1e6, s.glyphs / best / 1e6);
+
+    // The cells must describe exactly what is on screen
+    unsigned int width, height;
+    gfx_get_gfx_size(&width, &height);
+    const unsigned int pitch = width * PiVT100Config.colorDepth / 8;
+    const unsigned char* screen = host_fb_address() + host_fb_yoffset() * pitch;
+    unsigned char* rendered = malloc(pitch * height);
+    memcpy(rendered, screen, pitch * height);
+    gfx_term_redraw();
+    gfx_term_flush();
+    const int same = (memcmp(rendered, host_fb_address() + host_fb_yoffset() * pitch, pitch * height) == 0);
+    if (!same)
+        printf("FAIL %s: redraw from cells differs from the framebuffer\n", name);
+    free(rendered);
+    return same;
+}
+
+int main(int argc, char** argv)
+{
+    static const char* const recorded[] = { "streams/build.vt", "streams/ls-lR.vt", "streams/vim.vt", "streams/top.vt" };
+    const char* files[64];
+    unsigned int count = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-b") && i + 1 < argc)
+            usec_per_byte = 10e6 / strtoul(argv[++i], 0, 0);
+        else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+        {
+            strncat(settings, argv[++i], sizeof(settings) - strlen(settings) - 2);
+            strcat(settings, "\n");
+        }
+        else if (count < 64)
+            files[count++] = argv[i];
+    }
+    if (count == 0)
+    {
+        for (count = 0; count < 4; count++)
+            files[count] = recorded[count];
+    }
+
+    nmalloc_set_memory_area(heap, HEAP_SIZE);
+    font_registry_init();
+    gfx_register_builtin_fonts();
+
+    int same = 1;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        size_t len;
+        char* data = read_file(files[i], &len);
+        const char* name = strrchr(files[i], '/') ? strrchr(files[i], '/') + 1 : files[i];
+        if (len)
+            same &= run(name, data, len);
+        free(data);
+    }
+
+    printf("redraw from cells matches framebuffer: %s\n", same ? "yes" : "NO");
+    return same ? 0 : 1;
+}
@@ -0,0 +1,262 @@
+//
+// snapshot.c
+// Framebuffer images for the host tools
+//
+// PiVT100 host tools. Converts a screen of 8 bpp palette indexes (through
+// the xterm palette of palette.h), RGB565 or 32 bpp pixels to RGB and
+// writes it as binary PPM or as PNG. The PNG is compressed with the fixed
+// Huffman codes of deflate and matches against the pixel to the left and
+// the pixel above only, which is enough for terminal screens and needs no
+// zlib: a 640x480 screen of text takes some 20-60 KB.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../src/framebuffer.h"
+#include "host_shims.h"
+
+static unsigned int swap_red_blue(unsigned int c)
+{
+    return ((c << 16) & 0xFF0000) | (c & 0x00FF00) | ((c >> 16) & 0x0000FF);
+}
+
+void host_screen_rgb(unsigned char* rgb, const unsigned char* pixels, unsigned int width, unsigned int height,
+                     unsigned int bpp, unsigned int pitch)
+{
+    const unsigned int* palette = fb_get_palette();
+    const int bgr = (fb_get_pixel_order() == FB_PIXEL_ORDER_BGR);
+    for (unsigned int y = 0; y < height; y++)
+    {
+        const unsigned char* row = pixels + y * pitch;
+        for (unsigned int x = 0; x < width; x++, rgb += 3)
+        {
+            unsigned int c;
+            if (bpp == 8)
+                c = palette[row[x]];
+            else if (bpp == 16)
+            {
+                const unsigned int p = ((const uint16_t*)row)[x];
+                c = ((p & 0xF800) << 8) | ((p & 0xE000) << 3) | ((p & 0x07E0) << 5) | ((p & 0x0600) >> 1) |
+                    ((p & 0x001F) << 3) | ((p & 0x001C) >> 2);
+                if (bgr)
+                    c = swap_red_blue(c);
+            }
+            else
+            {
+                // red is the low byte in RGB order
+                c = ((const uint32_t*)row)[x] & 0xFFFFFF;
+                if (!bgr)
+                    c = swap_red_blue(c);
+            }
+            rgb[0] = c >> 16;
+            rgb[1] = c >> 8;
+            rgb[2] = c;
+        }
+    }
+}
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char* data, size_t len)
+{
+    if (crc_table[1] == 0)
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            crc_table[n] = c;
+        }
+    }
+    crc = ~crc;
+    while (len--)
+        crc = crc_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put_be32(unsigned char* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void write_chunk(FILE* f, const char* type, const unsigned char* data, size_t len)
+{
+    unsigned char word[4];
+    put_be32(word, len);
+    fwrite(word, 1, 4, f);
+    fwrite(type, 1, 4, f);
+    fwrite(data, 1, len, f);
+    put_be32(word, crc32_update(crc32_update(0, (const unsigned char*)type, 4), data, len));
+    fwrite(word, 1, 4, f);
+}
+
+/** Bit writer for deflate: bits go into the bytes least significant first. */
+typedef struct
+{
+    unsigned char* out;
+    size_t n;
+    uint32_t bits;
+    unsigned int count;
+} bit_writer;
+
+static void put_bits(bit_writer* w, uint32_t value, unsigned int count)
+{
+    w->bits |= value << w->count;
+    w->count += count;
+    while (w->count >= 8)
+    {
+        w->out[w->n++] = w->bits;
+        w->bits >>= 8;
+        w->count -= 8;
+    }
+}
+
+/** Huffman codes are sent most significant bit first. */
+static void put_code(bit_writer* w, uint32_t code, unsigned int count)
+{
+    uint32_t reversed = 0;
+    for (unsigned int i = 0; i < count; i++)
+        reversed |= ((code >> i) & 1) << (count - 1 - i);
+    put_bits(w, reversed, count);
+}
+
+/** A literal/length symbol in the fixed code of RFC 1951 3.2.6. */
+static void put_symbol(bit_writer* w, unsigned int sym)
+{
+    if (sym < 144)
+        put_code(w, 0x30 + sym, 8);
+    else if (sym < 256)
+        put_code(w, 0x190 + sym - 144, 9);
+    else if (sym < 280)
+        put_code(w, sym - 256, 7);
+    else
+        put_code(w, 0xC0 + sym - 280, 8);
+}
+
+static const unsigned short length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                                35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                              257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                              8193, 12289, 16385, 24577 };
+static const unsigned char dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                              7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static void put_match(bit_writer* w, unsigned int len, unsigned int dist)
+{
+    unsigned int i = 28;
+    while (length_base[i] > len)
+        i--;
+    put_symbol(w, 257 + i);
+    put_bits(w, len - length_base[i], length_extra[i]);
+    i = 29;
+    while (dist_base[i] > dist)
+        i--;
+    put_code(w, i, 5);
+    put_bits(w, dist - dist_base[i], dist_extra[i]);
+}
+
+/** Length of the match of data[pos...] with the bytes dist before, at most 258. */
+static unsigned int match_length(const unsigned char* data, size_t pos, size_t len, size_t dist)
+{
+    if (dist > pos || dist > 32768)
+        return 0;
+    unsigned int n = 0;
+    while (n < 258 && pos + n < len && data[pos + n] == data[pos + n - dist])
+        n++;
+    return n;
+}
+
+/** Compresses data into one fixed Huffman block; out needs len * 9 / 8 + 16 bytes. */
+static size_t deflate_fixed(unsigned char* out, const unsigned char* data, size_t len, size_t line)
+{
+    bit_writer w = { out, 0, 0, 0 };
+    put_bits(&w, 1, 1);             // last block
+    put_bits(&w, 1, 2);             // fixed Huffman codes
+    for (size_t pos = 0; pos < len; )
+    {
+        const unsigned int left = match_length(data, pos, len, 3);
+        const unsigned int above = match_length(data, pos, len, line);
+        const unsigned int best = (above > left) ? above : left;
+        if (best >= 3)
+        {
+            put_match(&w, best, (above > left) ? line : 3);
+            pos += best;
+        }
+        else
+            put_symbol(&w, data[pos++]);
+    }
+    put_symbol(&w, 256);
+    put_bits(&w, 0, 7);             // flush the last byte
+    return w.n;
+}
+
+static void write_png(FILE* f, const unsigned char* rgb, unsigned int width, unsigned int height)
+{
+    // scanlines with filter type 0 in front
+    const size_t line = 1 + 3 * (size_t)width;
+    const size_t raw_len = line * height;
+    unsigned char* raw = malloc(raw_len);
+    for (unsigned int y = 0; y < height; y++)
+    {
+        raw[y * line] = 0;
+        memcpy(raw + y * line + 1, rgb + y * (line - 1), line - 1);
+    }
+
+    // zlib stream: header, deflate data and the Adler-32 of the data
+    unsigned char* z = malloc(2 + raw_len * 9 / 8 + 16 + 4);
+    size_t n = 0;
+    z[n++] = 0x78;
+    z[n++] = 0x01;
+    n += deflate_fixed(z + n, raw, raw_len, line);
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < raw_len; i++)
+    {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_be32(z + n, (b << 16) | a);
+    n += 4;
+
+    unsigned char ihdr[13] = { 0 };
+    put_be32(ihdr, width);
+    put_be32(ihdr + 4, height);
+    ihdr[8] = 8;                // bits per channel
+    ihdr[9] = 2;                // RGB
+    fwrite("\x89PNG\r\n\x1a\n", 1, 8, f);
+    write_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+    write_chunk(f, "IDAT", z, n);
+    write_chunk(f, "IEND", 0, 0);
+    free(z);
+    free(raw);
+}
+
+int host_write_image(const char* path, const unsigned char* pixels, unsigned int width, unsigned int height,
+                     unsigned int bpp, unsigned int pitch)
+{
+    FILE* f = fopen(path, "wb");
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+    unsigned char* rgb = malloc(3 * (size_t)width * height);
+    host_screen_rgb(rgb, pixels, width, height, bpp, pitch);
+    const size_t len = strlen(path);
+    if (len >= 4 && !strcmp(path + len - 4, ".png"))
+        write_png(f, rgb, width, height);
+    else
+    {
+        fprintf(f, "P6\n%u %u\n255\n", width, height);
+        fwrite(rgb, 1, 3 * (size_t)width * height, f);
+    }
+    free(rgb);
+    return fclose(f) ? -1 : 0;
+}
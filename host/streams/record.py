@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+#
+# record.py
+# Records what a program writes to its terminal, for replay_bench
+#
+# PiVT100 host tools. Runs the command in a pseudo terminal of 80x30
+# characters, the size of the default 640x480 screen with an 8x16 font,
+# types the keys given with -k and saves every byte the program writes.
+#
+# Usage: record.py [-t TERM] [-k keys] [-d delay] [-l limit] output command...
+#   keys are typed one item at a time, "\n" separated items, with C escapes
+#   (\x06 is Ctrl-F); delay is the pause before each item in seconds;
+#   limit cuts the recording at the last line end before that many bytes.
+#
+# The streams in this directory were recorded from the host directory with
+#   ./streams/record.py streams/build.vt make -B all
+#   ./streams/record.py -l 262144 streams/ls-lR.vt ls -lR --color=auto /usr/share
+#   ./streams/record.py -k "$(cat streams/vim.keys)" -d 0.05 streams/vim.vt vim -u DEFAULTS -N ../src/gfx.c
+#   ./streams/record.py streams/top.vt top -d 0.3 -n 15
+
+import argparse
+import fcntl
+import os
+import pty
+import select
+import struct
+import sys
+import termios
+import time
+
+ROWS, COLS = 30, 80
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('-t', '--term', default='xterm')
+    parser.add_argument('-k', '--keys', default='')
+    parser.add_argument('-d', '--delay', type=float, default=0.1)
+    parser.add_argument('-l', '--limit', type=int, default=0)
+    parser.add_argument('output')
+    parser.add_argument('command', nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+
+    keys = [k.encode().decode('unicode_escape').encode('latin-1') for k in args.keys.split('\n') if k]
+    pid, fd = pty.fork()
+    if pid == 0:
+        os.environ['TERM'] = args.term
+        os.environ['LINES'] = str(ROWS)
+        os.environ['COLUMNS'] = str(COLS)
+        fcntl.ioctl(0, termios.TIOCSWINSZ, struct.pack('HHHH', ROWS, COLS, 0, 0))
+        os.execvp(args.command[0], args.command)
+
+    data = bytearray()
+    next_key = time.monotonic() + args.delay
+    while True:
+        timeout = max(0, next_key - time.monotonic()) if keys else None
+        ready, _, _ = select.select([fd], [], [], timeout)
+        if ready:
+            try:
+                chunk = os.read(fd, 65536)
+            except OSError:
+                break
+            if not chunk:
+                break
+            data += chunk
+        elif keys:
+            os.write(fd, keys.pop(0))
+            next_key = time.monotonic() + args.delay
+    os.waitpid(pid, 0)
+
+    if args.limit and len(data) > args.limit:
+        data = data[:data.rindex(b'\n', 0, args.limit) + 1]
+    with open(args.output, 'wb') as f:
+        f.write(data)
+    print('%s: %d bytes' % (args.output, len(data)), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
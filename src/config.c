@@ -8,6 +8,7 @@
 // the additional support of some primitive graphics functions.
 // Copyright (C) 2020 Christian Lehner
 
+#include "pivt100_config.h"
 #include "ee_printf.h"
 #include "config.h"
 
@@ -128,6 +129,7 @@ static void set_specific_values_config(const char* name, const char* value, unsi
  * - keyboardRepeatDelay, keyboardRepeatRate: Positive integers
  * - foregroundColor, backgroundColor: Color values (0-255)
  * - displayWidth, displayHeight: Specific allowed display dimensions
+ * - colorDepth: Bits per pixel (8, 16 or 32)
  * - debugVerbosity: Debug level (0-2)
  * - keyboardLayout: String value (copied directly)
  * 
@@ -212,10 +214,35 @@ int inihandler(void* user, const char* section, const char* name, const char* va
         static const int valid_heights[] = {480, 640, 768};
         set_specific_values_config(name, value, &PiVT100Config.displayHeight, valid_heights, 3);
     }
+    else if (pivt100_strcmp(name, "colorDepth") == 0)
+    {
+        static const int valid_depths[] = {8, 16, 32};
+        set_specific_values_config(name, value, &PiVT100Config.colorDepth, valid_depths, 3);
+    }
     else if (pivt100_strcmp(name, "disableGfxDMA") == 0)
     {
         set_boolean_config(name, value, &PiVT100Config.disableGfxDMA);
     }
+    else if (pivt100_strcmp(name, "glyphCacheSize") == 0)
+    {
+        set_range_config(name, value, &PiVT100Config.glyphCacheSize, 0, 1024);
+    }
+    else if (pivt100_strcmp(name, "rowCompositor") == 0)
+    {
+        set_boolean_config(name, value, &PiVT100Config.rowCompositor);
+    }
+    else if (pivt100_strcmp(name, "pageFlip") == 0)
+    {
+        set_boolean_config(name, value, &PiVT100Config.pageFlip);
+    }
+    else if (pivt100_strcmp(name, "maxFPS") == 0)
+    {
+        set_range_config(name, value, &PiVT100Config.maxFPS, 1, 240);
+    }
+    else if (pivt100_strcmp(name, "maxLatency") == 0)
+    {
+        set_range_config(name, value, &PiVT100Config.maxLatency, 1, 1000);
+    }
     // disableCollision removed (sprite system no longer present)
     else if (pivt100_strcmp(name, "debugVerbosity") == 0)
     {
@@ -283,7 +310,13 @@ void setDefaultConfig()
     PiVT100Config.fontSelection = 2;       // First font in registry (8x16 System Font)
     PiVT100Config.displayWidth = 1024;     // Default display width
     PiVT100Config.displayHeight = 768;     // Default display height
+    PiVT100Config.colorDepth = 8;          // Palette mode
     PiVT100Config.disableGfxDMA = 1;
+    PiVT100Config.glyphCacheSize = GLYPH_CACHE_ENTRIES;
+    PiVT100Config.rowCompositor = 1;
+    PiVT100Config.pageFlip = 0;
+    PiVT100Config.maxFPS = 60;
+    PiVT100Config.maxLatency = 50;
     // disableCollision removed
     PiVT100Config.debugVerbosity = 2;     // Default: all debug levels enabled
     PiVT100Config.cursorBlink = 0;            // Default: blinking disabled
@@ -329,7 +362,13 @@ void printConfig()
     LogDebug("fontSelection          = %u\n", PiVT100Config.fontSelection);
     LogDebug("displayWidth           = %u\n", PiVT100Config.displayWidth);
     LogDebug("displayHeight          = %u\n", PiVT100Config.displayHeight);
+    LogDebug("colorDepth             = %u\n", PiVT100Config.colorDepth);
     LogDebug("disableGfxDMA          = %u\n", PiVT100Config.disableGfxDMA);
+    LogDebug("glyphCacheSize         = %u\n", PiVT100Config.glyphCacheSize);
+    LogDebug("rowCompositor          = %u\n", PiVT100Config.rowCompositor);
+    LogDebug("pageFlip               = %u\n", PiVT100Config.pageFlip);
+    LogDebug("maxFPS                 = %u\n", PiVT100Config.maxFPS);
+    LogDebug("maxLatency             = %u\n", PiVT100Config.maxLatency);
     // disableCollision removed
     LogDebug("debugVerbosity         = %u\n", PiVT100Config.debugVerbosity);
     LogDebug("cursorBlink            = %u\n", PiVT100Config.cursorBlink);
@@ -526,12 +565,14 @@ unsigned int debugLevel(int level)
         PiVT100Config.hasChanged = 0;
 
     // Reinitialize framebuffer if display size changed
-    initialize_framebuffer(PiVT100Config.displayWidth, PiVT100Config.displayHeight, 8);         
+    initialize_framebuffer(PiVT100Config.displayWidth, PiVT100Config.displayHeight, PiVT100Config.colorDepth);         
 
     // Set drawing mode, cusor and colors
     gfx_set_drawing_mode(drawingNORMAL);
     gfx_term_set_cursor_blinking(PiVT100Config.cursorBlink);
 
+    gfx_set_default_fg(PiVT100Config.foregroundColor);
+    gfx_set_default_bg(PiVT100Config.backgroundColor);
     gfx_set_fg(PiVT100Config.foregroundColor);
     gfx_set_bg(PiVT100Config.backgroundColor);
     
@@ -41,7 +41,13 @@ typedef struct
     unsigned int fontSelection;         // Default font selection (font registry index)
     unsigned int displayWidth;          // Display width (640 or 1024)
     unsigned int displayHeight;         // Display height (480 or 768)
+    unsigned int colorDepth;            // Bits per pixel (8, 16 or 32)
     unsigned int disableGfxDMA;         // Disable DMA for Gfx if 1
+    unsigned int glyphCacheSize;        // Entries of the colored glyph cache, 0 disables it
+    unsigned int rowCompositor;         // Compose text rows in RAM before copying them to the framebuffer if 1
+    unsigned int pageFlip;              // Draw on a hidden page and flip to it when complete if 1
+    unsigned int maxFPS;                // Frames shown per second at most
+    unsigned int maxLatency;            // Milliseconds received text may wait to be shown while more is coming
     unsigned int debugVerbosity;        // Debug verbosity level (0=errors+notices, 1=+warnings, 2=+debug)
     unsigned int cursorBlink;           // Cursor blinking: 1=enabled, 0=disabled
     unsigned int soundLevel;            // Sound level (duty cycle %) for beeps (0-100)
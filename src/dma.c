@@ -12,12 +12,20 @@
 #include "mbox.h"
 #include "console.h"
 #include "memory.h"
+#include "irq.h"
+#include "synchronize.h"
 
 
 #define DMA_CS_OFFSET        0x00
 #define DMA_CONBLK_AD_OFFSET 0x01
 // https://www.raspberrypi.org/forums/viewtopic.php?f=72&t=10276
 
+#define DMA_CS_ACTIVE        (1<<0)
+#define DMA_CS_END           (1<<1)
+#define DMA_CS_INT           (1<<2)
+
+#define DMA_REG( OFFSET )    ( *( (volatile unsigned int*)DMA_BASE + (channel << 6) + (OFFSET) ) )
+
 
 typedef struct _DMA_Ctrl_Block
 {
@@ -26,26 +34,115 @@ typedef struct _DMA_Ctrl_Block
     unsigned int DEST_AD;               // destination address
     unsigned int TXFR_LEN;              // transfer length
     unsigned int STRIDE;                // 2D mode stride
-    struct _DMA_Ctrl_Block* NEXTCONBK;  // Next control block address
+    unsigned int NEXTCONBK;             // Bus address of the next control block
     unsigned int reserved1;
     unsigned int reserved2;
 
 } DMA_Control_Block;
 
+/** Control blocks of one submitted chain. */
+typedef struct
+{
+    unsigned short first;
+    unsigned short count;
+} DMA_Batch;
+
 
-// DMA Control block needs to be in a coherent section. We choose Coherent start + 2048 bytes
+// DMA Control blocks need to be in a coherent section. We choose Coherent start + 2048 bytes
 // Coherent start is already used by the mailbox
-// control block needs to be aligned 256
+// control blocks need to be aligned 32, the ring takes DMA_CB_COUNT * 32 bytes
+// The fill words of dma_fill_rect(), one per control block, follow the ring
+// The bounce buffer for overlapping moves (see dma_rect.c) follows at Coherent start + 8k
+#define DMA_CB_OFFSET        0x800
+#define DMA_FILL_OFFSET      (DMA_CB_OFFSET + DMA_CB_COUNT * 32)
+#define DMA_BOUNCE_OFFSET    0x2000
+#define DMA_BOUNCE_SIZE      0x40000
+#if DMA_FILL_OFFSET + DMA_CB_COUNT * 4 > DMA_BOUNCE_OFFSET
+#error "DMA control blocks and fill words overlap the bounce buffer"
+#endif
 DMA_Control_Block* ctr_blocks;
-unsigned int curr_blk;
-
+static volatile unsigned int* fill_words;   // fill word of control block i at fill_words[i]
 unsigned int channel;
 
+// The ring is free between the two counters, each written on one side only:
+// cb_taken by dma_enqueue_operation(), cb_released by dma_poll() in the IRQ.
+static unsigned int cb_next;                // next free control block in the ring
+static unsigned int cb_taken;               // control blocks handed out
+static volatile unsigned int cb_released;   // control blocks of finished batches
+static unsigned int open_first;             // first control block of the batch being enqueued
+static unsigned int open_count;             // control blocks in the batch being enqueued
+
+// Batches run one after another. The counters never wrap back, batch n has fence n+1.
+static DMA_Batch batches[DMA_CB_COUNT];
+static volatile unsigned int batch_head;    // batches finished
+static unsigned int batch_tail;             // batches submitted
+static volatile unsigned int batch_started; // batch_head is running on the channel
+static unsigned char dma_initialized = 0;
+
+
+/** Starts the oldest queued batch. Called with IRQs disabled or from the DMA IRQ. */
+static void dma_start_next()
+{
+    if (batch_head == batch_tail)
+    {
+        batch_started = 0;
+        return;
+    }
+
+    const DMA_Batch* batch = &batches[batch_head % DMA_CB_COUNT];
+    // control blocks and pixels still in the write buffer (the framebuffer
+    // is write-combining) must reach memory before the engine reads them
+    DataSyncBarrier();
+    DMA_REG(DMA_CONBLK_AD_OFFSET) = mem_arm2vc((unsigned int)&ctr_blocks[batch->first]);
+    DMA_REG(DMA_CS_OFFSET) = DMA_CS_ACTIVE | DMA_CS_END | DMA_CS_INT;
+    batch_started = 1;
+}
+
+/** Retires the running batch once the channel is idle and starts the next one. */
+static void dma_poll()
+{
+    if (!batch_started) return;
+    if (DMA_REG(DMA_CS_OFFSET) & DMA_CS_ACTIVE) return;
+    // framebuffer reads after this must not see data from before the transfer
+    DataMemBarrier();
+
+    // acknowledge end and interrupt flag
+    DMA_REG(DMA_CS_OFFSET) = DMA_CS_END | DMA_CS_INT;
+    cb_released += batches[batch_head % DMA_CB_COUNT].count;
+    batch_head++;
+    dma_start_next();
+}
+
+/** The last control block of every batch raises the channel interrupt. */
+static void dma_irq_handler( void* data )
+{
+    (void)data;
+    dma_poll();
+}
+
 void dma_init()
 {
-    ctr_blocks = (DMA_Control_Block*)(MEM_COHERENT_REGION+0x800);
-    curr_blk = 0;
-    channel = 0;
+    if (dma_initialized)
+    {
+        // the ring is reset, let queued transfers finish first
+        dma_execute_queue();
+    }
+    else
+    {
+        ctr_blocks = (DMA_Control_Block*)(MEM_COHERENT_REGION + DMA_CB_OFFSET);
+        fill_words = (volatile unsigned int*)(MEM_COHERENT_REGION + DMA_FILL_OFFSET);
+        channel = 0;
+        batch_head = 0;
+        batch_tail = 0;
+        batch_started = 0;
+        irq_attach_handler(IRQ_DMA_0 + channel, dma_irq_handler, 0);
+        dma_initialized = 1;
+    }
+    cb_next = 0;
+    cb_taken = cb_released;
+    open_first = 0;
+    open_count = 0;
+
     // Enable DMA on used channel
     unsigned int actEnable = R32(DMA_ENABLE);
     actEnable |= (1 << channel);
@@ -53,13 +150,22 @@ void dma_init()
 }
 
 
+/** Adds a transfer to the current batch. Nothing is started before dma_submit().
+ *  When the ring is full this waits for the oldest batch, a batch that alone
+ *  fills the ring is submitted as it is. Transfers always run in enqueue order.
+ *  @return number of transfers in the current batch
+ */
 int dma_enqueue_operation( void* src, void* dst, unsigned int len, unsigned int stride, unsigned int TRANSFER_INFO )
 {
     // Y length in 2D mode is limited to 16384 as the 2 top bits are reserved
-    if( curr_blk == 16 )
-        return 0;
+    while( cb_taken - cb_released == DMA_CB_COUNT )
+    {
+        if( batch_head == batch_tail )
+            dma_submit();
+        dma_wait( batch_head + 1 );
+    }
 
-    DMA_Control_Block* blk = &( ctr_blocks[ curr_blk ]);
+    DMA_Control_Block* blk = &( ctr_blocks[ cb_next ]);
     blk->TI = TRANSFER_INFO;
     blk->SOURCE_AD = mem_arm2vc((unsigned int)src);
     blk->DEST_AD = mem_arm2vc((unsigned int)dst);
@@ -69,39 +175,85 @@ int dma_enqueue_operation( void* src, void* dst, unsigned int len, unsigned int
     blk->reserved1 = 0;
     blk->reserved2 = 0;
 
-    if( curr_blk > 0 )
+    if( open_count > 0 )
     {
         // Enqueue
-        ctr_blocks[ curr_blk -1 ].NEXTCONBK = blk;
+        const unsigned int prev = (cb_next + DMA_CB_COUNT - 1) % DMA_CB_COUNT;
+        ctr_blocks[ prev ].NEXTCONBK = mem_arm2vc((unsigned int)blk);
+    }
+    else
+    {
+        open_first = cb_next;
     }
 
-    ++curr_blk;
-    return curr_blk;
+    cb_next = (cb_next + 1) % DMA_CB_COUNT;
+    cb_taken++;
+    ++open_count;
+    return open_count;
 }
 
 
-void dma_execute_queue()
+/** Hands the current batch to the DMA channel and returns without waiting.
+ *  The batch starts right away if the channel is idle, otherwise from the
+ *  completion interrupt of the batch before.
+ *  @return fence that is done when the batch and everything before it finished
+ */
+dma_fence_t dma_submit()
 {
-    // Set the first control block
-    *( (volatile unsigned int*)DMA_BASE + (channel << 6) + DMA_CONBLK_AD_OFFSET ) = mem_arm2vc((unsigned int)ctr_blocks);
+    if( open_count == 0 )
+        return batch_tail;
+
+    const unsigned int last = (open_first + open_count - 1) % DMA_CB_COUNT;
+    ctr_blocks[ last ].TI |= DMA_TI_INTEN;
+
+    const unsigned int cpsr = SaveAndDisableIRQs();
+    batches[ batch_tail % DMA_CB_COUNT ].first = open_first;
+    batches[ batch_tail % DMA_CB_COUNT ].count = open_count;
+    batch_tail++;
+    if( !batch_started )
+        dma_start_next();
+    RestoreIRQs(cpsr);
+
+    open_count = 0;
+    return batch_tail;
+}
 
-    // Start the operation
-    *( (volatile unsigned int*)DMA_BASE + (channel << 6) + DMA_CS_OFFSET  ) = 7;
 
-    // reset the queue
-    curr_blk=0;
+/** Tells whether all transfers up to fence have finished. */
+int dma_fence_done( dma_fence_t fence )
+{
+    return (int)(batch_head - fence) >= 0;
+}
 
-    // wait for DMA to finish
-    while( dma_running() )
+
+/** Waits until all transfers up to fence have finished.
+ *  The channel is polled as well, so this also works while IRQs are off.
+ */
+void dma_wait( dma_fence_t fence )
+{
+    while( !dma_fence_done(fence) )
     {
-        ;// Busy wait for DMA
+        const unsigned int cpsr = SaveAndDisableIRQs();
+        dma_poll();
+        RestoreIRQs(cpsr);
     }
 }
 
 
+/** Submits the current batch and waits for it. */
+void dma_execute_queue()
+{
+    dma_wait( dma_submit() );
+}
+
+
+/** Tells whether submitted transfers are still queued or running. */
 int dma_running()
 {
-    return *( (volatile unsigned int*)DMA_BASE + (channel << 6) + DMA_CS_OFFSET  ) &  0x1;
+    const unsigned int cpsr = SaveAndDisableIRQs();
+    dma_poll();
+    RestoreIRQs(cpsr);
+    return batch_head != batch_tail;
 }
 
 
@@ -112,3 +264,50 @@ void dma_memcpy_32( void* src, void *dst, unsigned int size )
 }
 
 
+/** Adds a transfer filling height rows of width bytes at dst with color32.
+ *  The source address does not increment and points to the fill word of the
+ *  control block in the coherent region (the reserved words of a control
+ *  block must stay 0), so fills of different colors can be queued at the
+ *  same time. color32 must hold the pixel value repeated, then
+ *  the pattern does not depend on the alignment of dst.
+ *  Like dma_enqueue_operation() the transfer starts with dma_submit().
+ */
+int dma_fill_rect( void* dst, unsigned int width, unsigned int height, unsigned int pitch, unsigned int color32 )
+{
+    // Y length in 2D mode is limited to 16384 as the 2 top bits are reserved
+    const int queued = dma_enqueue_operation( 0, dst,
+                            (((height-1) & 0x3FFF) << 16) | (width & 0xFFFF), // y len << 16 | xlen
+                            ((pitch - width) & 0xFFFF) << 16, // bits 31:16 destination stride, source does not move
+                            DMA_TI_DEST_INC | DMA_TI_2DMODE );
+
+    const unsigned int index = (cb_next + DMA_CB_COUNT - 1) % DMA_CB_COUNT;
+    fill_words[ index ] = color32;
+    ctr_blocks[ index ].SOURCE_AD = mem_arm2vc((unsigned int)&fill_words[ index ]);
+    return queued;
+}
+
+
+/** Writes size bytes from src, which the CPU wrote through the data cache,
+ *  back to memory for a transfer reading them. Not needed for the coherent
+ *  region and the framebuffer, which are not cached.
+ */
+void dma_clean_source( const void* src, unsigned int size )
+{
+#if RPI == 1
+    // the ARM1176 cleans its 16 KB data cache in one operation
+    (void)src;
+    (void)size;
+    CleanDataCache();
+#else
+    CleanDataCacheRange((unsigned int)src, size);
+#endif
+    DataSyncBarrier();
+}
+
+
+/** Scratch memory only the DMA engine accesses, used by dma_move_rect(). */
+void* dma_get_bounce_buffer( unsigned int* size )
+{
+    *size = DMA_BOUNCE_SIZE;
+    return (void*)(MEM_COHERENT_REGION + DMA_BOUNCE_OFFSET);
+}
@@ -19,14 +19,29 @@
 #define DMA_TI_DEST_INC             (1<<4)
 #define DMA_TI_DEST_IGNORE          (1<<7)
 #define DMA_TI_DEST_WIDTH_128BIT    (1<<5)
+#define DMA_TI_WAIT_RESP            (1<<3)      // wait for the AXI write response of each write
 #define DMA_TI_2DMODE               (1<<1)
 #define DMA_TI_INTEN                (1<<0)
 
 
+// Control blocks in the ring, transfers queued beyond that wait for the oldest to finish
+#define DMA_CB_COUNT                128
+
+/** Completion marker of a submitted batch of transfers. 0 is always done. */
+typedef unsigned int dma_fence_t;
+
 void dma_init();
 int dma_enqueue_operation( void* src, void* dst, unsigned int len, unsigned int stride, unsigned int TRANSFER_INFO );
+dma_fence_t dma_submit();
+int dma_fence_done( dma_fence_t fence );
+void dma_wait( dma_fence_t fence );
 void dma_execute_queue();
 void dma_memcpy_32( void* src, void *dst, unsigned int size );
+int dma_fill_rect( void* dst, unsigned int width, unsigned int height, unsigned int pitch, unsigned int color32 );
+int dma_move_rect( void* dst, void* src, unsigned int width, unsigned int height, unsigned int pitch );
+int dma_copy_rect( void* dst, unsigned int dst_pitch, void* src, unsigned int src_pitch, unsigned int width, unsigned int height );
+void dma_clean_source( const void* src, unsigned int size );
+void* dma_get_bounce_buffer( unsigned int* size );
 int dma_running();
 
 #endif
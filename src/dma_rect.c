@@ -0,0 +1,122 @@
+//
+// dma_rect.c
+// Rectangle moves built from DMA control blocks
+//
+// PiGFX is a bare metal kernel for the Raspberry Pi
+// that implements a basic ANSI terminal emulator with
+// the additional support of some primitive graphics functions.
+// Copyright (C) 2020 Christian Lehner
+
+#include "dma.h"
+
+#define DMA_RECT_MIN( v1, v2 ) ( ((v1) < (v2)) ? (v1) : (v2))
+
+
+/** Adds the transfers moving height rows of width bytes from src to dst, both
+ *  with pitch bytes from row to row. Source and destination may overlap:
+ *  - dst before src: one 2D transfer, rows top down
+ *  - dst after src on other rows: one 2D transfer, rows bottom up with a
+ *    negative stride
+ *  - dst after src within the same row: rows go through the bounce buffer
+ *    (two transfers per band of rows, bands bottom up)
+ *  Like dma_enqueue_operation() the transfers start with dma_submit().
+ *  @return number of transfers in the current batch
+ */
+int dma_move_rect( void* dst, void* src, unsigned int width, unsigned int height, unsigned int pitch )
+{
+    unsigned char* d = (unsigned char*)dst;
+    unsigned char* s = (unsigned char*)src;
+    int queued = 0;
+
+    if( width == 0 || height == 0 || d == s )
+        return 0;
+
+    const unsigned int TI = DMA_TI_DEST_INC | DMA_TI_2DMODE | DMA_TI_SRC_INC;
+
+    if( d < s )
+    {
+        // every source row is read before it gets overwritten
+        const unsigned int stride = (pitch - width) & 0xFFFF;
+        return dma_enqueue_operation( s, d,
+                            (((height-1) & 0x3FFF) << 16) | (width & 0xFFFF), // y len << 16 | xlen
+                            (stride << 16) | stride, // bits 31:16 destination stride, 15:0 source stride
+                            TI );
+    }
+
+    if( (unsigned int)(d - s) >= width )
+    {
+        const unsigned int last = (height-1) * pitch;
+        if( pitch + width <= 0x7FFF )
+        {
+            // from the last row up: after each row step back over the row and one pitch
+            const unsigned int stride = (0 - (pitch + width)) & 0xFFFF;
+            return dma_enqueue_operation( s + last, d + last,
+                                (((height-1) & 0x3FFF) << 16) | (width & 0xFFFF),
+                                (stride << 16) | stride,
+                                TI );
+        }
+        // stride does not fit into 16 bits: one control block per row
+        for( unsigned int row = height; row-- > 0; )
+        {
+            queued = dma_enqueue_operation( s + row * pitch, d + row * pitch, width, 0, DMA_TI_SRC_INC | DMA_TI_DEST_INC );
+        }
+        return queued;
+    }
+
+    // rows overlap themselves, e.g. shifting text to the right
+    unsigned int bounce_size;
+    unsigned char* bounce = (unsigned char*)dma_get_bounce_buffer( &bounce_size );
+    const unsigned int band = bounce_size / width;
+    unsigned int rows_left = height;
+    while( rows_left > 0 )
+    {
+        const unsigned int rows = DMA_RECT_MIN( band, rows_left );
+        rows_left -= rows;
+        const unsigned int offset = rows_left * pitch;
+        const unsigned int stride = (pitch - width) & 0xFFFF;
+        // the next control block reads the band back: its writes must have landed
+        dma_enqueue_operation( s + offset, bounce,
+                            (((rows-1) & 0x3FFF) << 16) | (width & 0xFFFF),
+                            stride, // rows are packed in the bounce buffer
+                            TI | DMA_TI_WAIT_RESP );
+        queued = dma_enqueue_operation( bounce, d + offset,
+                            (((rows-1) & 0x3FFF) << 16) | (width & 0xFFFF),
+                            stride << 16,
+                            TI );
+    }
+    return queued;
+}
+
+/** Adds the transfer copying height rows of width bytes from src, src_pitch
+ *  bytes from row to row, to dst with dst_pitch. Unlike dma_move_rect() the
+ *  pitches may differ, e.g. from a packed buffer into the framebuffer; the
+ *  rectangles must not overlap. A cached source has to be written back with
+ *  dma_clean_source() first.
+ *  @return number of transfers in the current batch
+ */
+int dma_copy_rect( void* dst, unsigned int dst_pitch, void* src, unsigned int src_pitch, unsigned int width, unsigned int height )
+{
+    unsigned char* d = (unsigned char*)dst;
+    unsigned char* s = (unsigned char*)src;
+    int queued = 0;
+
+    if( width == 0 || height == 0 )
+        return 0;
+
+    const unsigned int src_stride = src_pitch - width;
+    const unsigned int dst_stride = dst_pitch - width;
+    if( src_stride <= 0x7FFF && dst_stride <= 0x7FFF )
+    {
+        return dma_enqueue_operation( s, d,
+                            (((height-1) & 0x3FFF) << 16) | (width & 0xFFFF),
+                            (dst_stride << 16) | src_stride,
+                            DMA_TI_DEST_INC | DMA_TI_2DMODE | DMA_TI_SRC_INC );
+    }
+
+    // stride does not fit into 16 bits: one control block per row
+    for( unsigned int row = 0; row < height; row++ )
+    {
+        queued = dma_enqueue_operation( s + row * src_pitch, d + row * dst_pitch, width, 0, DMA_TI_SRC_INC | DMA_TI_DEST_INC );
+    }
+    return queued;
+}
@@ -40,6 +40,7 @@ void font_registry_init(void)
         g_font_registry.fonts[i].width = 0;
         g_font_registry.fonts[i].height = 0;
         g_font_registry.fonts[i].data = 0;
+        g_font_registry.fonts[i].format = FONT_FORMAT_BYTES;
         g_font_registry.fonts[i].get_glyph = 0;
         g_font_registry.fonts[i].is_valid = 0;
     }
@@ -47,7 +48,7 @@ void font_registry_init(void)
 
 
 int font_registry_register(const char* name, int width, int height,
-                          const unsigned char* data,
+                          const unsigned char* data, font_format_t format,
                           unsigned char* (*get_glyph)(unsigned int c))
 {
     if (g_font_registry.count >= MAX_FONTS)
@@ -63,6 +64,7 @@ int font_registry_register(const char* name, int width, int height,
     font->width = width;
     font->height = height;
     font->data = data;
+    font->format = format;
     font->get_glyph = get_glyph;
     font->is_valid = 0; // Will be validated later
     
@@ -11,12 +11,19 @@
 
 #define MAX_FONTS 16    // Maximum number of fonts that can be registered
 
+// Layout of the glyph data of a font
+typedef enum {
+    FONT_FORMAT_BYTES = 0,                         // One byte per pixel, 0x00 background or 0xFF foreground
+    FONT_FORMAT_PACKED1 = 1                        // One bit per pixel, (width+7)/8 bytes per glyph line, leftmost pixel in bit 7
+} font_format_t;
+
 // Font descriptor structure containing all metadata for a font
 typedef struct {
     char name[32];                                 // Human-readable name
     int width;                                     // Character width in pixels
     int height;                                    // Character height in pixels
     const unsigned char* data;                     // Pointer to binary font data
+    font_format_t format;                          // Layout of the glyph data
     unsigned char* (*get_glyph)(unsigned int c);   // Glyph address function
     int is_valid;                                  // Validation flag
 } font_descriptor_t;
@@ -42,11 +49,12 @@ void font_registry_init(void);
  * @param width Character width in pixels
  * @param height Character height in pixels
  * @param data Pointer to binary font data
+ * @param format Layout of the glyph data (FONT_FORMAT_BYTES or FONT_FORMAT_PACKED1)
  * @param get_glyph Function to get glyph address for a character
  * @return Font index if successful, -1 if failed
  */
 int font_registry_register(const char* name, int width, int height, 
-                          const unsigned char* data,
+                          const unsigned char* data, font_format_t format,
                           unsigned char* (*get_glyph)(unsigned int c));
 
 /**
@@ -25,6 +25,11 @@
  *
  * Now it's even more modified by Christian Lehner
  */
+/** Pixel order of the framebuffer allocated last, see fb_get_pixel_order(). */
+static unsigned int pixel_order = FB_PIXEL_ORDER_RGB;
+
+static FB_RETURN_TYPE fb_query_pixel_order( unsigned int* pOrder );
+
 FB_RETURN_TYPE fb_init( unsigned int ph_w, unsigned int ph_h, unsigned int vrt_w, unsigned int vrt_h,
                         unsigned int bpp, void** pp_fb, unsigned int* pfbsize, unsigned int* pPitch )
 {
@@ -86,6 +91,22 @@ FB_RETURN_TYPE fb_init( unsigned int ph_w, unsigned int ph_h, unsigned int vrt_w
         }
         value_colour_depth;
 
+        mbox_tagheader_t tag_pixel_order;
+        union
+        {
+            struct
+            {
+                uint32_t order;
+            }
+            request;
+            struct
+            {
+                uint32_t act_order;
+            }
+            response;
+        }
+        value_pixel_order;
+
         mbox_tagheader_t tag_get_buf;
         union
         {
@@ -122,13 +143,18 @@ FB_RETURN_TYPE fb_init( unsigned int ph_w, unsigned int ph_h, unsigned int vrt_w
     msg->tag_virt_size.size = sizeof(msg->value_virt_size);
     msg->tag_virt_size.code = 0;
     msg->value_virt_size.request.display_w = vrt_w;
-    msg->value_virt_size.request.display_h = vrt_h*2;   // our virtual display is double the y size for implementing double buffering
+    msg->value_virt_size.request.display_h = vrt_h;     // may be a multiple of the physical height for panning
 
     msg->tag_colour_depth.id = MAILBOX_TAG_SET_COLOUR_DEPTH; // Set colour depth
     msg->tag_colour_depth.size = sizeof(msg->value_colour_depth);
     msg->tag_colour_depth.code = 0;
     msg->value_colour_depth.request.depth = bpp;
 
+    msg->tag_pixel_order.id = MAILBOX_TAG_SET_PIXEL_ORDER; // RGB like the palette entries, see fb_get_pixel_order()
+    msg->tag_pixel_order.size = sizeof(msg->value_pixel_order);
+    msg->tag_pixel_order.code = 0;
+    msg->value_pixel_order.request.order = FB_PIXEL_ORDER_RGB;
+
     msg->tag_get_buf.id = MAILBOX_TAG_ALLOCATE_FRAMEBUFFER; // we want one
     msg->tag_get_buf.size = sizeof(msg->value_get_buf);
     msg->tag_get_buf.code = 0;
@@ -154,6 +180,9 @@ FB_RETURN_TYPE fb_init( unsigned int ph_w, unsigned int ph_h, unsigned int vrt_w
     // Get pitch (bytes per line)
     if (fb_get_pitch(pPitch) != 0) return FB_INVALID_PITCH;
 
+    // Read back the pixel order the firmware settled on, older firmware may ignore the request
+    if (fb_query_pixel_order(&pixel_order) != 0) pixel_order = FB_PIXEL_ORDER_RGB;
+
     return FB_SUCCESS;
 }
 
@@ -225,10 +254,14 @@ FB_RETURN_TYPE fb_get_phys_res(unsigned int* pRes_w, unsigned int* pRes_h)
     return FB_SUCCESS;
 }
 
+/** Palette set last by fb_set_palette(). */
+static unsigned char pal_current = pal_xterm;
+
 FB_RETURN_TYPE fb_set_palette(unsigned char idx)
 {
     // check idx
     idx = idx % NB_PALETTES;
+    pal_current = idx;
 
     // Set xterm palette
     unsigned int i;
@@ -324,6 +357,53 @@ FB_RETURN_TYPE fb_get_pitch( unsigned int* pPitch )
     return FB_SUCCESS;
 }
 
+static FB_RETURN_TYPE fb_query_pixel_order( unsigned int* pOrder )
+{
+    typedef struct
+    {
+        mbox_msgheader_t header;
+        mbox_tagheader_t tag;
+
+        union
+        {
+            // No request.
+            struct
+            {
+                uint32_t order;
+            }
+            response;
+        }
+        value;
+
+        mbox_msgfooter_t footer;
+    }
+    message_t;
+
+    message_t* msg = (message_t*)MEM_COHERENT_REGION;
+
+    msg->header.size = sizeof(*msg);
+    msg->header.code = 0;
+    msg->tag.id = MAILBOX_TAG_GET_PIXEL_ORDER; // Get pixel order (BGR or RGB)
+    msg->tag.size = sizeof(msg->value);
+    msg->tag.code = 0;
+    msg->footer.end = 0;
+
+    if (mbox_send(msg) != 0) {
+        return FB_ERROR;
+    }
+
+    *pOrder = msg->value.response.order;
+
+    return FB_SUCCESS;
+}
+
+/** Returns the pixel order (FB_PIXEL_ORDER_*) the firmware reported for the
+ *  framebuffer allocated last. */
+unsigned int fb_get_pixel_order()
+{
+    return pixel_order;
+}
+
 FB_RETURN_TYPE fb_switch_framebuffer(unsigned int yOffset)
 {
     typedef struct {
@@ -355,6 +435,8 @@ FB_RETURN_TYPE fb_switch_framebuffer(unsigned int yOffset)
     msg->value.request.yOffset = yOffset;
     msg->footer.end = 0;
 
+    // drain pixels still held in the write buffer before the GPU shows them
+    DataSyncBarrier();
     if (mbox_send(msg) != 0) {
         return FB_ERROR;
     }
@@ -362,7 +444,59 @@ FB_RETURN_TYPE fb_switch_framebuffer(unsigned int yOffset)
     return FB_SUCCESS;
 }
 
+/** Returns at the next vertical sync of the display, when an offset set with
+ *  fb_switch_framebuffer() has taken effect. Fails if the firmware does not
+ *  know the tag.
+ */
+FB_RETURN_TYPE fb_wait_vsync()
+{
+    typedef struct {
+        mbox_msgheader_t header;
+        mbox_tagheader_t tag;
+
+        union {
+            struct {
+                uint32_t unused;
+            }
+            request;
+            // No response.
+        }
+        value;
+
+        mbox_msgfooter_t footer;
+    }
+    message_t;
+
+    message_t* msg = (message_t*)MEM_COHERENT_REGION;
+
+    msg->header.size = sizeof(*msg);
+    msg->header.code = 0;
+    msg->tag.id = MAILBOX_TAG_SET_VSYNC;
+    msg->tag.size = sizeof(msg->value);
+    msg->tag.code = 0;
+    msg->value.request.unused = 0;
+    msg->footer.end = 0;
+
+    if (mbox_send(msg) != 0) {
+        return FB_ERROR;
+    }
+
+    // bit 31 is set in the tag code when the firmware handled the tag
+    if ((msg->tag.code & 0x80000000) == 0) {
+        return FB_ERROR;
+    }
+
+    return FB_SUCCESS;
+}
+
 unsigned int* fb_get_cust_pal_p()
 {
     return &palette[pal_custom][0];
 }
+
+/** Returns the 0xRRGGBB colors of the palette set last. The 16 and 32 bpp
+ *  modes have no palette in the display, gfx.c converts them by itself. */
+const unsigned int* fb_get_palette()
+{
+    return &palette[pal_current][0];
+}
@@ -22,6 +22,12 @@ FB_INVALID_TAG_DATA       = 0x5,
 FB_INVALID_PITCH          = 0x6
 } FB_RETURN_TYPE;
 
+// Pixel order of the 16 and 32 bpp modes (MAILBOX_TAG_SET_PIXEL_ORDER). RGB
+// matches the palette entries: red is the low byte of a 32 bpp pixel and
+// the high bits of a 16 bpp one. BGR swaps red and blue.
+#define FB_PIXEL_ORDER_BGR  0
+#define FB_PIXEL_ORDER_RGB  1
+
 
 
 extern FB_RETURN_TYPE fb_init( unsigned int ph_w, unsigned int ph_h, unsigned int vrt_w, unsigned int vrt_h,
@@ -31,7 +37,10 @@ FB_RETURN_TYPE fb_get_phys_res(unsigned int* pRes_w, unsigned int* pRes_h);
 extern FB_RETURN_TYPE fb_set_palette(unsigned char idx);
 FB_RETURN_TYPE fb_get_pitch( unsigned int* pPitch );
 FB_RETURN_TYPE fb_switch_framebuffer(unsigned int yOffset);
+FB_RETURN_TYPE fb_wait_vsync();
 extern unsigned int* fb_get_cust_pal_p();
+extern const unsigned int* fb_get_palette();
+extern unsigned int fb_get_pixel_order();
 
 
 #endif
@@ -22,10 +22,19 @@
 #include "config.h"
 #include "synchronize.h"
 #include "pwm.h"
+#include "glyph_blend.h"
 
 #define MIN( v1, v2 ) ( ((v1) < (v2)) ? (v1) : (v2))
 #define MAX( v1, v2 ) ( ((v1) > (v2)) ? (v1) : (v2))
-#define PFB( X, Y ) ( ctx.pfb + (Y) * ctx.Pitch + (X) )
+#define PFB( X, Y ) ( ctx.pfb + (Y) * ctx.Pitch + (X) * ctx.Bpp )
+
+/** Engine counters, only maintained when GFX_STATISTICS is enabled. */
+static gfx_stats_t stats;
+#if ENABLED(GFX_STATISTICS)
+#define GFX_STAT_ADD( FIELD, N ) ( stats.FIELD += (N) )
+#else
+#define GFX_STAT_ADD( FIELD, N )
+#endif
 
 
 
@@ -37,6 +46,43 @@ int __abs__( int a )
 /** Function type to compute a glyph address in a font. */
 typedef unsigned char* font_fun(unsigned int c);
 
+/** Columns of a screen row whose cells have not been drawn yet. */
+typedef struct {
+    unsigned short first;
+    unsigned short last;
+} DIRTY_SPAN;
+
+/** Entry of the colored glyph cache, see gfx_glyph_cache_lookup(). */
+typedef struct {
+    unsigned int key;           /// GLYPH_CACHE_KEY() of the pixels, 0 if unused
+    unsigned short prev;        /// LRU list, towards the most recently used
+    unsigned short next;        /// LRU list, towards the least recently used
+    unsigned short chain;       /// Next entry in the same hash bucket
+} GLYPH_CACHE_ENTRY;
+
+/** Pixels of a framebuffer line written on the back page since the last flip, see gfx_page_damage(). */
+typedef struct {
+    unsigned short x0;
+    unsigned short x1;          /// End, exclusive
+} PAGE_SPAN;
+
+/** Display refresh period assumed when the firmware cannot wait for vertical sync. */
+#define GFX_REFRESH_US          16667
+
+/** Pixel format back-end of a color depth, see gfx_depths. Fills, scrolls and
+ *  copies work on bytes with a color as 32-bit pattern word and are shared by
+ *  all depths; a back-end gives the pattern of a color and the glyph kernels. */
+typedef struct {
+    unsigned int bpp;                   /// Bits per pixel
+    unsigned int bytes;                 /// Bytes per pixel
+    unsigned int (*pattern)( unsigned int index, unsigned int rgb );   /// Pattern word of a palette entry
+    glyph_blend_fun* blend_bytes;       /// Glyph kernel for fonts with a byte per pixel
+    glyph_blend_fun* blend_packed;      /// Glyph kernel for packed fonts
+} GFX_DEPTH;
+
+#define GLYPH_CACHE_NONE        0xFFFF
+#define GLYPH_CACHE_KEY( c, fg, bg )    ( 0x1000000 | ((bg) << 16) | ((fg) << 8) | (c) )
+
 // Sprite support removed
 
 /** Display properties.
@@ -49,13 +95,36 @@ typedef struct {
     unsigned int W;						/// Screen pixel width
     unsigned int H;						/// Screen pixel height
     unsigned int bpp;					/// Bits depth
+    unsigned int Bpp;                   /// Bytes per pixel
+    const GFX_DEPTH* depth;             /// Pixel format back-end for bpp
     unsigned int Pitch;					/// Number of bytes for one line
-    unsigned int size;					/// Number of bytes in the framebuffer (double the screen size)
-    unsigned char* pfb;					/// Framebuffer address
-    unsigned char* pFirstFb;			/// First Framebuffer address
-    unsigned char* pSecondFb;		    /// Second Framebuffer address (double buffering)
-    unsigned int fb_yOffset;            /// y-Offset within the framebuffer for double buffering
+    unsigned int size;					/// Number of bytes of one screen
+    unsigned char* pfb;					/// Address of the top line shown on screen
+    unsigned char* pFirstFb;			/// First line of the virtual framebuffer, of the back page with page flipping
+    unsigned int fb_lines;              /// Lines in the virtual framebuffer (of a page), the screen pans through them
+    unsigned int fb_yOffset;            /// Virtual line shown on top of the screen
+    unsigned int overlay_line;          /// First line of the overlay page after the virtual framebuffer, 0 if none
     DRAWING_MODE mode;					/// Drawing mode: normal
+    dma_fence_t dma_fence;              /// DMA transfers on the framebuffer not waited for yet
+    unsigned char* dma_lo;              /// First framebuffer byte they touch
+    unsigned char* dma_hi;              /// End of the framebuffer bytes they touch
+
+    // Page flipping: the virtual framebuffer is split into two pages, each panning by
+    // itself. Drawing goes to the back page, gfx_term_flush() shows it.
+    struct
+    {
+        unsigned int count;             /// 2 with page flipping (pageFlip), 0 otherwise
+        unsigned int back;              /// Page drawn on, the other one is shown
+        unsigned int line[2];           /// First virtual framebuffer line of each page
+        unsigned int yOffset[2];        /// fb_yOffset of each page, for the back page ctx.fb_yOffset holds it
+        PAGE_SPAN* damage;              /// H lines, pixels one page has and the other has not yet
+        unsigned int damage_top;        /// First line with damage
+        unsigned int damage_bottom;     /// End of the lines with damage, no damage if equal to damage_top
+        unsigned int scroll;            /// Lines the content moved up since the last flip
+        char catch_up;                  /// 1 after a flip until the back page got the damage
+        char replay;                    /// 1 while the back page catches up, nothing is recorded
+        unsigned int flip_time;         /// time_microsec() of the last flip
+    } page;
 
     // Terminal variables
     struct
@@ -64,6 +133,8 @@ typedef struct {
         unsigned char* FONT;            /// Points to font resource
         unsigned int FONTWIDTH;         /// Pixel width for characters
         unsigned int FONTHEIGHT;        /// Pixel height for characters
+        font_format_t FONTFORMAT;       /// Layout of the glyph data, bytes or packed bits
+        unsigned int FONTROWBYTES;      /// Number of bytes for one glyph line in font
         unsigned int FONTCHARBYTES;     /// Number of bytes for one char in font
         unsigned int FONTWIDTH_INTS;    /// Number of 32-bits integers for font width (4 pixels / int)
         unsigned int FONTWIDTH_REMAIN;  /// Number of bytes to add to ints (when fontwidth not a multiple of 4)
@@ -79,8 +150,24 @@ typedef struct {
         unsigned int saved_cursor[2];	/// Saved cursor position
         char cursor_visible;			/// 0 if no visible cursor
         char cursor_blink;	     		/// 0 if not blinking
+        char cursor_drawn;              /// 1 while the cursor is painted on screen
+        char cursor_hold;               /// 1 while a batch is processed, the cursor stays lifted
+        unsigned int cursor_drawn_pos[2]; /// Row and column where the cursor is painted
+        GFX_CELL cursor_cell;           /// Cell under the painted cursor, as it was drawn
         unsigned int blink_timer_hnd;   /// timer handle for cursor blink
 
+        // Character cells, the screen content independent of the framebuffer
+        GFX_CELL* cells;                /// HEIGHT rows of WIDTH cells, kept as a ring of rows
+        unsigned int cells_top;         /// Ring index of the row shown on top of the screen
+        unsigned int* dirty_rows;       /// One bit per screen row with cells not drawn yet
+        DIRTY_SPAN* dirty_span;         /// First and last column to draw for each dirty row
+        char dirty;                     /// 1 if any bit in dirty_rows is set
+
+        unsigned int scroll_top;        /// First row of the scrolling region (DECSTBM)
+        unsigned int scroll_bottom;     /// Last row of the scrolling region
+        unsigned int scroll_pending;    /// Rows the cells were scrolled up but not the framebuffer yet
+        GFX_COL scroll_pending_bg;      /// Background color of the rows coming in with the pending scroll
+
         scn_state state;				/// Current scan state
     } term;
 
@@ -89,32 +176,59 @@ typedef struct {
     GFX_COL bg;					        /// Background characters color
     GFX_COL fg;						    /// Foreground characters color
     unsigned int reverse; 				/// reverse status: 0 - normal; 1 -reverse
-    unsigned int bg32;					/// Computed ctx.bg<<24 | ctx.bg<<16 | ctx.bg<<8 | ctx.bg;
-    unsigned int fg32;					/// Computed ctx.fg<<24 | ctx.fg<<16 | ctx.fg<<8 | ctx.fg;
+    unsigned int bg32;					/// Pattern word of ctx.bg, ctx.bg in all 4 bytes at 8 bpp
+    unsigned int fg32;					/// Pattern word of ctx.fg
 
-    unsigned char* cursor_buffer;		/// Saved content under current buffer position
-    unsigned int cursor_buffer_size;	/// Byte size of this buffer
-    unsigned int cursor_buffer_ready;	/// 0 if buffer is empty, 1 of it stores a content
+    struct
+    {
+        unsigned char* pixels;          /// Colored glyphs, FONTWIDTH*FONTHEIGHT pixels per entry
+        GLYPH_CACHE_ENTRY* entries;
+        unsigned short* buckets;        /// First entry per hash bucket
+        unsigned int count;             /// Number of entries, 0 if the cache is off
+        unsigned int bucket_mask;       /// Number of buckets - 1
+        unsigned short lru_first;       /// Most recently used entry
+        unsigned short lru_last;        /// Least recently used entry, replaced on a miss
+        unsigned long long hits;
+        unsigned long long misses;
+    } glyph_cache;
 
-} FRAMEBUFFER_CTX;
+    struct
+    {
+        unsigned char* buffer[2];       /// Text row images in cached RAM, W*FONTHEIGHT pixels each, 0 if off
+        dma_fence_t fence[2];           /// DMA flush still reading the buffer
+        unsigned int next;              /// Buffer for the next row
+    } compose;
 
-/** Forward declaration for some state functions. */
-state_fun state_fun_finalletter;
-state_fun state_fun_read_digit;
-state_fun state_fun_selectescape;
-state_fun state_fun_waitquarebracket;
-state_fun state_fun_normaltext;
-state_fun state_fun_ignore_digit;
+} FRAMEBUFFER_CTX;
 
 #include "framebuffer.h"
 
 // Global static to store the screen variables.
 FRAMEBUFFER_CTX ctx;
 
+/** The overlay page (setup dialog) has a display context of its own, swapped
+ *  with ctx while the overlay is drawn, see gfx_overlay_open(). */
+static struct
+{
+    FRAMEBUFFER_CTX ctx;                /// The context not in use: overlay or terminal
+    draw_putc_fun (*putc);              /// Its glyph kernel
+    unsigned char open;                 /// 1 while the overlay page is shown
+    unsigned char drawing;              /// 1 between gfx_overlay_begin() and gfx_overlay_end()
+} overlay;
+
 // Forward declarations
 void gfx_term_render_cursor();
-void gfx_term_save_cursor_content();
-void gfx_switch_framebuffer();
+void gfx_term_render_dirty();
+static void gfx_term_apply_scroll();
+static void gfx_select_putc();
+static void gfx_glyph_cache_alloc();
+static void gfx_glyph_cache_free();
+static void gfx_compose_alloc();
+static void gfx_compose_free();
+static void gfx_page_alloc();
+static void gfx_page_damage( unsigned int x, unsigned int y, unsigned int width, unsigned int height );
+static void gfx_page_scroll( unsigned int npixels );
+static void gfx_page_flip();
 
 // Functions from pigfx.c called by some private sequences (set mode, debug tests ...)
 extern void initialize_framebuffer(unsigned int width, unsigned int height, unsigned int bpp);
@@ -130,69 +244,349 @@ unsigned char* font_get_glyph_address(unsigned int c)
 #include "buildin_fonts.inc"
 
 
-/** Compute some font variables from font size. */
-void gfx_compute_font()
+/** 8 bpp: the palette index in every byte, the display looks the color up. */
+static unsigned int gfx_pattern8( unsigned int index, __attribute__((unused)) unsigned int rgb )
 {
-    ctx.term.FONTCHARBYTES = ctx.term.FONTWIDTH * ctx.term.FONTHEIGHT;
-    ctx.term.FONTWIDTH_INTS = ctx.term.FONTWIDTH / 4 ;
-    ctx.term.FONTWIDTH_REMAIN = ctx.term.FONTWIDTH % 4;
-    ctx.cursor_buffer_size = ctx.term.FONTWIDTH * ctx.term.FONTHEIGHT;
-    if (ctx.cursor_buffer)
+    return index * 0x01010101;
+}
+
+/** 16 bpp: RGB565 with red in the high bits, the pixel twice. */
+static unsigned int gfx_pattern16( __attribute__((unused)) unsigned int index, unsigned int rgb )
+{
+    const unsigned int pixel = ((rgb >> 8) & 0xF800) | ((rgb >> 5) & 0x07E0) | ((rgb >> 3) & 0x001F);
+    return pixel | (pixel << 16);
+}
+
+/** 32 bpp: red in the low byte like the palette entries, opaque. */
+static unsigned int gfx_pattern32( __attribute__((unused)) unsigned int index, unsigned int rgb )
+{
+    return 0xFF000000 | ((rgb << 16) & 0xFF0000) | (rgb & 0x00FF00) | ((rgb >> 16) & 0x0000FF);
+}
+
+/** The supported color depths. Only 8 bpp has the width specialized kernels
+ *  and NEON, see gfx_select_putc(). */
+static const GFX_DEPTH gfx_depths[] =
+{
+    {  8, 1, gfx_pattern8,  glyph_blend_bytes,   glyph_blend_packed   },
+    { 16, 2, gfx_pattern16, glyph_blend_bytes16, glyph_blend_packed16 },
+    { 32, 4, gfx_pattern32, glyph_blend_bytes32, glyph_blend_packed32 },
+};
+
+/** Pattern word of each palette color in the current depth, see gfx_set_fg(). */
+static unsigned int gfx_color32[256];
+
+/** Selects the back-end for bpp bits per pixel, 8 bpp if there is none, and
+ *  computes the pattern words of the palette colors for it. */
+static void gfx_set_depth( unsigned int bpp )
+{
+    ctx.depth = &gfx_depths[0];
+    for (unsigned int i = 0; i < sizeof(gfx_depths) / sizeof(gfx_depths[0]); i++)
+    {
+        if (gfx_depths[i].bpp == bpp)
+            ctx.depth = &gfx_depths[i];
+    }
+    ctx.bpp = ctx.depth->bpp;
+    ctx.Bpp = ctx.depth->bytes;
+
+    // The patterns are for the RGB pixel order, with BGR red and blue trade places
+    const unsigned int* rgb = fb_get_palette();
+    const int bgr = (fb_get_pixel_order() == FB_PIXEL_ORDER_BGR);
+    for (unsigned int i = 0; i < 256; i++)
+    {
+        const unsigned int c = bgr ? ((rgb[i] << 16) & 0xFF0000) | (rgb[i] & 0x00FF00) | ((rgb[i] >> 16) & 0x0000FF) : rgb[i];
+        gfx_color32[i] = ctx.depth->pattern(i, c);
+    }
+}
+
+
+/** Returns the first cell of a screen row. */
+static inline GFX_CELL* gfx_term_cell_row( unsigned int row )
+{
+    unsigned int r = ctx.term.cells_top + row;
+    if (r >= ctx.term.HEIGHT) r -= ctx.term.HEIGHT;
+    return ctx.term.cells + r * ctx.term.WIDTH;
+}
+
+/** Sets cells [from, to) of a screen row to blanks in the current colors. */
+static void gfx_term_blank_cells( unsigned int row, unsigned int from, unsigned int to )
+{
+    if (row >= ctx.term.HEIGHT) return;
+    if (to > ctx.term.WIDTH) to = ctx.term.WIDTH;
+
+    GFX_CELL* cell = gfx_term_cell_row(row);
+    const GFX_CELL blank = { ' ', ctx.fg, ctx.bg, 0, 0 };
+    for (unsigned int col = from; col < to; col++)
+    {
+        cell[col] = blank;
+    }
+}
+
+/** Copies all cells of screen row src to screen row dst. */
+static void gfx_term_copy_cell_row( unsigned int dst, unsigned int src )
+{
+    pivt100_memcpy(gfx_term_cell_row(dst), gfx_term_cell_row(src), ctx.term.WIDTH * sizeof(GFX_CELL));
+}
+
+/** Remembers that a cell has to be drawn by gfx_term_render_dirty(). */
+static void gfx_term_mark_dirty( unsigned int row, unsigned int col )
+{
+    DIRTY_SPAN* span = &ctx.term.dirty_span[row];
+    unsigned int* word = &ctx.term.dirty_rows[row >> 5];
+    const unsigned int bit = 1u << (row & 31);
+
+    if (*word & bit)
+    {
+        if (col < span->first) span->first = col;
+        if (col > span->last) span->last = col;
+    }
+    else
+    {
+        *word |= bit;
+        span->first = span->last = col;
+        ctx.term.dirty = 1;
+    }
+}
+
+/** Marks every cell of the screen for drawing. */
+static void gfx_term_mark_all_dirty()
+{
+    for (unsigned int row = 0; row < ctx.term.HEIGHT; row++)
+    {
+        ctx.term.dirty_span[row].first = 0;
+        ctx.term.dirty_span[row].last = ctx.term.WIDTH - 1;
+    }
+    for (unsigned int i = 0; i < (ctx.term.HEIGHT + 31) / 32; i++)
+    {
+        ctx.term.dirty_rows[i] = 0xFFFFFFFF;
+    }
+    // no bits for rows below the screen, their spans are not initialized
+    if (ctx.term.HEIGHT % 32)
+        ctx.term.dirty_rows[ctx.term.HEIGHT / 32] = (1u << (ctx.term.HEIGHT % 32)) - 1;
+    ctx.term.dirty = (ctx.term.HEIGHT > 0);
+}
+
+/** Forgets all pending cell drawing, used when the screen is wiped anyway. */
+static void gfx_term_clear_dirty()
+{
+    pivt100_memset(ctx.term.dirty_rows, 0, ((ctx.term.HEIGHT + 31) / 32) * sizeof(unsigned int));
+    ctx.term.dirty = 0;
+}
+
+/** Allocates the cell grid for the current terminal size.
+ *  Cells of the previous grid are kept where they still fit, new cells are blank.
+ */
+static void gfx_term_alloc_cells( unsigned int old_width, unsigned int old_height )
+{
+    GFX_CELL* old_cells = ctx.term.cells;
+    const unsigned int old_top = ctx.term.cells_top;
+    const unsigned int words = (ctx.term.HEIGHT + 31) / 32;
+
+    if (ctx.term.dirty_rows) nmalloc_free(ctx.term.dirty_rows);
+    if (ctx.term.dirty_span) nmalloc_free(ctx.term.dirty_span);
+    ctx.term.cells = (GFX_CELL*)nmalloc_malloc((ctx.term.WIDTH * ctx.term.HEIGHT + 1) * sizeof(GFX_CELL));
+    ctx.term.dirty_rows = (unsigned int*)nmalloc_malloc((words + 1) * sizeof(unsigned int));
+    ctx.term.dirty_span = (DIRTY_SPAN*)nmalloc_malloc((ctx.term.HEIGHT + 1) * sizeof(DIRTY_SPAN));
+    ctx.term.cells_top = 0;
+    pivt100_memset(ctx.term.dirty_rows, 0, (words + 1) * sizeof(unsigned int));
+    ctx.term.dirty = 0;
+    ctx.term.scroll_pending = 0;
+
+    for (unsigned int row = 0; row < ctx.term.HEIGHT; row++)
     {
-        nmalloc_free(ctx.cursor_buffer);
-        ctx.cursor_buffer = 0;
-        ctx.cursor_buffer_ready = 0;
+        unsigned int keep = 0;
+        if (old_cells && row < old_height)
+        {
+            keep = MIN(old_width, ctx.term.WIDTH);
+            pivt100_memcpy(gfx_term_cell_row(row), old_cells + ((old_top + row) % old_height) * old_width, keep * sizeof(GFX_CELL));
+        }
+        gfx_term_blank_cells(row, keep, ctx.term.WIDTH);
     }
-    ctx.cursor_buffer = (unsigned char*)nmalloc_malloc(ctx.cursor_buffer_size);
-    pivt100_memset(ctx.cursor_buffer, 0, ctx.cursor_buffer_size);
 
-    // set logical terminal size
+    if (old_cells) nmalloc_free(old_cells);
+}
+
+/** Takes the glyph data and size of a registered font and computes the
+ *  glyph layout and the text size in characters from it. */
+static void gfx_set_font_metrics( const font_descriptor_t* fontInfo )
+{
+    ctx.term.FONT = (unsigned char*)fontInfo->data;
+    ctx.term.FONTWIDTH = fontInfo->width;
+    ctx.term.FONTHEIGHT = fontInfo->height;
+    ctx.term.FONTFORMAT = fontInfo->format;
+    ctx.term.font_getglyph = fontInfo->get_glyph;
+
+    ctx.term.FONTROWBYTES = (ctx.term.FONTFORMAT == FONT_FORMAT_PACKED1) ? (ctx.term.FONTWIDTH + 7) / 8 : ctx.term.FONTWIDTH;
+    ctx.term.FONTCHARBYTES = ctx.term.FONTROWBYTES * ctx.term.FONTHEIGHT;
+    ctx.term.FONTWIDTH_INTS = ctx.term.FONTWIDTH / 4 ;
+    ctx.term.FONTWIDTH_REMAIN = ctx.term.FONTWIDTH % 4;
     ctx.term.WIDTH = ctx.W / ctx.term.FONTWIDTH;
     ctx.term.HEIGHT= ctx.H / ctx.term.FONTHEIGHT;
-    gfx_term_save_cursor_content();
+}
+
+/** Compute some font variables from font size. */
+void gfx_compute_font( const font_descriptor_t* fontInfo )
+{
+    const unsigned int old_width = ctx.term.WIDTH;
+    const unsigned int old_height = ctx.term.HEIGHT;
+
+    gfx_set_font_metrics(fontInfo);
+    ctx.term.cursor_drawn = 0;
+    gfx_term_alloc_cells(old_width, old_height);
+
+    // the scrolling region is reset to the full screen
+    ctx.term.scroll_top = 0;
+    ctx.term.scroll_bottom = ctx.term.HEIGHT-1;
+
+    // colored glyphs of the previous font are dropped
+    gfx_glyph_cache_alloc();
+    gfx_compose_alloc();
+    gfx_select_putc();
 }
 
 
 // Sprite collision detection removed
 
+/** Starts the queued DMA transfers touching framebuffer bytes lo to hi-1 without
+ *  waiting for them. CPU accesses to these bytes wait in gfx_dma_sync_range().
+ */
+static void gfx_dma_submit( unsigned char* lo, unsigned char* hi )
+{
+    if (ctx.dma_fence && !dma_fence_done(ctx.dma_fence))
+    {
+        ctx.dma_lo = MIN(ctx.dma_lo, lo);
+        ctx.dma_hi = MAX(ctx.dma_hi, hi);
+    }
+    else
+    {
+        ctx.dma_lo = lo;
+        ctx.dma_hi = hi;
+    }
+    ctx.dma_fence = dma_submit();
+}
+
+/** Waits until no DMA transfer touches the framebuffer anymore. */
+static void gfx_dma_sync()
+{
+    if (ctx.dma_fence == 0) return;
+    dma_wait(ctx.dma_fence);
+    ctx.dma_fence = 0;
+}
+
+/** Waits for the DMA transfers if they touch framebuffer bytes lo to hi-1. */
+static inline void gfx_dma_sync_range( const unsigned char* lo, const unsigned char* hi )
+{
+    if (ctx.dma_fence && lo < ctx.dma_hi && hi > ctx.dma_lo)
+        gfx_dma_sync();
+}
+
+/** Fills height lines of width bytes from dst on with the repeated color word col32.
+ *  The DMA engine fills in the background, the CPU fallback uses 32-bit stores
+ *  and treats full lines as one run. The word is aligned to the framebuffer
+ *  words, single bytes take their byte of it, so it works for every depth.
+ */
+static void gfx_fill( unsigned char* dst, unsigned int width, unsigned int height, unsigned int col32 )
+{
+    if (width == 0 || height == 0) return;
+    GFX_STAT_ADD(fb_written, width * height);
+    GFX_STAT_ADD(fb_write_runs, (width == ctx.Pitch) ? 1 : height);
+
+    if (!PiVT100Config.disableGfxDMA)
+    {
+        dma_fill_rect(dst, width, height, ctx.Pitch, col32);
+        gfx_dma_submit(dst, dst + height * ctx.Pitch);
+        return;
+    }
+
+    gfx_dma_sync_range(dst, dst + height * ctx.Pitch);
+    if (width == ctx.Pitch)
+    {
+        width *= height;
+        height = 1;
+    }
+    while (height--)
+    {
+        unsigned char* p = dst;
+        unsigned int n = width;
+        while (n && ((unsigned int)p & 3))
+        {
+            *p = (unsigned char)(col32 >> (8 * ((unsigned int)p & 3)));
+            p++;
+            n--;
+        }
+        unsigned int* p32 = (unsigned int*)p;
+        for (; n >= 16; n -= 16, p32 += 4)
+        {
+            p32[0] = col32;
+            p32[1] = col32;
+            p32[2] = col32;
+            p32[3] = col32;
+        }
+        for (; n >= 4; n -= 4)
+        {
+            *p32++ = col32;
+        }
+        p = (unsigned char*)p32;
+        while (n--)
+        {
+            *p = (unsigned char)(col32 >> (8 * ((unsigned int)p & 3)));
+            p++;
+        }
+        dst += ctx.Pitch;
+    }
+}
+
 /** Sets the display variables. This is called by initialize_framebuffer when setting mode.
  * Default to 8x16 font if no other font was selected before.
  * @param p_framebuffer Framebuffer address as given by DMA
  * @param width Pixel width
  * @param height Pixel height
- * @param bpp Bit depth
+ * @param bpp Bit depth: 8, 16 or 32, see gfx_depths
  * @param pitch Line byte pitch as given by DMA
- * @param size Byte size for framebuffer
+ * @param size Byte size for framebuffer, may hold several screens
  */
 void gfx_set_env( void* p_framebuffer, unsigned int width, unsigned int height, unsigned int bpp, unsigned int pitch, unsigned int size )
 {
+    gfx_dma_sync();
     dma_init();
 
-    // Set ctx memory to 0
-    pivt100_memset(&ctx, 0, sizeof(ctx));
+    // Buffers of a previous mode are released before ctx is cleared
+    if (ctx.term.cells) nmalloc_free(ctx.term.cells);
+    if (ctx.term.dirty_rows) nmalloc_free(ctx.term.dirty_rows);
+    if (ctx.term.dirty_span) nmalloc_free(ctx.term.dirty_span);
+    if (ctx.page.damage) nmalloc_free(ctx.page.damage);
+    gfx_glyph_cache_free();
+    gfx_compose_free();
 
-    // set default font
-    if (ctx.term.FONT == 0) {
-        gfx_term_set_font(1);
-    }
+    // Set ctx memory to 0, an overlay of the previous mode is gone
+    pivt100_memset(&ctx, 0, sizeof(ctx));
+    pivt100_memset(&overlay, 0, sizeof(overlay));
 
     // Store DMA framebuffer infos
     ctx.pFirstFb = p_framebuffer;
-    ctx.pSecondFb = p_framebuffer+size/2;
-    //ctx.pfb = ctx.pSecondFb;    // set invisible part of screen to start with
-    ctx.pfb = ctx.pFirstFb;    // set invisible part of screen to start with
+    ctx.pfb = ctx.pFirstFb;
     ctx.W = width;
     ctx.H = height;
     ctx.Pitch = pitch;
-    ctx.size = size/2;      // screen is only half of the framebuffer with double buffering
-    ctx.bpp = bpp;
+    ctx.size = pitch * height;
+    gfx_set_depth(bpp);
+
+    // The virtual framebuffer may be several screens high, see gfx_scroll_down().
+    // With two screens or more the last one is kept as overlay page for the setup dialog.
+    ctx.fb_lines = MAX(size / pitch, height);
+    ctx.fb_yOffset = 0;
+    if (ctx.fb_lines >= 2 * height)
+    {
+        ctx.fb_lines -= height;
+        ctx.overlay_line = ctx.fb_lines;
+    }
+    gfx_page_alloc();
 
-    // store terminal sizes and informations
-    ctx.term.WIDTH = ctx.W / ctx.term.FONTWIDTH;
-    ctx.term.HEIGHT= ctx.H / ctx.term.FONTHEIGHT;
+    // set default font, this also sizes the terminal and its cells
+    gfx_term_set_font(1);
     ctx.term.cursor_row = ctx.term.cursor_col = 0;
     ctx.term.cursor_visible = 1;
-    ctx.term.state.next = state_fun_normaltext;
+    ctx.term.state.state = SCN_GROUND;
+    if (ctx.term.tab_pos == 0) ctx.term.tab_pos = 8;
 
 
     // store reverse state to 'normal'
@@ -215,20 +609,16 @@ void gfx_set_default_fg( GFX_COL col )
 void gfx_set_bg( GFX_COL col )
 {
     ctx.bg = col;
-    // fill precomputed 4 bytes integer
-    unsigned char* p = (unsigned char*)&ctx.bg32;
-    for (size_T i = 0 ; i < sizeof(ctx.bg32) ; i++)
-        *(p++) = col;
+    // precomputed pattern word of the depth
+    ctx.bg32 = gfx_color32[col];
 }
 
 /** Sets the foreground color. */
 void gfx_set_fg( GFX_COL col )
 {
     ctx.fg = col;
-    // fill precomputed 4 bytes integer
-    unsigned char* p = (unsigned char*)&ctx.fg32;
-    for (size_T i = 0 ; i < sizeof(ctx.fg32) ; i++)
-        *(p++) = col;
+    // precomputed pattern word of the depth
+    ctx.fg32 = gfx_color32[col];
 }
 
 /** Swaps the foreground and background colors. */
@@ -272,94 +662,150 @@ void gfx_get_gfx_size( unsigned int* width, unsigned int* height )
 void gfx_clear()
 {
     // Sprites removed: nothing to clear besides framebuffer
+    gfx_page_damage(0, 0, ctx.W, ctx.H);
+    gfx_fill(ctx.pfb, ctx.Pitch, ctx.H, ctx.bg32);
+}
 
-    if (PiVT100Config.disableGfxDMA)
-    {
-        unsigned int* pf = (unsigned int*)ctx.pfb;
-        for (unsigned int i=0; i< ctx.size/4; i++)
-        {
-            pf[i] = ctx.bg32;
-        }
-    }
-    else
-    {
-        // Somehow a simple memfill is not working with DMA. So we fill the first line on the screen and then use 2D mode to copy it to the rest of the screen
-        unsigned int* fillScreen = (unsigned int*)ctx.pfb;
-        for (unsigned int i=0; i<ctx.Pitch/4; i++)
-        {
-            fillScreen[i] = ctx.bg32;
-        }
-        dma_enqueue_operation( ctx.pfb,
-                            ctx.pfb+ctx.Pitch,
-                            (((ctx.H-2) & 0xFFFF )<<16) | (ctx.Pitch & 0xFFFF ), // y len << 16 | xlen
-                            (-ctx.Pitch & 0xFFFF), // bits 31:16 destination stride, 15:0 source stride
-                            DMA_TI_DEST_INC | DMA_TI_2DMODE | DMA_TI_SRC_INC );
-        dma_execute_queue();
-    }
+/** Shows the virtual framebuffer from line yOffset on. */
+static void gfx_pan_to( unsigned int yOffset )
+{
+    // lines still being moved would be shown half done
+    gfx_dma_sync();
+    ctx.fb_yOffset = yOffset;
+    ctx.pfb = ctx.pFirstFb + yOffset * ctx.Pitch;
+    // the overlay stays on screen, the terminal page is shown when it closes;
+    // a back page is shown by gfx_page_flip()
+    if (!overlay.open && ctx.page.count < 2)
+        fb_switch_framebuffer(yOffset);
+}
+
+/** Fills lines of the virtual framebuffer with the background color. */
+static void gfx_clear_lines( unsigned char* pf, unsigned int lines )
+{
+    gfx_fill(pf, ctx.W * ctx.Bpp, lines, ctx.bg32);
 }
 
-/** move screen up, new bg pixels on bottom */
+/** move screen up, new bg pixels on bottom.
+ *  When the virtual framebuffer is higher than the screen, the new bottom lines
+ *  are cleared below the visible area and the screen is panned down, so no pixel is
+ *  copied. Only when the end of the virtual framebuffer is reached the visible
+ *  content is copied back to its top.
+ */
 void gfx_scroll_down( unsigned int npixels )
 {
-    if (PiVT100Config.disableGfxDMA)
+    if (npixels > ctx.H) npixels = ctx.H;
+
+    if (ctx.fb_lines >= 2 * ctx.H)
     {
-        for (unsigned int row = 0; row < (ctx.H - npixels); row++)
+        gfx_page_scroll(npixels);
+        GFX_STAT_ADD(scrolls, 1);
+        if (ctx.fb_yOffset + ctx.H + npixels > ctx.fb_lines)
         {
-            unsigned char* src = PFB(0, row + npixels);
-            unsigned char* dst = PFB(0, row);
-            veryfastmemcpy(dst, src, ctx.W);
+            // wrap around: the rows staying visible go to the top of the virtual framebuffer
+            const unsigned int bytes_to_copy = ctx.Pitch * (ctx.H - npixels);
+            GFX_STAT_ADD(fb_read, bytes_to_copy);
+            GFX_STAT_ADD(fb_written, bytes_to_copy);
+            GFX_STAT_ADD(fb_write_runs, 1);
+            if (bytes_to_copy > 0)
+            {
+                if (PiVT100Config.disableGfxDMA)
+                {
+                    gfx_dma_sync();
+                    veryfastmemcpy(ctx.pFirstFb, PFB(0, npixels), bytes_to_copy);
+                }
+                else
+                {
+                    // the new bottom lines are cleared while the copy runs
+                    dma_enqueue_operation(PFB(0, npixels), ctx.pFirstFb, bytes_to_copy, 0, DMA_TI_SRC_INC | DMA_TI_DEST_INC);
+                    gfx_dma_submit(ctx.pFirstFb, PFB(0, ctx.H));
+                }
+            }
+            gfx_clear_lines(ctx.pFirstFb + (ctx.H - npixels) * ctx.Pitch, npixels);
+            gfx_pan_to(0);
         }
-    }
-    else
-    {
-        unsigned int bytes_to_copy = ctx.W * (ctx.H - npixels);
-        if (bytes_to_copy > 0)
+        else
         {
-            dma_memcpy_32(PFB(0, npixels), PFB(0, 0), bytes_to_copy);
+            // clear the lines below the visible area, then show them
+            gfx_clear_lines(PFB(0, ctx.H), npixels);
+            gfx_pan_to(ctx.fb_yOffset + npixels);
         }
+        return;
     }
 
-    for (unsigned int row = ctx.H - npixels; row < ctx.H; row++)
-    {
-        unsigned char* pf = PFB(0, row);
-        for (unsigned int col = 0; col < ctx.W; col++)
-        {
-            *pf++ = ctx.bg;
-        }
-    }
+    gfx_scroll_region_down(0, ctx.H, npixels);
 }
 
 void gfx_scroll_up( unsigned int npixels )
 {
-    if (PiVT100Config.disableGfxDMA)
-    {
-        for (int row = ctx.H - 1; row >= (int)npixels; row--)
-        {
-            unsigned char* src = PFB(0, row - npixels);
-            unsigned char* dst = PFB(0, row);
-            veryfastmemcpy(dst, src, ctx.W);
-        }
-    }
-    else
+    gfx_scroll_region_up(0, ctx.H, npixels);
+}
+
+/** move lines top to bottom-1 up by npixels, new bg pixels at the bottom of the region.
+ *  With DMA the region is moved by a single 2D transfer (dma_move_rect()). Rows are copied from the top
+ *  down, so every source row is read before it gets overwritten.
+ */
+void gfx_scroll_region_down( unsigned int top, unsigned int bottom, unsigned int npixels )
+{
+    if (bottom > ctx.H) bottom = ctx.H;
+    if (top >= bottom || npixels == 0) return;
+    if (npixels > bottom - top) npixels = bottom - top;
+    gfx_page_damage(0, top, ctx.W, bottom - top);
+
+    const unsigned int rows = bottom - top - npixels;
+    const unsigned int line_bytes = ctx.W * ctx.Bpp;
+    GFX_STAT_ADD(scrolls, 1);
+    GFX_STAT_ADD(fb_read, line_bytes * rows);
+    GFX_STAT_ADD(fb_written, line_bytes * rows);
+    GFX_STAT_ADD(fb_write_runs, rows);
+    if (rows > 0)
     {
-        unsigned int bytes_to_copy = ctx.W * (ctx.H - npixels);
-        if (bytes_to_copy > 0)
+        if (PiVT100Config.disableGfxDMA)
         {
-            for (int row = ctx.H - 1; row >= (int)npixels; row--)
+            gfx_dma_sync_range(PFB(0, top), PFB(0, bottom));
+            for (unsigned int row = top; row < top + rows; row++)
             {
-                dma_memcpy_32(PFB(0, row - npixels), PFB(0, row), ctx.W);
+                veryfastmemcpy(PFB(0, row), PFB(0, row + npixels), line_bytes);
             }
         }
+        else
+        {
+            dma_move_rect(PFB(0, top), PFB(0, top + npixels), line_bytes, rows, ctx.Pitch);
+            gfx_dma_submit(PFB(0, top), PFB(0, bottom));
+        }
     }
+    gfx_clear_lines(PFB(0, bottom - npixels), npixels);
+}
 
-    for (unsigned int row = 0; row < npixels; row++)
+/** move lines top to bottom-1 down by npixels, new bg pixels at the top of the region.
+ *  Rows are copied from the bottom up because source and destination overlap.
+ */
+void gfx_scroll_region_up( unsigned int top, unsigned int bottom, unsigned int npixels )
+{
+    if (bottom > ctx.H) bottom = ctx.H;
+    if (top >= bottom || npixels == 0) return;
+    if (npixels > bottom - top) npixels = bottom - top;
+    gfx_page_damage(0, top, ctx.W, bottom - top);
+
+    const unsigned int line_bytes = ctx.W * ctx.Bpp;
+    GFX_STAT_ADD(scrolls, 1);
+    GFX_STAT_ADD(fb_read, line_bytes * (bottom - top - npixels));
+    GFX_STAT_ADD(fb_written, line_bytes * (bottom - top - npixels));
+    GFX_STAT_ADD(fb_write_runs, bottom - top - npixels);
+    if (PiVT100Config.disableGfxDMA)
     {
-        unsigned char* pf = PFB(0, row);
-        for (unsigned int col = 0; col < ctx.W; col++)
+        gfx_dma_sync_range(PFB(0, top), PFB(0, bottom));
+        for (unsigned int row = bottom - 1; row >= top + npixels; row--)
         {
-            *pf++ = ctx.bg;
+            veryfastmemcpy(PFB(0, row), PFB(0, row - npixels), line_bytes);
         }
     }
+    else if (bottom - top > npixels)
+    {
+        // a single 2D transfer running from the bottom row up
+        dma_move_rect(PFB(0, top + npixels), PFB(0, top), line_bytes, bottom - top - npixels, ctx.Pitch);
+        gfx_dma_submit(PFB(0, top), PFB(0, bottom));
+    }
+    gfx_clear_lines(PFB(0, top), npixels);
 }
 
 /** move screen to the right, new bg pixels on the left */
@@ -367,43 +813,42 @@ void gfx_scroll_left( unsigned int npixels )
 {
     if (npixels >= ctx.W) return;
     if (npixels == 0) return;
+    gfx_page_damage(0, 0, ctx.W, ctx.H);
+    gfx_dma_sync();
 
     unsigned char* pfb_dst;
     unsigned char* pfb_src;
     unsigned char* pfb_end;
     for (unsigned int i=0; i<ctx.H; i++)
     {
-        // for all lines
+        // for all lines, byte by byte from the last one
         pfb_end = PFB(0, i);
-        pfb_dst = PFB(ctx.W-1, i);
-        pfb_src = PFB(ctx.W-1-npixels, i);
+        pfb_dst = PFB(ctx.W, i) - 1;
+        pfb_src = PFB(ctx.W-npixels, i) - 1;
         while (pfb_src >= pfb_end)
             *pfb_dst-- = *pfb_src--;
-        for (unsigned int k=0; k<npixels; k++)
-            *pfb_end++ = ctx.bg;
     }
+    gfx_fill(PFB(0, 0), npixels * ctx.Bpp, ctx.H, ctx.bg32);
 }
 
 void gfx_scroll_right( unsigned int npixels )
 {
     if (npixels >= ctx.W) return;
     if (npixels == 0) return;
+    gfx_page_damage(0, 0, ctx.W, ctx.H);
+    gfx_dma_sync();
 
     unsigned int cpPixels = ctx.W-npixels;
     for (unsigned int i=0; i<ctx.H; i++)
     {
         // for all lines
-        veryfastmemcpy(PFB(0,i), PFB(npixels,i), cpPixels);
-        unsigned char* pfb_bg = PFB(cpPixels, i);
-        for (unsigned int j=cpPixels; j<ctx.W; j++)
-        {
-            *pfb_bg++ = ctx.bg;
-        }
+        veryfastmemcpy(PFB(0,i), PFB(npixels,i), cpPixels * ctx.Bpp);
     }
+    gfx_fill(PFB(cpPixels, 0), npixels * ctx.Bpp, ctx.H, ctx.bg32);
 }
 
-/** draw a bg filled rectangle: */
-void gfx_fill_rect( unsigned int x, unsigned int y, unsigned int width, unsigned int height )
+/** Fills the part of a rectangle inside the screen with the color word col32. */
+static void gfx_fill_rect_col32( unsigned int x, unsigned int y, unsigned int width, unsigned int height, unsigned int col32 )
 {
     if( x >= ctx.W || y >= ctx.H )
         return;
@@ -414,23 +859,20 @@ void gfx_fill_rect( unsigned int x, unsigned int y, unsigned int width, unsigned
     if( y+height > ctx.H )
         height = ctx.H-y;
 
-    while( height-- )
-    {
-        unsigned char* pf = PFB(x,y);
-        const unsigned char* const pfb_end = pf + width;
+    gfx_page_damage(x, y, width, height);
+    gfx_fill(PFB(x, y), width * ctx.Bpp, height, col32);
+}
 
-        while( pf < pfb_end )
-            *pf++ = ctx.fg;
-        ++y;
-    }
+/** draw a fg filled rectangle: */
+void gfx_fill_rect( unsigned int x, unsigned int y, unsigned int width, unsigned int height )
+{
+    gfx_fill_rect_col32(x, y, width, height, ctx.fg32);
 }
 
-/** TODO: */
+/** draw a bg filled rectangle: */
 void gfx_clear_rect( unsigned int x, unsigned int y, unsigned int width, unsigned int height )
 {
-    gfx_swap_fg_bg();
-    gfx_fill_rect(x,y,width,height);
-    gfx_swap_fg_bg();
+    gfx_fill_rect_col32(x, y, width, height, ctx.bg32);
 }
 
 /** Display a character at a position. The character is drawn using
@@ -450,51 +892,301 @@ void gfx_putc_NORMAL( unsigned int row, unsigned int col, unsigned char c )
     const unsigned int pixcol = col * ctx.term.FONTWIDTH;
     const unsigned int pixrow = row * ctx.term.FONTHEIGHT;
 
-    if (ctx.term.FONTWIDTH == 8)
+    GFX_STAT_ADD(glyphs, 1);
+    GFX_STAT_ADD(fb_written, ctx.term.FONTWIDTH * ctx.term.FONTHEIGHT * ctx.Bpp);
+    GFX_STAT_ADD(fb_write_runs, ctx.term.FONTHEIGHT);
+    gfx_dma_sync_range(PFB(pixcol, pixrow), PFB(pixcol + ctx.term.FONTWIDTH, pixrow + ctx.term.FONTHEIGHT - 1));
+
+    const unsigned char* p_glyph = ctx.term.font_getglyph(c);
+    if (ctx.term.FONTFORMAT == FONT_FORMAT_PACKED1)
+        ctx.depth->blend_packed(PFB(pixcol, pixrow), ctx.Pitch, p_glyph, ctx.term.FONTWIDTH, ctx.term.FONTHEIGHT, ctx.fg32, ctx.bg32);
+    else
+        ctx.depth->blend_bytes(PFB(pixcol, pixrow), ctx.Pitch, p_glyph, ctx.term.FONTWIDTH, ctx.term.FONTHEIGHT, ctx.fg32, ctx.bg32);
+}
+
+/** Body of the width specialized kernels for packed fonts. W is a constant in
+ *  every caller, so the line loop has a fixed number of byte loads and stores
+ *  and no per pixel branches: 32-bit stores when W is a multiple of 4, 16-bit
+ *  stores when it is even. Unlike gfx_putc_NORMAL() the glyph address is
+ *  computed here instead of calling font_getglyph. With NEON the lines are
+ *  drawn by glyph_blend_packed(), 8 or 16 pixels per instruction.
+ */
+static inline __attribute__((always_inline)) void gfx_putc_packed( unsigned int row, unsigned int col, unsigned char c, const unsigned int W )
+{
+    if( col >= ctx.term.WIDTH )
+        return;
+    if( row >= ctx.term.HEIGHT )
+        return;
+
+    const unsigned int ROWBYTES = (W + 7) / 8;
+    const unsigned int pixcol = col * W;
+    const unsigned int pixrow = row * ctx.term.FONTHEIGHT;
+    unsigned int h = ctx.term.FONTHEIGHT;
+
+    GFX_STAT_ADD(glyphs, 1);
+    GFX_STAT_ADD(fb_written, W * h);
+    GFX_STAT_ADD(fb_write_runs, h);
+    gfx_dma_sync_range(PFB(pixcol, pixrow), PFB(pixcol + W, pixrow + h - 1));
+
+    const unsigned char* p_glyph = ctx.term.FONT + c * ROWBYTES * h;
+    const unsigned int FG = ctx.fg32;
+    const unsigned int BG = ctx.bg32;
+    unsigned char* pf = PFB(pixcol, pixrow);
+#if defined(GLYPH_BLEND_NEON)
+    glyph_blend_packed(pf, ctx.Pitch, p_glyph, W, h, FG, BG);
+#else
+    const unsigned int pitch = ctx.Pitch;
+    while (h--)
+    {
+        // glyph line left aligned in 32 bits
+        unsigned int bits = 0;
+        for (unsigned int i = 0; i < ROWBYTES; i++)
+            bits |= (unsigned int)p_glyph[i] << (24 - 8 * i);
+        p_glyph += ROWBYTES;
+
+        if ((W & 3) == 0)
+        {
+            unsigned int* p32 = (unsigned int*)pf;
+            for (unsigned int i = 0; i < W / 4; i++)
+                p32[i] = glyph_select4(glyph_nibble_mask[(bits >> (28 - 4 * i)) & 0x0F], FG, BG);
+        }
+        else if ((W & 1) == 0)
+        {
+            unsigned short* p16 = (unsigned short*)pf;
+            for (unsigned int i = 0; i < W / 2; i++)
+                p16[i] = glyph_select4(glyph_pair_mask[(bits >> (30 - 2 * i)) & 0x03], FG, BG);
+        }
+        else
+        {
+            for (unsigned int i = 0; i < W; i++)
+                pf[i] = glyph_select4(-((bits >> (31 - i)) & 1), FG, BG);
+        }
+        pf += pitch;
+    }
+#endif
+}
+
+#define GFX_PUTC_PACKED_KERNEL(W) \
+    static void gfx_putc_packed_##W( unsigned int row, unsigned int col, unsigned char c ) \
+    { \
+        gfx_putc_packed(row, col, c, W); \
+    }
+
+GFX_PUTC_PACKED_KERNEL(8)
+GFX_PUTC_PACKED_KERNEL(10)
+GFX_PUTC_PACKED_KERNEL(12)
+GFX_PUTC_PACKED_KERNEL(16)
+GFX_PUTC_PACKED_KERNEL(32)
+
+/** Hash bucket of a glyph cache key. */
+static inline unsigned int gfx_glyph_cache_bucket( unsigned int key )
+{
+    return ((key * 0x9E3779B1u) >> 16) & ctx.glyph_cache.bucket_mask;
+}
+
+/** Drops all colored glyphs, see gfx.h. */
+void gfx_glyph_cache_invalidate()
+{
+    const unsigned int n = ctx.glyph_cache.count;
+    if (n == 0)
+        return;
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        ctx.glyph_cache.entries[i].key = 0;
+        ctx.glyph_cache.entries[i].prev = i ? i - 1 : GLYPH_CACHE_NONE;
+        ctx.glyph_cache.entries[i].next = (i + 1 < n) ? i + 1 : GLYPH_CACHE_NONE;
+        ctx.glyph_cache.entries[i].chain = GLYPH_CACHE_NONE;
+    }
+    for (unsigned int i = 0; i <= ctx.glyph_cache.bucket_mask; i++)
+        ctx.glyph_cache.buckets[i] = GLYPH_CACHE_NONE;
+    ctx.glyph_cache.lru_first = 0;
+    ctx.glyph_cache.lru_last = n - 1;
+}
+
+/** Releases the glyph cache buffers, the cache is off afterwards. */
+static void gfx_glyph_cache_free()
+{
+    if (ctx.glyph_cache.pixels) nmalloc_free(ctx.glyph_cache.pixels);
+    if (ctx.glyph_cache.entries) nmalloc_free(ctx.glyph_cache.entries);
+    if (ctx.glyph_cache.buckets) nmalloc_free(ctx.glyph_cache.buckets);
+    ctx.glyph_cache.pixels = 0;
+    ctx.glyph_cache.entries = 0;
+    ctx.glyph_cache.buckets = 0;
+    ctx.glyph_cache.count = 0;
+}
+
+/** Sizes the glyph cache for the current font, PiVT100Config.glyphCacheSize
+ *  entries in normal (cached) RAM. The cache stays off if that is 0 or the
+ *  heap is too small.
+ */
+static void gfx_glyph_cache_alloc()
+{
+    gfx_glyph_cache_free();
+
+    const unsigned int n = MIN(PiVT100Config.glyphCacheSize, GLYPH_CACHE_NONE);
+    if (n == 0 || ctx.term.FONTWIDTH == 0)
+        return;
+    unsigned int buckets = 1;
+    while (buckets < n)
+        buckets <<= 1;
+
+    ctx.glyph_cache.pixels = (unsigned char*)nmalloc_malloc(n * ctx.term.FONTWIDTH * ctx.term.FONTHEIGHT * ctx.Bpp);
+    ctx.glyph_cache.entries = (GLYPH_CACHE_ENTRY*)nmalloc_malloc(n * sizeof(GLYPH_CACHE_ENTRY));
+    ctx.glyph_cache.buckets = (unsigned short*)nmalloc_malloc(buckets * sizeof(unsigned short));
+    if (!ctx.glyph_cache.pixels || !ctx.glyph_cache.entries || !ctx.glyph_cache.buckets)
+    {
+        gfx_glyph_cache_free();
+        return;
+    }
+    ctx.glyph_cache.count = n;
+    ctx.glyph_cache.bucket_mask = buckets - 1;
+    gfx_glyph_cache_invalidate();
+}
+
+/** Returns the pixels of glyph c in the current colors. On a miss the least
+ *  recently used entry is drawn with them. The key holds the colors after
+ *  the reverse attribute is applied, so attribute changes need no flush.
+ */
+static const unsigned char* gfx_glyph_cache_lookup( unsigned char c )
+{
+    GLYPH_CACHE_ENTRY* entries = ctx.glyph_cache.entries;
+    const unsigned int line_bytes = ctx.term.FONTWIDTH * ctx.Bpp;
+    const unsigned int glyph_bytes = line_bytes * ctx.term.FONTHEIGHT;
+    const unsigned int key = GLYPH_CACHE_KEY(c, ctx.fg, ctx.bg);
+    const unsigned int bucket = gfx_glyph_cache_bucket(key);
+
+    unsigned int i = ctx.glyph_cache.buckets[bucket];
+    while (i != GLYPH_CACHE_NONE && entries[i].key != key)
+        i = entries[i].chain;
+
+    if (i != GLYPH_CACHE_NONE)
+    {
+        ctx.glyph_cache.hits++;
+    }
+    else
+    {
+        ctx.glyph_cache.misses++;
+        i = ctx.glyph_cache.lru_last;
+        if (entries[i].key)
+        {
+            // take the entry out of the chain of its old key
+            unsigned short* link = &ctx.glyph_cache.buckets[gfx_glyph_cache_bucket(entries[i].key)];
+            while (*link != i)
+                link = &entries[*link].chain;
+            *link = entries[i].chain;
+        }
+        entries[i].key = key;
+        entries[i].chain = ctx.glyph_cache.buckets[bucket];
+        ctx.glyph_cache.buckets[bucket] = i;
+
+        unsigned char* pixels = ctx.glyph_cache.pixels + i * glyph_bytes;
+        const unsigned char* p_glyph = ctx.term.font_getglyph(c);
+        if (ctx.term.FONTFORMAT == FONT_FORMAT_PACKED1)
+            ctx.depth->blend_packed(pixels, line_bytes, p_glyph, ctx.term.FONTWIDTH, ctx.term.FONTHEIGHT, ctx.fg32, ctx.bg32);
+        else
+            ctx.depth->blend_bytes(pixels, line_bytes, p_glyph, ctx.term.FONTWIDTH, ctx.term.FONTHEIGHT, ctx.fg32, ctx.bg32);
+    }
+
+    // move to the front of the LRU list
+    if (i != ctx.glyph_cache.lru_first)
+    {
+        GLYPH_CACHE_ENTRY* e = &entries[i];
+        entries[e->prev].next = e->next;
+        if (e->next != GLYPH_CACHE_NONE)
+            entries[e->next].prev = e->prev;
+        else
+            ctx.glyph_cache.lru_last = e->prev;
+        e->prev = GLYPH_CACHE_NONE;
+        e->next = ctx.glyph_cache.lru_first;
+        entries[ctx.glyph_cache.lru_first].prev = i;
+        ctx.glyph_cache.lru_first = i;
+    }
+    return ctx.glyph_cache.pixels + i * glyph_bytes;
+}
+
+/** Body of the glyph cache kernels: displays a character through the colored
+ *  glyph cache. A hit is a plain copy of the cached pixels, 32-bit words when
+ *  font width and pitch allow. A single glyph is too small to be worth a DMA
+ *  control block. As for gfx_putc_packed() W, the font width, and B, the bytes
+ *  per pixel, are constants in the callers except gfx_putc_CACHED().
+ */
+static inline __attribute__((always_inline)) void gfx_putc_cached( unsigned int row, unsigned int col, unsigned char c,
+                                                                   const unsigned int W, const unsigned int B )
+{
+    if( col >= ctx.term.WIDTH )
+        return;
+    if( row >= ctx.term.HEIGHT )
+        return;
+
+    const unsigned int pixcol = col * W;
+    const unsigned int pixrow = row * ctx.term.FONTHEIGHT;
+    unsigned int h = ctx.term.FONTHEIGHT;
+
+    const unsigned int bytes = W * B;
+    GFX_STAT_ADD(glyphs, 1);
+    GFX_STAT_ADD(fb_written, bytes * h);
+    GFX_STAT_ADD(fb_write_runs, h);
+    gfx_dma_sync_range(PFB(pixcol, pixrow), PFB(pixcol + W, pixrow + h - 1));
+
+    const unsigned char* src = gfx_glyph_cache_lookup(c);
+    unsigned char* dst = PFB(pixcol, pixrow);
+    const unsigned int pitch = ctx.Pitch;
+    const unsigned int align = bytes | pitch | (unsigned int)dst | (unsigned int)src;
+
+    if ((align & 3) == 0)
     {
-        // optimized original code drawing 4 pixels at once using 32-bit ints
-        const unsigned int FG = ctx.fg32;
-        const unsigned int BG = ctx.bg32;
-        const unsigned int int_stride = (ctx.Pitch>>2) - 2; // 2 ints = 8 pixels = 1 character
-        register unsigned int* p_glyph = (unsigned int*)ctx.term.font_getglyph(c);
-        register unsigned char h = ctx.term.FONTHEIGHT;
-        register unsigned int* pf = (unsigned int*)PFB(pixcol, pixrow);
-        while(h--)
+        while (h--)
         {
-            // Loop unrolled for 8xH fonts
-            register unsigned int gv = *p_glyph++;
-            // Each byte is 00 for background pixel or FF for foreground pixel
-            *pf++ =  (gv & FG) | ( ~gv & BG );
-            gv = *p_glyph++;
-            *pf++ =  (gv & FG) | ( ~gv & BG );
-            pf += int_stride;
+            const unsigned int* s32 = (const unsigned int*)src;
+            unsigned int* d32 = (unsigned int*)dst;
+            for (unsigned int i = 0; i < bytes / 4; i++)
+                d32[i] = s32[i];
+            src += bytes;
+            dst += pitch;
+        }
+    }
+    else if ((align & 1) == 0)
+    {
+        while (h--)
+        {
+            const unsigned short* s16 = (const unsigned short*)src;
+            unsigned short* d16 = (unsigned short*)dst;
+            for (unsigned int i = 0; i < bytes / 2; i++)
+                d16[i] = s16[i];
+            src += bytes;
+            dst += pitch;
         }
     }
     else
     {
-        // number of bytes to next line start position in framebuffer
-        const unsigned int byte_stride = ctx.Pitch - ctx.term.FONTWIDTH;
-        // address of character in font
-        register unsigned char* p_glyph = (unsigned char*)ctx.term.font_getglyph(c);
-        // copy from font to framebuffer for each font line
-        register unsigned char h = ctx.term.FONTHEIGHT;
-        register unsigned char* pf = (unsigned char*)PFB(pixcol, pixrow);
-        while( h-- )
+        while (h--)
         {
-            unsigned int w = ctx.term.FONTWIDTH;
-            while( w-- )
-            {
-                register unsigned char gv = *p_glyph++;	// get 1 pixel of font glyph
-                if (gv)
-                    *pf++ = ctx.fg;
-                else
-                    *pf++ = ctx.bg;
-            }
-            pf += byte_stride;
+            for (unsigned int i = 0; i < bytes; i++)
+                dst[i] = src[i];
+            src += bytes;
+            dst += pitch;
         }
     }
 }
 
+#define GFX_PUTC_CACHED_KERNEL(W) \
+    static void gfx_putc_cached_##W( unsigned int row, unsigned int col, unsigned char c ) \
+    { \
+        gfx_putc_cached(row, col, c, W, 1); \
+    }
+
+GFX_PUTC_CACHED_KERNEL(8)
+GFX_PUTC_CACHED_KERNEL(10)
+GFX_PUTC_CACHED_KERNEL(12)
+GFX_PUTC_CACHED_KERNEL(16)
+
+/** Glyph cache kernel for all other font widths and depths. */
+static void gfx_putc_CACHED( unsigned int row, unsigned int col, unsigned char c )
+{
+    gfx_putc_cached(row, col, c, ctx.term.FONTWIDTH, ctx.Bpp);
+}
+
 /** Displays a character in current drawing mode. Characters with codes from 0 to 31
  *  are displayed using current font and don't have any control effect.
  *	@param row the character line number (0 = top screen)
@@ -510,158 +1202,566 @@ void gfx_set_drawing_mode( DRAWING_MODE mode )
 {
     ctx.mode = mode;
     // Only normal mode is supported for VT100 compatibility
+    gfx_select_putc();
+}
+
+/** Installs the glyph kernel for the current font in gfx_putc. With the glyph
+ *  cache on this is a gfx_putc_cached() kernel, otherwise packed fonts of
+ *  width 8, 10, 12, 16 and 32 get a specialized kernel, all others
+ *  gfx_putc_NORMAL(). The specialized kernels are for 8 bpp, other depths
+ *  take gfx_putc_CACHED() or gfx_putc_NORMAL() with the kernels of their
+ *  back-end. Called whenever the font changes.
+ */
+static void gfx_select_putc()
+{
     gfx_putc = gfx_putc_NORMAL;
+    if (ctx.glyph_cache.count)
+    {
+        switch (ctx.Bpp == 1 ? ctx.term.FONTWIDTH : 0)
+        {
+            case 8:  gfx_putc = gfx_putc_cached_8;  break;
+            case 10: gfx_putc = gfx_putc_cached_10; break;
+            case 12: gfx_putc = gfx_putc_cached_12; break;
+            case 16: gfx_putc = gfx_putc_cached_16; break;
+            default: gfx_putc = gfx_putc_CACHED;    break;
+        }
+        return;
+    }
+    if (ctx.term.FONTFORMAT != FONT_FORMAT_PACKED1 || ctx.Bpp != 1)
+        return;
+
+    switch (ctx.term.FONTWIDTH)
+    {
+        case 8:  gfx_putc = gfx_putc_packed_8;  break;
+        case 10: gfx_putc = gfx_putc_packed_10; break;
+        case 12: gfx_putc = gfx_putc_packed_12; break;
+        case 16: gfx_putc = gfx_putc_packed_16; break;
+        case 32: gfx_putc = gfx_putc_packed_32; break;
+        default: break;
+    }
 }
 
-/** Restore saved content under cursor.
- *
+/** Draws the glyph of cursor_cell where the cursor is painted, in the colors fg on bg. */
+static void gfx_term_draw_cursor_cell( GFX_COL fg, GFX_COL bg )
+{
+    const GFX_COL old_fg = ctx.fg;
+    const GFX_COL old_bg = ctx.bg;
+    gfx_page_damage(ctx.term.cursor_drawn_pos[1] * ctx.term.FONTWIDTH, ctx.term.cursor_drawn_pos[0] * ctx.term.FONTHEIGHT,
+                    ctx.term.FONTWIDTH, ctx.term.FONTHEIGHT);
+    gfx_set_fg(fg);
+    gfx_set_bg(bg);
+    gfx_putc(ctx.term.cursor_drawn_pos[0], ctx.term.cursor_drawn_pos[1], (unsigned char)ctx.term.cursor_cell.glyph);
+    gfx_set_fg(old_fg);
+    gfx_set_bg(old_bg);
+}
+
+/** Removes the cursor: the cell it covers is drawn again in its own colors.
+ *  The cell is taken from the copy made by gfx_term_render_cursor(), the
+ *  grid may have scrolled since while the pixels have not. Does nothing if
+ *  the cursor is not on screen.
  */
 void gfx_restore_cursor_content()
 {
-    if (!ctx.cursor_buffer_ready) return;
+    if (!ctx.term.cursor_drawn) return;
 
-    unsigned char* pb = ctx.cursor_buffer;
-    unsigned char* pfb = (unsigned char*)PFB( ctx.term.cursor_col * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT );
-    const unsigned int byte_stride = ctx.Pitch - ctx.term.FONTWIDTH;
-    unsigned int h = ctx.term.FONTHEIGHT;
-    while(h--)
+    ctx.term.cursor_drawn = 0;
+    gfx_term_draw_cursor_cell(ctx.term.cursor_cell.fg, ctx.term.cursor_cell.bg);
+}
+
+/** Paints the cursor by drawing the cell under it with foreground and
+    background swapped, nothing is read back from the framebuffer.
+    A cursor painted somewhere else is removed first. While a batch is processed
+    (see gfx_term_write()) the cursor stays lifted and is drawn by gfx_term_flush().
+*/
+void gfx_term_render_cursor()
+{
+    gfx_restore_cursor_content();
+
+    if( ctx.term.cursor_hold || !ctx.term.cursor_visible )
+        return;
+
+    if( ctx.term.cursor_row >= ctx.term.HEIGHT || ctx.term.cursor_col >= ctx.term.WIDTH )
+        return;
+
+    // a dirty cell drawn later would paint over the cursor
+    gfx_term_render_dirty();
+
+    ctx.term.cursor_cell = gfx_term_cell_row(ctx.term.cursor_row)[ctx.term.cursor_col];
+    ctx.term.cursor_drawn = 1;
+    ctx.term.cursor_drawn_pos[0] = ctx.term.cursor_row;
+    ctx.term.cursor_drawn_pos[1] = ctx.term.cursor_col;
+    gfx_term_draw_cursor_cell(ctx.term.cursor_cell.bg, ctx.term.cursor_cell.fg);
+    GFX_STAT_ADD(cursor_draws, 1);
+}
+
+/** Lifts the cursor and keeps it hidden until gfx_term_flush() is called. */
+void gfx_term_hold_cursor()
+{
+    gfx_restore_cursor_content();
+    ctx.term.cursor_hold = 1;
+}
+
+/** Ends a batch started by gfx_term_write(): draws the changed cells and the cursor once.
+ *  With page flipping the back page is shown afterwards. */
+void gfx_term_flush()
+{
+    gfx_term_render_dirty();
+    if (ctx.term.cursor_hold)
     {
-        unsigned int w = ctx.term.FONTWIDTH;
-        while (w--)
-        {
-            *pfb++ = *pb++;
-        }
-        pfb += byte_stride;
+        ctx.term.cursor_hold = 0;
+        gfx_term_render_cursor();
     }
+    gfx_page_flip();
+}
 
-    //cout("cursor restored");cout_d(ctx.term.cursor_row);cout("-");cout_d(ctx.term.cursor_col);cout_endl();
+/** Draws the cells of one screen row from column first to last with gfx_putc. */
+static void gfx_term_draw_cells( unsigned int row, unsigned int first, unsigned int last )
+{
+    const GFX_CELL* cell = gfx_term_cell_row(row) + first;
+    for (unsigned int col = first; col <= last; col++, cell++)
+    {
+        if (cell->fg != ctx.fg) gfx_set_fg(cell->fg);
+        if (cell->bg != ctx.bg) gfx_set_bg(cell->bg);
+        gfx_putc(row, col, (unsigned char)cell->glyph);
+    }
 }
 
-/** Saves framebuffer content in the cursor bufffer so t can be restored later. */
-void gfx_term_save_cursor_content()
+/** Releases the row buffers of the compositor, which is off afterwards. */
+static void gfx_compose_free()
 {
-    unsigned char* pb = ctx.cursor_buffer;
-    unsigned char* pfb = (unsigned char*)PFB(
-    ctx.term.cursor_col * ctx.term.FONTWIDTH,
-    ctx.term.cursor_row * ctx.term.FONTHEIGHT );
-    const unsigned int byte_stride = ctx.Pitch - ctx.term.FONTWIDTH;//$$ adjust if not 8 width?
-    unsigned int h = ctx.term.FONTHEIGHT;
-    while(h--)
+    gfx_dma_sync();
+    for (unsigned int i = 0; i < 2; i++)
     {
-        int w = ctx.term.FONTWIDTH;
-        while (w--)
+        if (ctx.compose.buffer[i]) nmalloc_free(ctx.compose.buffer[i]);
+        ctx.compose.buffer[i] = 0;
+        ctx.compose.fence[i] = 0;
+    }
+    ctx.compose.next = 0;
+}
+
+/** Allocates the two row buffers of the compositor for the current font if
+ *  PiVT100Config.rowCompositor is set. While DMA flushes one buffer the next
+ *  row is drawn into the other.
+ */
+static void gfx_compose_alloc()
+{
+    gfx_compose_free();
+    if (!PiVT100Config.rowCompositor || ctx.W == 0)
+        return;
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        ctx.compose.buffer[i] = (unsigned char*)nmalloc_malloc(ctx.W * ctx.Bpp * ctx.term.FONTHEIGHT);
+        if (!ctx.compose.buffer[i])
         {
-            *pb++ = *pfb++;
+            gfx_compose_free();
+            return;
         }
-        pfb += byte_stride;
     }
-    ctx.cursor_buffer_ready = 1;
 }
 
-/** Saves framebuffer content that is going to be replaced by the cursor and update
-    the new content.
-*/
-void gfx_term_render_cursor()
+/** Copies n bytes of a framebuffer line, 16 bytes per loop (LDM/STM) once the
+ *  destination is word aligned. src must have the same alignment as dst.
+ */
+static void gfx_copy_line( unsigned char* dst, const unsigned char* src, unsigned int n )
 {
+    while (n && ((unsigned int)dst & 3))
+    {
+        *dst++ = *src++;
+        n--;
+    }
+    unsigned int* d32 = (unsigned int*)dst;
+    const unsigned int* s32 = (const unsigned int*)src;
+    for (; n >= 16; n -= 16, d32 += 4, s32 += 4)
+    {
+        const unsigned int a = s32[0], b = s32[1], c = s32[2], d = s32[3];
+        d32[0] = a; d32[1] = b; d32[2] = c; d32[3] = d;
+    }
+    for (; n >= 4; n -= 4)
+        *d32++ = *s32++;
+    dst = (unsigned char*)d32;
+    src = (const unsigned char*)s32;
+    while (n--)
+        *dst++ = *src++;
+}
 
-    unsigned char* pb = ctx.cursor_buffer;
-    //cout("pb: "); cout_h((unsigned int)pb);cout_endl();
-    unsigned char* pfb = (unsigned char*)PFB(
-            ctx.term.cursor_col * ctx.term.FONTWIDTH,
-            ctx.term.cursor_row * ctx.term.FONTHEIGHT );
-    //cout("pfb: "); cout_h((unsigned int)pfb);cout_endl();
-    const unsigned int byte_stride = ctx.Pitch - ctx.term.FONTWIDTH;//$$ adjust if not 8 width?
-    //cout("byte_stride: "); cout_d(byte_stride);  cout(" pitch: "); cout_d(ctx.Pitch); cout(" FONTWIDTH: "); cout_d(ctx.term.FONTWIDTH);cout_endl();
+/** Row compositor: draws the cells of one text row into a row buffer in
+ *  cached RAM, then copies the span to the framebuffer at once, with one 2D
+ *  DMA transfer or line by line with 16 byte CPU bursts. Each glyph line
+ *  would otherwise be a short store of its own, spread over FONTHEIGHT
+ *  framebuffer lines. The glyph kernels are pointed at the buffer by
+ *  swapping ctx.pfb and ctx.Pitch, so PFB() of this text row lands in it.
+ */
+static void gfx_term_compose_row( unsigned int row, unsigned int first, unsigned int last )
+{
+    const unsigned int b = ctx.compose.next;
+    unsigned char* const buffer = ctx.compose.buffer[b];
     unsigned int h = ctx.term.FONTHEIGHT;
-    //cout("h: "); cout_d(h);cout_endl();
+    const unsigned int pixrow = row * h;
+    const unsigned int x = first * ctx.term.FONTWIDTH;
+    const unsigned int width = (last - first + 1) * ctx.term.FONTWIDTH * ctx.Bpp;
+    const unsigned int line_bytes = ctx.W * ctx.Bpp;
+    ctx.compose.next = b ^ 1;
+
+    // the flush two rows ago may still read this buffer
+    if (ctx.compose.fence[b])
+    {
+        dma_wait(ctx.compose.fence[b]);
+        ctx.compose.fence[b] = 0;
+    }
+
+    unsigned char* const pfb = ctx.pfb;
+    const unsigned int pitch = ctx.Pitch;
+#if ENABLED(GFX_STATISTICS)
+    const unsigned long long fb_written = stats.fb_written;
+    const unsigned long long fb_write_runs = stats.fb_write_runs;
+#endif
+    ctx.pfb = buffer - pixrow * line_bytes;
+    ctx.Pitch = line_bytes;
+    gfx_term_draw_cells(row, first, last);
+    ctx.pfb = pfb;
+    ctx.Pitch = pitch;
+#if ENABLED(GFX_STATISTICS)
+    // the glyphs went to the buffer, only the copy below reaches the framebuffer
+    stats.fb_written = fb_written;
+    stats.fb_write_runs = fb_write_runs;
+#endif
+    GFX_STAT_ADD(fb_written, width * h);
+    GFX_STAT_ADD(fb_write_runs, h);
+
+    unsigned char* dst = PFB(x, pixrow);
+    const unsigned char* src = buffer + x * ctx.Bpp;
+    if (!PiVT100Config.disableGfxDMA)
+    {
+        dma_clean_source(src, (h - 1) * line_bytes + width);
+        dma_copy_rect(dst, pitch, (void*)src, line_bytes, width, h);
+        gfx_dma_submit(dst, dst + h * pitch);
+        ctx.compose.fence[b] = ctx.dma_fence;
+        return;
+    }
+
+    gfx_dma_sync_range(dst, dst + h * pitch);
+    while (h--)
+    {
+        gfx_copy_line(dst, src, width);
+        dst += pitch;
+        src += line_bytes;
+    }
+}
+
+/** Draws the cells of one screen row from column first to last, through the
+ *  row compositor if it is on. */
+static void gfx_term_render_row( unsigned int row, unsigned int first, unsigned int last )
+{
+    gfx_page_damage(first * ctx.term.FONTWIDTH, row * ctx.term.FONTHEIGHT, (last - first + 1) * ctx.term.FONTWIDTH, ctx.term.FONTHEIGHT);
+    if (ctx.compose.buffer[0])
+        gfx_term_compose_row(row, first, last);
+    else
+        gfx_term_draw_cells(row, first, last);
+}
+
+/** Splits the virtual framebuffer into two pages if PiVT100Config.pageFlip is
+ *  set and it is at least two screens high. Each page pans through its half
+ *  by itself (gfx_scroll_down()); page 0 is shown first, drawing starts on page 1.
+ */
+static void gfx_page_alloc()
+{
+    if (!PiVT100Config.pageFlip || ctx.fb_lines < 2 * ctx.H)
+        return;
 
-    if( ctx.term.cursor_visible )
+    ctx.page.damage = (PAGE_SPAN*)nmalloc_malloc(ctx.H * sizeof(PAGE_SPAN));
+    if (!ctx.page.damage)
+        return;
+    pivt100_memset(ctx.page.damage, 0, ctx.H * sizeof(PAGE_SPAN));
+    ctx.fb_lines /= 2;
+    ctx.page.count = 2;
+    ctx.page.line[1] = ctx.fb_lines;
+    ctx.page.back = 1;
+    ctx.page.flip_time = time_microsec() - GFX_REFRESH_US;
+    ctx.pFirstFb += ctx.page.line[1] * ctx.Pitch;
+    ctx.pfb = ctx.pFirstFb;
+}
+
+/** Copies lines lines of width bytes from dst + delta lines to dst, from the
+ *  front page to the back page. */
+static void gfx_page_copy( unsigned char* dst, int delta, unsigned int width, unsigned int lines )
+{
+    const unsigned char* src = dst + delta * (int)ctx.Pitch;
+    GFX_STAT_ADD(page_copied, width * lines);
+    GFX_STAT_ADD(fb_read, width * lines);
+    GFX_STAT_ADD(fb_written, width * lines);
+    GFX_STAT_ADD(fb_write_runs, lines);
+
+    if (!PiVT100Config.disableGfxDMA)
+    {
+        dma_copy_rect(dst, ctx.Pitch, (void*)src, ctx.Pitch, width, lines);
+        gfx_dma_submit(dst, dst + lines * ctx.Pitch);
+        return;
+    }
+
+    gfx_dma_sync_range(dst, dst + lines * ctx.Pitch);
+    while (lines--)
+    {
+        gfx_copy_line(dst, src, width);
+        dst += ctx.Pitch;
+        src += ctx.Pitch;
+    }
+}
+
+/** Brings the back page up to the page shown by the last flip: it is scrolled
+ *  the same way and gets the pixels drawn on the other page, line spans of equal
+ *  width in one copy. The display keeps reading the back page until the flip
+ *  takes effect at the next vertical sync, which is waited for if it may not
+ *  have passed yet.
+ */
+static void gfx_page_catch_up()
+{
+    if (!ctx.page.catch_up) return;
+    ctx.page.catch_up = 0;
+
+    if (time_microsec() - ctx.page.flip_time < GFX_REFRESH_US && fb_wait_vsync() != FB_SUCCESS)
     {
-        while(h--)
+        while (time_microsec() - ctx.page.flip_time < GFX_REFRESH_US)
+            ;
+    }
+
+    ctx.page.replay = 1;
+    if (ctx.page.scroll)
+        gfx_scroll_down(ctx.page.scroll);
+    ctx.page.replay = 0;
+    ctx.page.scroll = 0;
+
+    const unsigned int front = ctx.page.back ^ 1;
+    const int delta = (int)(ctx.page.line[front] + ctx.page.yOffset[front]) - (int)(ctx.page.line[ctx.page.back] + ctx.fb_yOffset);
+    const unsigned int top = ctx.page.damage_top;
+    const unsigned int bottom = ctx.page.damage_bottom;
+    for (unsigned int y = top; y < bottom; )
+    {
+        const unsigned int x0 = ctx.page.damage[y].x0;
+        const unsigned int x1 = ctx.page.damage[y].x1;
+        unsigned int lines = 1;
+        while (y + lines < bottom && ctx.page.damage[y + lines].x0 == x0 && ctx.page.damage[y + lines].x1 == x1)
+            lines++;
+        if (x1 > x0)
+            gfx_page_copy(PFB(x0, y), delta, (x1 - x0) * ctx.Bpp, lines);
+        y += lines;
+    }
+    pivt100_memset(ctx.page.damage + top, 0, (bottom - top) * sizeof(PAGE_SPAN));
+    ctx.page.damage_top = ctx.page.damage_bottom = 0;
+}
+
+/** Records that pixels x to x+width-1 of lines y to y+height-1 are drawn on the
+ *  back page, to be copied to the other page after the next flip. Called before
+ *  drawing, as the back page has to catch up with the last flip first.
+ */
+static void gfx_page_damage( unsigned int x, unsigned int y, unsigned int width, unsigned int height )
+{
+    if (ctx.page.count < 2 || ctx.page.replay) return;
+    gfx_page_catch_up();
+    if (x >= ctx.W || y >= ctx.H || width == 0 || height == 0) return;
+
+    const unsigned int x1 = MIN(x + width, ctx.W);
+    const unsigned int y1 = MIN(y + height, ctx.H);
+    if (ctx.page.damage_top == ctx.page.damage_bottom)
+    {
+        ctx.page.damage_top = y;
+        ctx.page.damage_bottom = y1;
+    }
+    else
+    {
+        ctx.page.damage_top = MIN(ctx.page.damage_top, y);
+        ctx.page.damage_bottom = MAX(ctx.page.damage_bottom, y1);
+    }
+    for (; y < y1; y++)
+    {
+        PAGE_SPAN* span = &ctx.page.damage[y];
+        if (span->x1 == span->x0)
         {
-            unsigned int w = ctx.term.FONTWIDTH;
-            while (w--)
-            {
-                *pb = *pfb; // Save original pixel
-                if (*pfb == (ctx.fg32 & 0xFF))
-                {
-                    *pfb = ctx.bg32 & 0xFF;
-                }
-                else if (*pfb == (ctx.bg32 & 0xFF))
-                {
-                    *pfb = ctx.fg32 & 0xFF;
-                }
-                // else leave pixel unchanged
-                pb++;
-                pfb++;
-            }
-            pfb += byte_stride;
+            span->x0 = x;
+            span->x1 = x1;
+        }
+        else
+        {
+            if (x < span->x0) span->x0 = x;
+            if (x1 > span->x1) span->x1 = x1;
         }
-        ctx.cursor_buffer_ready = 1;
     }
-    else
+}
+
+/** Records that the back page content moves up by npixels lines, by panning.
+ *  The damage moves along and the lines coming in at the bottom are damaged.
+ */
+static void gfx_page_scroll( unsigned int npixels )
+{
+    if (ctx.page.count < 2 || ctx.page.replay || npixels == 0) return;
+    gfx_page_catch_up();
+
+    const unsigned int top = ctx.page.damage_top;
+    const unsigned int bottom = ctx.page.damage_bottom;
+    for (unsigned int y = MAX(top, npixels); y < bottom; y++)
+        ctx.page.damage[y - npixels] = ctx.page.damage[y];
+    // lines the damage moved away from
+    const unsigned int stale = MAX(top, bottom > npixels ? bottom - npixels : 0);
+    if (bottom > stale)
+        pivt100_memset(ctx.page.damage + stale, 0, (bottom - stale) * sizeof(PAGE_SPAN));
+
+    const unsigned int in = ctx.H - npixels;
+    ctx.page.damage_top = (bottom > npixels && top < bottom) ? (top > npixels ? top - npixels : 0) : in;
+    ctx.page.damage_bottom = ctx.H;
+    for (unsigned int y = in; y < ctx.H; y++)
     {
-        while(h--)
+        ctx.page.damage[y].x0 = 0;
+        ctx.page.damage[y].x1 = ctx.W;
+    }
+    ctx.page.scroll = MIN(ctx.page.scroll + npixels, ctx.H);
+}
+
+/** Shows the back page if anything was drawn on it since the last flip and
+ *  draws on the other page from then on. The new back page catches up when
+ *  it is drawn on the next time, see gfx_page_catch_up().
+ *  There is at most one flip per display refresh: before that the back page
+ *  stays hidden and collects more changes for a later gfx_term_flush().
+ */
+static void gfx_page_flip()
+{
+    if (ctx.page.count < 2 || ctx.page.catch_up) return;
+    if (ctx.page.damage_top == ctx.page.damage_bottom && ctx.page.scroll == 0) return;
+    if (time_microsec() - ctx.page.flip_time < GFX_REFRESH_US) return;
+
+    // the page is shown complete
+    gfx_dma_sync();
+    const unsigned int shown = ctx.page.back;
+    ctx.page.yOffset[shown] = ctx.fb_yOffset;
+    if (!overlay.open)
+        fb_switch_framebuffer(ctx.page.line[shown] + ctx.fb_yOffset);
+    ctx.page.flip_time = time_microsec();
+    GFX_STAT_ADD(page_flips, 1);
+
+    ctx.page.back = shown ^ 1;
+    ctx.pFirstFb += ((int)ctx.page.line[ctx.page.back] - (int)ctx.page.line[shown]) * (int)ctx.Pitch;
+    ctx.fb_yOffset = ctx.page.yOffset[ctx.page.back];
+    ctx.pfb = ctx.pFirstFb + ctx.fb_yOffset * ctx.Pitch;
+    ctx.page.catch_up = 1;
+}
+
+/** Draws all cells changed since the last call.
+ *  Rows without dirty bit are skipped, dirty rows are drawn only between
+ *  their first and last changed column.
+ */
+void gfx_term_render_dirty()
+{
+    gfx_term_apply_scroll();
+    if (!ctx.term.dirty) return;
+
+    // a dirty cell under the cursor paints over it, no need to draw the cell twice
+    const unsigned int crow = ctx.term.cursor_drawn_pos[0];
+    const unsigned int ccol = ctx.term.cursor_drawn_pos[1];
+    if (ctx.term.cursor_drawn && (ctx.term.dirty_rows[crow >> 5] & (1u << (crow & 31))) &&
+        ccol >= ctx.term.dirty_span[crow].first && ccol <= ctx.term.dirty_span[crow].last)
+        ctx.term.cursor_drawn = 0;
+
+    const GFX_COL fg = ctx.fg;
+    const GFX_COL bg = ctx.bg;
+    const unsigned int words = (ctx.term.HEIGHT + 31) / 32;
+    for (unsigned int i = 0; i < words; i++)
+    {
+        unsigned int bits = ctx.term.dirty_rows[i];
+        ctx.term.dirty_rows[i] = 0;
+        while (bits)
         {
-            unsigned int w = ctx.term.FONTWIDTH;
-            while (w--)
-            {
-                *pfb = *pb++; // Restore original pixel
-                pfb++;
-            }
-            pfb += byte_stride;
+            const unsigned int row = i * 32 + __builtin_ctz(bits);
+            bits &= bits - 1;
+            gfx_term_render_row(row, ctx.term.dirty_span[row].first, ctx.term.dirty_span[row].last);
         }
-        ctx.cursor_buffer_ready = 1;
     }
+    ctx.term.dirty = 0;
+    gfx_set_fg(fg);
+    gfx_set_bg(bg);
+}
+
+/** Clears the framebuffer and draws every cell again. */
+void gfx_term_redraw()
+{
+    if (ctx.pfb == 0) return;
+
+    gfx_restore_cursor_content();
+    ctx.term.scroll_pending = 0;    // everything is drawn again anyway
+    gfx_clear();
+    gfx_term_mark_all_dirty();
+    gfx_term_render_dirty();
+    gfx_term_render_cursor();
+}
+
+/** Returns the cells of a screen row, WIDTH entries. */
+const GFX_CELL* gfx_term_get_cells( unsigned int row )
+{
+    if (row >= ctx.term.HEIGHT) return 0;
+    return gfx_term_cell_row(row);
 }
 
 /** shifts content from cursor 1 character to the right */
 void gfx_term_shift_right()
 {
+    GFX_STAT_ADD(fb_read, (ctx.term.WIDTH-ctx.term.cursor_col-1) * ctx.term.FONTWIDTH * ctx.term.FONTHEIGHT * ctx.Bpp);
+    GFX_STAT_ADD(fb_written, (ctx.term.WIDTH-ctx.term.cursor_col-1) * ctx.term.FONTWIDTH * ctx.term.FONTHEIGHT * ctx.Bpp);
+    GFX_STAT_ADD(fb_write_runs, ctx.term.FONTHEIGHT);
+    unsigned char* const text_row = PFB(0, ctx.term.cursor_row * ctx.term.FONTHEIGHT);
+    gfx_page_damage(0, ctx.term.cursor_row * ctx.term.FONTHEIGHT, ctx.W, ctx.term.FONTHEIGHT);
     if (PiVT100Config.disableGfxDMA)
     {
+        gfx_dma_sync_range(text_row, text_row + ctx.term.FONTHEIGHT * ctx.Pitch);
         for (unsigned int i=0; i<ctx.term.FONTHEIGHT; i++)
         {
-            unsigned int* src = (unsigned int*)PFB(ctx.W-4-ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT + i);
-            unsigned int* dst = (unsigned int*)PFB(ctx.W-4, ctx.term.cursor_row * ctx.term.FONTHEIGHT + i);
-            unsigned int* end = (unsigned int*)PFB(ctx.term.cursor_col * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT + i);
-            while (src >= end)
+            // words from the last one of the line, then the bytes left before them
+            unsigned int* src = (unsigned int*)PFB(ctx.W-ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT + i) - 1;
+            unsigned int* dst = (unsigned int*)PFB(ctx.W, ctx.term.cursor_row * ctx.term.FONTHEIGHT + i) - 1;
+            unsigned char* end = PFB(ctx.term.cursor_col * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT + i);
+            while ((unsigned char*)src >= end)
             {
                 *dst-- = *src--;
             }
+            unsigned char* src8 = (unsigned char*)(src + 1);
+            unsigned char* dst8 = (unsigned char*)(dst + 1);
+            while (src8 > end)
+            {
+                *--dst8 = *--src8;
+            }
         }
     }
     else
     {
-        dma_enqueue_operation( PFB((ctx.term.cursor_col) * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT),
-                            PFB((ctx.term.cursor_col+1) * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT),
-                            (((ctx.term.FONTHEIGHT-1) & 0xFFFF )<<16) | ((ctx.term.WIDTH-ctx.term.cursor_col-1)*ctx.term.FONTWIDTH & 0xFFFF ),
-                            ((((ctx.term.cursor_col+1)*ctx.term.FONTWIDTH) & 0xFFFF)<<16 | (((ctx.term.cursor_col+1)*ctx.term.FONTWIDTH) & 0xFFFF)), /* bits 31:16 destination stride, 15:0 source stride */
-                            DMA_TI_DEST_INC | DMA_TI_2DMODE | DMA_TI_SRC_INC );
-        dma_execute_queue();
+        // the row overlaps itself, dma_move_rect() takes care of the direction
+        dma_move_rect( PFB((ctx.term.cursor_col+1) * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT),
+                       PFB(ctx.term.cursor_col * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT),
+                       (ctx.term.WIDTH-ctx.term.cursor_col-1) * ctx.term.FONTWIDTH * ctx.Bpp, ctx.term.FONTHEIGHT, ctx.Pitch );
+        gfx_dma_submit(text_row, text_row + ctx.term.FONTHEIGHT * ctx.Pitch);
     }
 }
 
 /** shifts content right of cursor 1 character to the left */
 void gfx_term_shift_left()
 {
+    GFX_STAT_ADD(fb_read, (ctx.term.WIDTH-ctx.term.cursor_col-1) * ctx.term.FONTWIDTH * ctx.term.FONTHEIGHT * ctx.Bpp);
+    GFX_STAT_ADD(fb_written, (ctx.term.WIDTH-ctx.term.cursor_col-1) * ctx.term.FONTWIDTH * ctx.term.FONTHEIGHT * ctx.Bpp);
+    GFX_STAT_ADD(fb_write_runs, ctx.term.FONTHEIGHT);
+    unsigned char* const text_row = PFB(0, ctx.term.cursor_row * ctx.term.FONTHEIGHT);
+    gfx_page_damage(0, ctx.term.cursor_row * ctx.term.FONTHEIGHT, ctx.W, ctx.term.FONTHEIGHT);
     if (PiVT100Config.disableGfxDMA)
     {
+        gfx_dma_sync_range(text_row, text_row + ctx.term.FONTHEIGHT * ctx.Pitch);
         for (unsigned int i=0; i<ctx.term.FONTHEIGHT; i++)
         {
             veryfastmemcpy(PFB((ctx.term.cursor_col) * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT + i),
                            PFB((ctx.term.cursor_col+1) * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT + i),
-                           (ctx.term.WIDTH-ctx.term.cursor_col)*ctx.term.FONTWIDTH);
+                           (ctx.term.WIDTH-ctx.term.cursor_col)*ctx.term.FONTWIDTH*ctx.Bpp);
         }
     }
     else
     {
-        dma_enqueue_operation( PFB((ctx.term.cursor_col+1) * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT),
-                            PFB((ctx.term.cursor_col) * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT),
-                            (((ctx.term.FONTHEIGHT-1) & 0xFFFF )<<16) | ((ctx.term.WIDTH-ctx.term.cursor_col)*ctx.term.FONTWIDTH & 0xFFFF ),
-                            (((ctx.term.cursor_col*ctx.term.FONTWIDTH) & 0xFFFF)<<16 | ((ctx.term.cursor_col*ctx.term.FONTWIDTH) & 0xFFFF)), /* bits 31:16 destination stride, 15:0 source stride */
-                            DMA_TI_DEST_INC | DMA_TI_2DMODE | DMA_TI_SRC_INC );
-        dma_execute_queue();
+        dma_move_rect( PFB(ctx.term.cursor_col * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT),
+                       PFB((ctx.term.cursor_col+1) * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT),
+                       (ctx.term.WIDTH-ctx.term.cursor_col-1) * ctx.term.FONTWIDTH * ctx.Bpp, ctx.term.FONTHEIGHT, ctx.Pitch );
+        gfx_dma_submit(text_row, text_row + ctx.term.FONTHEIGHT * ctx.Pitch);
     }
 }
 
@@ -672,8 +1772,17 @@ void gfx_term_shift_left()
 void gfx_term_insert_blank()
 {
     gfx_restore_cursor_content();
+    gfx_term_render_dirty();
     gfx_term_shift_right();
     gfx_clear_rect( ctx.term.cursor_col * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT, ctx.term.FONTWIDTH, ctx.term.FONTHEIGHT );
+
+    GFX_CELL* cell = gfx_term_cell_row(ctx.term.cursor_row);
+    for (unsigned int col = ctx.term.WIDTH-1; col > ctx.term.cursor_col; col--)
+    {
+        cell[col] = cell[col-1];
+    }
+    gfx_term_blank_cells(ctx.term.cursor_row, ctx.term.cursor_col, ctx.term.cursor_col+1);
+
     gfx_term_render_cursor();
 }
 
@@ -682,85 +1791,190 @@ void gfx_term_insert_blank()
     restore cursor */
 void gfx_term_delete_char()
 {
+    gfx_restore_cursor_content();
+    gfx_term_render_dirty();
     if (ctx.term.cursor_col < (ctx.term.WIDTH-1))
     {
         gfx_term_shift_left();
     }
     gfx_clear_rect( (ctx.term.WIDTH-1) * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT, ctx.term.FONTWIDTH, ctx.term.FONTHEIGHT );
+
+    GFX_CELL* cell = gfx_term_cell_row(ctx.term.cursor_row);
+    for (unsigned int col = ctx.term.cursor_col; col < ctx.term.WIDTH-1; col++)
+    {
+        cell[col] = cell[col+1];
+    }
+    gfx_term_blank_cells(ctx.term.cursor_row, ctx.term.WIDTH-1, ctx.term.WIDTH);
+
     gfx_term_render_cursor();
 }
 
-/** Insert blank line at current row (shift screen down) */
-void gfx_term_insert_line()
+/** Moves the cells of rows top to bottom (inclusive) up by lines rows, blank rows come in
+ *  at the bottom. The dirty state moves along, so rows moving out of the region are never drawn.
+ *  For the whole screen only the top of the row ring moves.
+ */
+static void gfx_term_cells_up( unsigned int top, unsigned int bottom, unsigned int lines )
 {
-    unsigned int size = ctx.term.WIDTH*ctx.term.FONTWIDTH*ctx.term.FONTHEIGHT;
-
-    gfx_restore_cursor_content();
-
-    for(int i=ctx.term.HEIGHT-2;i>=(int)ctx.term.cursor_row; i--)
+    if (top == 0 && bottom == ctx.term.HEIGHT-1)
     {
-        if (PiVT100Config.disableGfxDMA)
+        ctx.term.cells_top += lines;
+        if (ctx.term.cells_top >= ctx.term.HEIGHT) ctx.term.cells_top -= ctx.term.HEIGHT;
+    }
+    else
+    {
+        for (unsigned int row = top; row + lines <= bottom; row++)
         {
-            veryfastmemcpy(PFB((0), (i+1) * ctx.term.FONTHEIGHT), PFB((0), i * ctx.term.FONTHEIGHT), size);
+            gfx_term_copy_cell_row(row, row + lines);
         }
-        else
+    }
+
+    if (ctx.term.dirty)
+    {
+        for (unsigned int row = top; row <= bottom; row++)
         {
-            dma_memcpy_32(PFB((0), i * ctx.term.FONTHEIGHT), PFB((0), (i+1) * ctx.term.FONTHEIGHT), size);
+            const unsigned int src = row + lines;
+            const unsigned int bit = 1u << (row & 31);
+            if (src <= bottom && (ctx.term.dirty_rows[src >> 5] & (1u << (src & 31))))
+            {
+                ctx.term.dirty_rows[row >> 5] |= bit;
+                ctx.term.dirty_span[row] = ctx.term.dirty_span[src];
+            }
+            else
+            {
+                ctx.term.dirty_rows[row >> 5] &= ~bit;
+            }
         }
     }
 
-    unsigned int* pos = (unsigned int*)PFB(0, ctx.term.cursor_row * ctx.term.FONTHEIGHT);
-    for(unsigned int i=0; i<size/4;i++)
-    {
-        *pos++=ctx.bg32;
-    }
+    for (unsigned int row = bottom + 1 - lines; row <= bottom; row++)
+    {
+        gfx_term_blank_cells(row, 0, ctx.term.WIDTH);
+    }
+}
+
+/** Moves the pixels of text rows top to bottom (inclusive) up by lines rows.
+ *  The whole screen is scrolled by panning the framebuffer.
+ */
+static void gfx_term_pixels_up( unsigned int top, unsigned int bottom, unsigned int lines )
+{
+    if (top == 0 && bottom == ctx.term.HEIGHT-1)
+        gfx_scroll_down(lines * ctx.term.FONTHEIGHT);
+    else
+        gfx_scroll_region_down(top * ctx.term.FONTHEIGHT, (bottom+1) * ctx.term.FONTHEIGHT, lines * ctx.term.FONTHEIGHT);
+}
+
+/** Moves text rows top to bottom (inclusive) up by lines rows right away, blank rows come in at the bottom. */
+static void gfx_term_rows_up( unsigned int top, unsigned int bottom, unsigned int lines )
+{
+    if (bottom >= ctx.term.HEIGHT || top > bottom || lines == 0) return;
+    if (lines > bottom - top + 1) lines = bottom - top + 1;
+
+    gfx_term_render_dirty();
+    gfx_term_pixels_up(top, bottom, lines);
+    gfx_term_cells_up(top, bottom, lines);
+}
+
+/** Moves text rows top to bottom (inclusive) down by lines rows, blank rows come in at the top. */
+static void gfx_term_rows_down( unsigned int top, unsigned int bottom, unsigned int lines )
+{
+    if (bottom >= ctx.term.HEIGHT || top > bottom || lines == 0) return;
+    if (lines > bottom - top + 1) lines = bottom - top + 1;
+
+    gfx_term_render_dirty();
+    gfx_scroll_region_up(top * ctx.term.FONTHEIGHT, (bottom+1) * ctx.term.FONTHEIGHT, lines * ctx.term.FONTHEIGHT);
+    for (unsigned int row = bottom; row >= top + lines; row--)
+    {
+        gfx_term_copy_cell_row(row, row - lines);
+    }
+    for (unsigned int row = top; row < top + lines; row++)
+    {
+        gfx_term_blank_cells(row, 0, ctx.term.WIDTH);
+    }
+}
+
+/** Insert blank line at current row (shift screen down).
+ *  Only the rows down to the bottom margin move; nothing happens outside the scrolling region.
+ */
+void gfx_term_insert_line()
+{
+    if (ctx.term.cursor_row < ctx.term.scroll_top || ctx.term.cursor_row > ctx.term.scroll_bottom)
+        return;
+
+    gfx_restore_cursor_content();
+    gfx_term_rows_down(ctx.term.cursor_row, ctx.term.scroll_bottom, 1);
+    gfx_term_render_cursor();
+}
+
+/** Delete the current line (shift screen up).
+ *  Only the rows down to the bottom margin move; nothing happens outside the scrolling region.
+ */
+void gfx_term_delete_line()
+{
+    if (ctx.term.cursor_row < ctx.term.scroll_top || ctx.term.cursor_row > ctx.term.scroll_bottom)
+        return;
 
+    gfx_restore_cursor_content();
+    gfx_term_rows_up(ctx.term.cursor_row, ctx.term.scroll_bottom, 1);
     gfx_term_render_cursor();
 }
 
-// Delete the current line (shift screen up)
-void gfx_term_delete_line()
+/** Moves the content of the scrolling region up by lines rows, blank rows come in at the bottom.
+ *  Only the cells are scrolled here. The framebuffer follows with a single scroll for all
+ *  pending rows in gfx_term_apply_scroll(), once something has to be drawn.
+ */
+void gfx_term_scroll_up( unsigned int lines )
 {
-    unsigned int size;
+    const unsigned int height = ctx.term.scroll_bottom - ctx.term.scroll_top + 1;
+    if (lines == 0) return;
+    if (lines > height) lines = height;
 
-    if (ctx.term.cursor_row < ctx.term.HEIGHT-2)
-    {
-        size = ctx.term.WIDTH*ctx.term.FONTWIDTH*ctx.term.FONTHEIGHT*(ctx.term.HEIGHT-1-ctx.term.cursor_row);
-        if (PiVT100Config.disableGfxDMA)
-        {
-            veryfastmemcpy(PFB((0), ctx.term.cursor_row * ctx.term.FONTHEIGHT), PFB((0), (ctx.term.cursor_row+1) * ctx.term.FONTHEIGHT), size);
-        }
-        else
-        {
-            dma_memcpy_32(PFB((0), (ctx.term.cursor_row+1) * ctx.term.FONTHEIGHT), PFB((0), ctx.term.cursor_row * ctx.term.FONTHEIGHT), size);
-        }
-    }
+    // the rows coming in are filled with one color per scroll
+    if (ctx.term.scroll_pending && ctx.term.scroll_pending_bg != ctx.bg)
+        gfx_term_apply_scroll();
 
-    unsigned int* pos = (unsigned int*)PFB(0, (ctx.term.HEIGHT-1) * ctx.term.FONTHEIGHT);
-    size = ctx.term.WIDTH*ctx.term.FONTWIDTH*ctx.term.FONTHEIGHT;
-    for(unsigned int i=0; i<size/4;i++)
-    {
-        *pos++=ctx.bg32;
-    }
+    gfx_term_cells_up(ctx.term.scroll_top, ctx.term.scroll_bottom, lines);
+    ctx.term.scroll_pending = MIN(ctx.term.scroll_pending + lines, height);
+    ctx.term.scroll_pending_bg = ctx.bg;
+}
 
-    gfx_term_render_cursor();
+/** Scrolls the framebuffer by the rows counted in gfx_term_scroll_up(). */
+static void gfx_term_apply_scroll()
+{
+    if (ctx.term.scroll_pending == 0) return;
+
+    const unsigned int lines = ctx.term.scroll_pending;
+    const GFX_COL bg = ctx.bg;
+    ctx.term.scroll_pending = 0;
+
+    gfx_restore_cursor_content();
+    gfx_set_bg(ctx.term.scroll_pending_bg);
+    gfx_term_pixels_up(ctx.term.scroll_top, ctx.term.scroll_bottom, lines);
+    gfx_set_bg(bg);
 }
 
-/** Fill cursor buffer with the current background and framebuffer with fg.
+/** Moves the cursor one row down. On the bottom margin the scrolling region
+ *  scrolls instead, below the region the cursor stops at the last row.
  */
-void gfx_term_render_cursor_newline()
+void gfx_term_line_feed()
 {
-    //
-    const unsigned int BG = ctx.bg32; // 4 pixels
-    unsigned int nwords = ctx.cursor_buffer_size / 4;
-    unsigned int* pb = (unsigned int*)ctx.cursor_buffer;
-    while( nwords-- )
-    {
-        *pb++ = BG;
-    }
+    if (ctx.term.cursor_row == ctx.term.scroll_bottom)
+        gfx_term_scroll_up(1);
+    else if (ctx.term.cursor_row < ctx.term.HEIGHT-1)
+        ++ctx.term.cursor_row;
+}
 
-    if( ctx.term.cursor_visible )
-        gfx_fill_rect( ctx.term.cursor_col * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT, ctx.term.FONTWIDTH, ctx.term.FONTHEIGHT );
+/** Sets the scrolling region (DECSTBM) and moves the cursor home.
+ *  Rows are 0-based and inclusive. Invalid regions are ignored.
+ */
+void gfx_term_set_scroll_region( unsigned int top, unsigned int bottom )
+{
+    if (bottom >= ctx.term.HEIGHT) bottom = ctx.term.HEIGHT-1;
+    if (top >= bottom) return;
+
+    gfx_term_apply_scroll();
+    ctx.term.scroll_top = top;
+    ctx.term.scroll_bottom = bottom;
+    gfx_term_move_cursor(0, 0);
 }
 
 void gfx_term_beep()
@@ -781,87 +1995,10 @@ void gfx_term_beep()
 /** Draws a character string and handle control characters. */
 void gfx_term_putstring( const char* str )
 {
-    while( *str )
-    {
-        int checkscroll = 1;
-        switch( *str )
-        {
-            case '\r':
-                gfx_restore_cursor_content();
-                ctx.term.cursor_col = 0;
-                if( ctx.term.cursor_row < ctx.term.HEIGHT ) {
-                    gfx_term_save_cursor_content();
-                    gfx_term_render_cursor();
-                }
-                break;
-
-            case '\n':
-                gfx_restore_cursor_content();
-                ++ctx.term.cursor_row;
-                ctx.term.cursor_col = 0;
-                if( ctx.term.cursor_row < ctx.term.HEIGHT ) {
-                    gfx_term_save_cursor_content();
-                    gfx_term_render_cursor();
-                }
-                break;
-
-            case 0x09: /* tab */
-                gfx_restore_cursor_content();
-                ctx.term.cursor_col += 1;
-                ctx.term.cursor_col =  MIN( ctx.term.cursor_col + ctx.term.tab_pos - ctx.term.cursor_col%ctx.term.tab_pos, ctx.term.WIDTH-1 );
-                gfx_term_render_cursor();
-                break;
-
-            case 0x07: /* bell */
-                gfx_term_beep();
-                break;
-
-            case 0x08:
-            case 0x7F:
-                /* backspace */
-                if( ctx.term.cursor_col>0 )
-                {
-                    gfx_restore_cursor_content();
-                    --ctx.term.cursor_col;
-                    gfx_clear_rect( ctx.term.cursor_col*ctx.term.FONTWIDTH, ctx.term.cursor_row*ctx.term.FONTHEIGHT, ctx.term.FONTWIDTH, ctx.term.FONTHEIGHT );
-                    gfx_term_render_cursor();
-                }
-                break;
-
-            case 0xC:
-                /* new page */
-                gfx_term_move_cursor(0,0);
-                gfx_term_clear_screen();
-                break;
-
-
-            default:
-                checkscroll = ctx.term.state.next( *str, &(ctx.term.state) );
-                break;
-        }
-
-        if( checkscroll && (ctx.term.cursor_col >= ctx.term.WIDTH ))
-        {
-            gfx_restore_cursor_content();
-            ++ctx.term.cursor_row;
-            ctx.term.cursor_col = 0;
-            gfx_term_render_cursor();
-        }
-
-        if( checkscroll && (ctx.term.cursor_row >= ctx.term.HEIGHT ))
-        {
-            gfx_restore_cursor_content();
-            --ctx.term.cursor_row;
-
-            gfx_scroll_down(ctx.term.FONTHEIGHT);
-            gfx_term_render_cursor_newline();
-        }
-
-        ++str;
-    }
+    gfx_term_write( str, pivt100_strlen(str) );
+    gfx_term_flush();
 }
 
-
 void gfx_term_set_cursor_visibility( unsigned char visible )
 {
     ctx.term.cursor_visible = visible;
@@ -950,53 +2087,72 @@ void gfx_term_restore_cursor()
 
 void gfx_term_clear_till_end()
 {
-    gfx_swap_fg_bg();
-    gfx_fill_rect( ctx.term.cursor_col * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT, ctx.W, ctx.term.FONTHEIGHT );
-    gfx_swap_fg_bg();
+    gfx_restore_cursor_content();
+    gfx_term_apply_scroll();
+    gfx_term_blank_cells( ctx.term.cursor_row, ctx.term.cursor_col, ctx.term.WIDTH );
+    gfx_clear_rect( ctx.term.cursor_col * ctx.term.FONTWIDTH, ctx.term.cursor_row * ctx.term.FONTHEIGHT, ctx.W, ctx.term.FONTHEIGHT );
+    gfx_term_render_cursor();
 }
 
 void gfx_term_clear_till_cursor()
 {
-    gfx_swap_fg_bg();
-    gfx_fill_rect( 0, ctx.term.cursor_row * ctx.term.FONTHEIGHT, (ctx.term.cursor_col+1) * ctx.term.FONTWIDTH, ctx.term.FONTHEIGHT );
-    gfx_swap_fg_bg();
+    gfx_restore_cursor_content();
+    gfx_term_apply_scroll();
+    gfx_term_blank_cells( ctx.term.cursor_row, 0, ctx.term.cursor_col+1 );
+    gfx_clear_rect( 0, ctx.term.cursor_row * ctx.term.FONTHEIGHT, (ctx.term.cursor_col+1) * ctx.term.FONTWIDTH, ctx.term.FONTHEIGHT );
     gfx_term_render_cursor();
 }
 
 
 void gfx_term_clear_line()
 {
-    gfx_swap_fg_bg();
-    gfx_fill_rect( 0, ctx.term.cursor_row*ctx.term.FONTHEIGHT, ctx.W, ctx.term.FONTHEIGHT );
-    gfx_swap_fg_bg();
+    gfx_restore_cursor_content();
+    gfx_term_apply_scroll();
+    gfx_term_blank_cells( ctx.term.cursor_row, 0, ctx.term.WIDTH );
+    gfx_clear_rect( 0, ctx.term.cursor_row*ctx.term.FONTHEIGHT, ctx.W, ctx.term.FONTHEIGHT );
     gfx_term_render_cursor();
 }
 
 
 void gfx_term_clear_screen()
 {
+    ctx.term.cursor_drawn = 0;  // wiped by the clear anyway
+    ctx.term.scroll_pending = 0;
+    for (unsigned int row = 0; row < ctx.term.HEIGHT; row++)
+    {
+        gfx_term_blank_cells(row, 0, ctx.term.WIDTH);
+    }
+    gfx_term_clear_dirty();
     gfx_clear();
     gfx_term_render_cursor();
 }
 
 void gfx_term_clear_screen_from_here()
 {
+    gfx_restore_cursor_content();
+    gfx_term_apply_scroll();
     if ( ctx.term.cursor_row < (ctx.term.HEIGHT-1) )
     {
-        gfx_swap_fg_bg();
-        gfx_fill_rect( 0, (ctx.term.cursor_row+1) * ctx.term.FONTHEIGHT, ctx.W, ctx.H );
-        gfx_swap_fg_bg();
+        for (unsigned int row = ctx.term.cursor_row+1; row < ctx.term.HEIGHT; row++)
+        {
+            gfx_term_blank_cells(row, 0, ctx.term.WIDTH);
+        }
+        gfx_clear_rect( 0, (ctx.term.cursor_row+1) * ctx.term.FONTHEIGHT, ctx.W, ctx.H );
     }
     gfx_term_clear_till_end();
 }
 
 void gfx_term_clear_screen_to_here()
 {
+    gfx_restore_cursor_content();
+    gfx_term_apply_scroll();
     if ( ctx.term.cursor_row > 0 )
     {
-        gfx_swap_fg_bg();
-        gfx_fill_rect( 0, 0, ctx.W, ctx.term.cursor_row * ctx.term.FONTHEIGHT );
-        gfx_swap_fg_bg();
+        for (unsigned int row = 0; row < ctx.term.cursor_row; row++)
+        {
+            gfx_term_blank_cells(row, 0, ctx.term.WIDTH);
+        }
+        gfx_clear_rect( 0, 0, ctx.W, ctx.term.cursor_row * ctx.term.FONTHEIGHT );
     }
     gfx_term_clear_till_cursor();
 }
@@ -1013,11 +2169,13 @@ void gfx_term_set_font(int font_type)
 
     if (fontInfo != 0)
     {
-        ctx.term.FONT = (unsigned char*)fontInfo->data;
-        ctx.term.FONTWIDTH = fontInfo->width;
-        ctx.term.FONTHEIGHT = fontInfo->height;
-        ctx.term.font_getglyph = fontInfo->get_glyph;
-        gfx_compute_font();
+        gfx_restore_cursor_content();
+        gfx_compute_font(fontInfo);
+
+        // Cells are kept, so the screen content is redrawn with the new font
+        ctx.term.cursor_row = MIN(ctx.term.cursor_row, ctx.term.HEIGHT-1);
+        ctx.term.cursor_col = MIN(ctx.term.cursor_col, ctx.term.WIDTH-1);
+        gfx_term_redraw();
     }
 }
 
@@ -1026,17 +2184,268 @@ void gfx_term_set_font(int font_type)
 /** Sets the tabulation width. */
 void gfx_term_set_tabulation(int width)
 {
-    if (width < 0) width = 8;
+    if (width <= 0) width = 8;
     if (width > (int)ctx.term.WIDTH) width = (int)ctx.term.WIDTH;
     ctx.term.tab_pos = (unsigned int)width;
 }
 
-/**  Term ANSI prefix code */
-#define TERM_ESCAPE_CHAR (0x1B)
+/** Stores a run of printable characters at the cursor position in the current
+ *  colors and advances the cursor, going to the next line at the right edge.
+ *  The cells of a row are marked dirty once and drawn later by
+ *  gfx_term_render_dirty().
+ */
+static void gfx_term_put_run( const char* str, unsigned int len )
+{
+    while( len )
+    {
+        const unsigned int row = ctx.term.cursor_row;
+        const unsigned int col = ctx.term.cursor_col;
+        unsigned int count = (col < ctx.term.WIDTH) ? ctx.term.WIDTH - col : 1;
+        if( count > len ) count = len;
+
+        if( row < ctx.term.HEIGHT && col < ctx.term.WIDTH )
+        {
+            GFX_CELL* cell = gfx_term_cell_row(row) + col;
+            const GFX_CELL pen = { 0, ctx.fg, ctx.bg, ctx.reverse ? GFX_ATTR_REVERSE : 0, 0 };
+            for( unsigned int i = 0; i < count; i++ )
+            {
+                cell[i] = pen;
+                cell[i].glyph = (unsigned char)str[i];
+            }
+            gfx_term_mark_dirty(row, col);
+            gfx_term_mark_dirty(row, col + count - 1);
+        }
+
+        ctx.term.cursor_col += count;
+        str += count;
+        len -= count;
+        if( ctx.term.cursor_col >= ctx.term.WIDTH )
+        {
+            gfx_term_line_feed();
+            ctx.term.cursor_col = 0;
+        }
+    }
+}
+
+/** Word of received bytes, may alias the char buffer. */
+typedef unsigned int __attribute__((may_alias)) scn_word;
+
+/** Returns the end of the printable run starting at str: the first byte
+ *  below 0x20 (control characters and ESC) or 0x7F. Bytes from 0x80 on are
+ *  glyphs of the font. Aligned words are tested 4 bytes at a time.
+ */
+static const char* gfx_term_printable_end( const char* str, const char* end )
+{
+    while( str < end && ((unsigned int)str & 3) )
+    {
+        if( (unsigned char)*str < 0x20 || *str == 0x7F ) return str;
+        str++;
+    }
+    while( str + 4 <= end )
+    {
+        // high bit set in a byte lane below 0x20 or equal to 0x7F
+        const unsigned int w = *(const scn_word*)str;
+        if( ((w - 0x20202020u) | ((w ^ 0x7F7F7F7Fu) - 0x01010101u)) & ~w & 0x80808080u )
+            break;
+        str += 4;
+    }
+    while( str < end && (unsigned char)*str >= 0x20 && *str != 0x7F )
+        str++;
+    return str;
+}
+
+/** Byte classes of the parser table. */
+enum
+{
+    SCN_C_EXECUTE,      // NUL, BS, HT, LF, FF, CR
+    SCN_C_BEL,          // BEL, also ends an OSC string
+    SCN_C_CONTROL,      // other C0 controls, shown as glyphs in normal text
+    SCN_C_CANCEL,       // CAN, SUB
+    SCN_C_ESC,
+    SCN_C_INTER,        // 0x20-0x2F intermediates
+    SCN_C_HASH,         // '#', an intermediate or the PiGFX private mode character
+    SCN_C_DIGIT,
+    SCN_C_COLON,
+    SCN_C_SEMI,
+    SCN_C_PRIVATE,      // '<' '=' '>' '?'
+    SCN_C_CSI,          // '['
+    SCN_C_OSC,          // ']'
+    SCN_C_DCS,          // 'P'
+    SCN_C_SOS,          // 'X' '^' '_' (SOS, PM, APC)
+    SCN_C_FINAL,        // other 0x40-0x7E
+    SCN_C_DEL,
+    SCN_C_HIGH,         // 0x80-0xFF
+    SCN_C_COUNT
+};
+
+/** Actions of the parser table. */
+enum
+{
+    SCN_ACT_NONE,
+    SCN_ACT_PRINT,          // put the byte into a cell
+    SCN_ACT_EXECUTE,        // control character
+    SCN_ACT_CLEAR,          // start of a sequence, forget the parameters
+    SCN_ACT_COLLECT,        // intermediate character
+    SCN_ACT_PRIVATE,        // private mode character
+    SCN_ACT_PARAM,          // digit of a parameter
+    SCN_ACT_SEPARATE,       // next parameter
+    SCN_ACT_ESC_DISPATCH,   // final character of an ESC sequence
+    SCN_ACT_CSI_DISPATCH,   // final character of an ESC[ sequence
+};
+
+#define SCN_CLASS_RANGE( FIRST, LAST, C ) [FIRST ... LAST] = C
+
+/** Class of every byte. */
+static const unsigned char scn_class[256] =
+{
+    [0x00] = SCN_C_EXECUTE,
+    SCN_CLASS_RANGE( 0x01, 0x06, SCN_C_CONTROL ),
+    [0x07] = SCN_C_BEL,
+    [0x08] = SCN_C_EXECUTE, [0x09] = SCN_C_EXECUTE, [0x0A] = SCN_C_EXECUTE,
+    [0x0B] = SCN_C_CONTROL,
+    [0x0C] = SCN_C_EXECUTE, [0x0D] = SCN_C_EXECUTE,
+    SCN_CLASS_RANGE( 0x0E, 0x17, SCN_C_CONTROL ),
+    [0x18] = SCN_C_CANCEL, [0x19] = SCN_C_CONTROL, [0x1A] = SCN_C_CANCEL,
+    [0x1B] = SCN_C_ESC,
+    SCN_CLASS_RANGE( 0x1C, 0x1F, SCN_C_CONTROL ),
+    SCN_CLASS_RANGE( 0x20, 0x22, SCN_C_INTER ),
+    ['#'] = SCN_C_HASH,
+    SCN_CLASS_RANGE( 0x24, 0x2F, SCN_C_INTER ),
+    SCN_CLASS_RANGE( '0', '9', SCN_C_DIGIT ),
+    [':'] = SCN_C_COLON,
+    [';'] = SCN_C_SEMI,
+    SCN_CLASS_RANGE( '<', '?', SCN_C_PRIVATE ),
+    SCN_CLASS_RANGE( '@', 'O', SCN_C_FINAL ),
+    ['P'] = SCN_C_DCS,
+    SCN_CLASS_RANGE( 'Q', 'W', SCN_C_FINAL ),
+    ['X'] = SCN_C_SOS,
+    SCN_CLASS_RANGE( 'Y', 'Z', SCN_C_FINAL ),
+    ['['] = SCN_C_CSI,
+    ['\\'] = SCN_C_FINAL,
+    [']'] = SCN_C_OSC,
+    ['^'] = SCN_C_SOS,
+    ['_'] = SCN_C_SOS,
+    SCN_CLASS_RANGE( '`', 0x7E, SCN_C_FINAL ),
+    [0x7F] = SCN_C_DEL,
+    SCN_CLASS_RANGE( 0x80, 0xFF, SCN_C_HIGH ),
+};
+
+/** Transition: action in the high nibble, next state in the low nibble. */
+#define T( ACT, STATE ) (unsigned char)((SCN_ACT_##ACT << 4) | SCN_##STATE)
+
+/** Transitions for each state and byte class, after the DEC VT500 parser.
+ *  Controls are executed in the middle of a sequence, CAN and SUB cancel
+ *  it, ESC starts a new one. PiGFX differences: other C0 controls and bytes
+ *  from 0x80 on are shown as glyphs, DEL is a backspace, ESC ESC shows the
+ *  ESC glyph and '#' right after ESC[ is a private mode character.
+ */
+static const unsigned char scn_table[SCN_STATE_COUNT][SCN_C_COUNT] =
+{
+    [SCN_GROUND] =
+    {
+        T(EXECUTE, GROUND), T(EXECUTE, GROUND), T(PRINT, GROUND), T(PRINT, GROUND),
+        T(CLEAR, ESCAPE),
+        T(PRINT, GROUND), T(PRINT, GROUND), T(PRINT, GROUND), T(PRINT, GROUND), T(PRINT, GROUND),
+        T(PRINT, GROUND), T(PRINT, GROUND), T(PRINT, GROUND), T(PRINT, GROUND), T(PRINT, GROUND),
+        T(PRINT, GROUND), T(EXECUTE, GROUND), T(PRINT, GROUND),
+    },
+    [SCN_ESCAPE] =
+    {
+        T(EXECUTE, ESCAPE), T(EXECUTE, ESCAPE), T(NONE, ESCAPE), T(NONE, GROUND),
+        T(PRINT, GROUND),
+        T(COLLECT, ESCAPE_INTERMEDIATE), T(COLLECT, ESCAPE_INTERMEDIATE),
+        T(ESC_DISPATCH, GROUND), T(ESC_DISPATCH, GROUND), T(ESC_DISPATCH, GROUND), T(ESC_DISPATCH, GROUND),
+        T(CLEAR, CSI_ENTRY), T(NONE, OSC_STRING), T(NONE, STRING), T(NONE, STRING),
+        T(ESC_DISPATCH, GROUND), T(NONE, ESCAPE), T(NONE, GROUND),
+    },
+    [SCN_ESCAPE_INTERMEDIATE] =
+    {
+        T(EXECUTE, ESCAPE_INTERMEDIATE), T(EXECUTE, ESCAPE_INTERMEDIATE), T(NONE, ESCAPE_INTERMEDIATE), T(NONE, GROUND),
+        T(CLEAR, ESCAPE),
+        T(COLLECT, ESCAPE_INTERMEDIATE), T(COLLECT, ESCAPE_INTERMEDIATE),
+        T(ESC_DISPATCH, GROUND), T(ESC_DISPATCH, GROUND), T(ESC_DISPATCH, GROUND), T(ESC_DISPATCH, GROUND),
+        T(ESC_DISPATCH, GROUND), T(ESC_DISPATCH, GROUND), T(ESC_DISPATCH, GROUND), T(ESC_DISPATCH, GROUND),
+        T(ESC_DISPATCH, GROUND), T(NONE, ESCAPE_INTERMEDIATE), T(NONE, GROUND),
+    },
+    [SCN_CSI_ENTRY] =
+    {
+        T(EXECUTE, CSI_ENTRY), T(EXECUTE, CSI_ENTRY), T(NONE, CSI_ENTRY), T(NONE, GROUND),
+        T(CLEAR, ESCAPE),
+        T(COLLECT, CSI_INTERMEDIATE), T(PRIVATE, CSI_PARAM),
+        T(PARAM, CSI_PARAM), T(NONE, CSI_IGNORE), T(SEPARATE, CSI_PARAM), T(PRIVATE, CSI_PARAM),
+        T(CSI_DISPATCH, GROUND), T(CSI_DISPATCH, GROUND), T(CSI_DISPATCH, GROUND), T(CSI_DISPATCH, GROUND),
+        T(CSI_DISPATCH, GROUND), T(NONE, CSI_ENTRY), T(NONE, GROUND),
+    },
+    [SCN_CSI_PARAM] =
+    {
+        T(EXECUTE, CSI_PARAM), T(EXECUTE, CSI_PARAM), T(NONE, CSI_PARAM), T(NONE, GROUND),
+        T(CLEAR, ESCAPE),
+        T(COLLECT, CSI_INTERMEDIATE), T(COLLECT, CSI_INTERMEDIATE),
+        T(PARAM, CSI_PARAM), T(NONE, CSI_IGNORE), T(SEPARATE, CSI_PARAM), T(NONE, CSI_IGNORE),
+        T(CSI_DISPATCH, GROUND), T(CSI_DISPATCH, GROUND), T(CSI_DISPATCH, GROUND), T(CSI_DISPATCH, GROUND),
+        T(CSI_DISPATCH, GROUND), T(NONE, CSI_PARAM), T(NONE, GROUND),
+    },
+    [SCN_CSI_INTERMEDIATE] =
+    {
+        T(EXECUTE, CSI_INTERMEDIATE), T(EXECUTE, CSI_INTERMEDIATE), T(NONE, CSI_INTERMEDIATE), T(NONE, GROUND),
+        T(CLEAR, ESCAPE),
+        T(COLLECT, CSI_INTERMEDIATE), T(COLLECT, CSI_INTERMEDIATE),
+        T(NONE, CSI_IGNORE), T(NONE, CSI_IGNORE), T(NONE, CSI_IGNORE), T(NONE, CSI_IGNORE),
+        T(CSI_DISPATCH, GROUND), T(CSI_DISPATCH, GROUND), T(CSI_DISPATCH, GROUND), T(CSI_DISPATCH, GROUND),
+        T(CSI_DISPATCH, GROUND), T(NONE, CSI_INTERMEDIATE), T(NONE, GROUND),
+    },
+    [SCN_CSI_IGNORE] =
+    {
+        T(EXECUTE, CSI_IGNORE), T(EXECUTE, CSI_IGNORE), T(NONE, CSI_IGNORE), T(NONE, GROUND),
+        T(CLEAR, ESCAPE),
+        T(NONE, CSI_IGNORE), T(NONE, CSI_IGNORE),
+        T(NONE, CSI_IGNORE), T(NONE, CSI_IGNORE), T(NONE, CSI_IGNORE), T(NONE, CSI_IGNORE),
+        T(NONE, GROUND), T(NONE, GROUND), T(NONE, GROUND), T(NONE, GROUND),
+        T(NONE, GROUND), T(NONE, CSI_IGNORE), T(NONE, GROUND),
+    },
+    [SCN_OSC_STRING] =
+    {
+        T(NONE, OSC_STRING), T(NONE, GROUND), T(NONE, OSC_STRING), T(NONE, GROUND),
+        T(CLEAR, ESCAPE),
+        T(NONE, OSC_STRING), T(NONE, OSC_STRING),
+        T(NONE, OSC_STRING), T(NONE, OSC_STRING), T(NONE, OSC_STRING), T(NONE, OSC_STRING),
+        T(NONE, OSC_STRING), T(NONE, OSC_STRING), T(NONE, OSC_STRING), T(NONE, OSC_STRING),
+        T(NONE, OSC_STRING), T(NONE, OSC_STRING), T(NONE, OSC_STRING),
+    },
+    [SCN_STRING] =
+    {
+        T(NONE, STRING), T(NONE, STRING), T(NONE, STRING), T(NONE, GROUND),
+        T(CLEAR, ESCAPE),
+        T(NONE, STRING), T(NONE, STRING),
+        T(NONE, STRING), T(NONE, STRING), T(NONE, STRING), T(NONE, STRING),
+        T(NONE, STRING), T(NONE, STRING), T(NONE, STRING), T(NONE, STRING),
+        T(NONE, STRING), T(NONE, STRING), T(NONE, STRING),
+    },
+};
+
+#undef T
+
+/** Final character of an ESC sequence without ESC[. */
+static void gfx_term_esc_dispatch( char ch, scn_state *state )
+{
+    if( state->intermediate != 0 )
+        return;
+
+    switch( ch )
+    {
+        case '7':
+            // DECSC
+            gfx_term_save_cursor();
+            break;
 
-/** State parsing functions */
+        case '8':
+            // DECRC
+            gfx_term_restore_cursor();
+            break;
+    }
+}
 
-/** Parse the last letter in ANSI sequence.
+/** Final character of an ESC[ sequence.
  *  Normal ANSI escape sequences assume previous parameters are stored as numbers in state->cmd_params[].
  *
  *  state->private_mode_char can hold a character in which case the process is not
@@ -1048,13 +2457,9 @@ void gfx_term_set_tabulation(int width)
  *
  *  @param ch the character to scan
  *	@param state points to the current state structure
- *	@return 1 if the terminal should handle line break and screen scroll returning from this call.
- *
  */
-int state_fun_final_letter( char ch, scn_state *state )
+static void gfx_term_csi_dispatch( char ch, scn_state *state )
 {
-    int retval = 1;// handle line break and screen scroll by default
-    
     // General 'ESC[' ANSI/VT100 commands
     switch( ch )
     {
@@ -1291,8 +2696,9 @@ int state_fun_final_letter( char ch, scn_state *state )
         case 'H':
             if( state->cmd_params_size == 2 )
             {
-                int row = (state->cmd_params[0] - 1) % ctx.term.HEIGHT;
-                int col = (state->cmd_params[1] - 1) % ctx.term.WIDTH; // 80 -> (79 % 80) -> 79, 81 -> (80 % 80) -> 0
+                // 0 is 1 like an empty parameter
+                int row = (MAX(state->cmd_params[0], 1) - 1) % ctx.term.HEIGHT;
+                int col = (MAX(state->cmd_params[1], 1) - 1) % ctx.term.WIDTH; // 80 -> (79 % 80) -> 79, 81 -> (80 % 80) -> 0
                 gfx_term_move_cursor(row, col);
             }
             else
@@ -1300,6 +2706,17 @@ int state_fun_final_letter( char ch, scn_state *state )
             goto back_to_normal;
             break;
 
+        case 'r':
+            // Set scrolling region (DECSTBM), no parameters or 0 select the screen edges
+            if( state->private_mode_char == 0 )
+            {
+                unsigned int top = (state->cmd_params_size >= 1 && state->cmd_params[0] > 0) ? state->cmd_params[0] : 1;
+                unsigned int bottom = (state->cmd_params_size >= 2 && state->cmd_params[1] > 0) ? state->cmd_params[1] : ctx.term.HEIGHT;
+                gfx_term_set_scroll_region(top-1, bottom-1);
+            }
+            goto back_to_normal;
+            break;
+
         case 's':
             gfx_term_save_cursor();
             goto back_to_normal;
@@ -1351,161 +2768,162 @@ int state_fun_final_letter( char ch, scn_state *state )
     }
 
 back_to_normal:
-    // go back to normal text
-    state->cmd_params_size = 0;
-    state->next = state_fun_normaltext;
-    return retval;
+    // the table goes back to normal text
+    return;
 }
 
-/** Read next digit of a parameter or a separator. */
-int state_fun_read_digit( char ch, scn_state *state )
+/** Executes a control character. */
+static void gfx_term_execute( char ch )
 {
-    if( ch>='0' && ch <= '9' )
-    {
-        // make sure we have a parameter
-        if (state->cmd_params_size == 0)
-        {
-            state->cmd_params_size = 1;
-            state->cmd_params[0] = 0;
-        }
-        // parse digit
-        state->cmd_params[ state->cmd_params_size - 1] = state->cmd_params[ state->cmd_params_size - 1]*10 + (ch-'0');
-        state->next = state_fun_read_digit; // stay on this state
-        return 1;
-    }
-    if (ch == '.')
-    {
-        state->next = state_fun_ignore_digit;
-         return 1;
-    }
-    if( ch == ';' )
+    switch( ch )
     {
-        // Another param will follow
-        state->cmd_params_size++;
-        state->cmd_params[ state->cmd_params_size-1 ] = 0;
-        state->next = state_fun_read_digit; // stay on this state
-        return 1;
-    }
+        case 0x00: /* NUL fill character */
+            break;
 
-    // not a digit, call the final state
-    state_fun_final_letter( ch, state );
-    return 1;
-}
+        case '\r':
+            ctx.term.cursor_col = 0;
+            break;
 
-/** Ignore next digits of a parameter until separator. */
-int state_fun_ignore_digit( char ch, scn_state *state )
-{
-    if( ch>='0' && ch <= '9' )
-    {
-        return 1;
-    }
-    if( ch == ';' )
-    {
-        // Another param will follow
-        state->cmd_params_size++;
-        state->cmd_params[ state->cmd_params_size-1 ] = 0;
-        state->next = state_fun_read_digit; // stay on this state
-        return 1;
+        case '\n':
+            gfx_term_line_feed();
+            ctx.term.cursor_col = 0;
+            break;
+
+        case 0x09: /* tab */
+            ctx.term.cursor_col += 1;
+            ctx.term.cursor_col =  MIN( ctx.term.cursor_col + ctx.term.tab_pos - ctx.term.cursor_col%ctx.term.tab_pos, ctx.term.WIDTH-1 );
+            break;
+
+        case 0x07: /* bell */
+            gfx_term_beep();
+            break;
+
+        case 0x08:
+        case 0x7F:
+            /* backspace */
+            if( ctx.term.cursor_col>0 )
+            {
+                --ctx.term.cursor_col;
+                if( ctx.term.cursor_col < ctx.term.WIDTH )
+                {
+                    gfx_term_blank_cells( ctx.term.cursor_row, ctx.term.cursor_col, ctx.term.cursor_col+1 );
+                    gfx_term_mark_dirty( ctx.term.cursor_row, ctx.term.cursor_col );
+                }
+            }
+            break;
+
+        case 0xC:
+            /* new page */
+            gfx_term_move_cursor(0,0);
+            gfx_term_clear_screen();
+            break;
     }
-    // not a digit, end
-    state_fun_final_letter( ch, state );
-    return 1;
 }
 
-/** Right after ESC, start a parameter when reading a digit or select the private mode character. */
-int state_fun_selectescape( char ch, scn_state *state )
+/** Draws len bytes from buf and handle control characters.
+ *  Unlike gfx_term_putstring() the buffer doesn't need a terminating 0,
+ *  NUL bytes inside the buffer are ignored like on a real VT100.
+ *  Escape sequences may be split across calls.
+ *  The cursor is not drawn again before gfx_term_flush() is called.
+ */
+void gfx_term_write( const char* buf, size_t len )
 {
-    if( ch>='0' && ch<='9' )
-    {
-        // start of a digit
-        state->cmd_params_size = 1;
-        state->cmd_params[ 0 ] = ch-'0';
-        state->next = state_fun_read_digit;
-        return 1;
-    }
-    else
+    const char* const end = buf + len;
+    scn_state* const state = &ctx.term.state;
+
+    // The cursor is lifted once for the whole batch and drawn again by gfx_term_flush()
+    gfx_term_hold_cursor();
+    GFX_STAT_ADD(bytes_in, len);
+
+    const char* str = buf;
+    while( str < end )
     {
-        if( ch=='?' || ch=='#' || ch=='=' )
+        // Text goes to the cells a run at a time
+        if( state->state == SCN_GROUND )
         {
-            state->private_mode_char = ch;
-            // A digit may follow
-            state->cmd_params_size = 0;
-            state->next = state_fun_read_digit;
-            return 1;
+            const char* run = gfx_term_printable_end( str, end );
+            if( run != str )
+            {
+                gfx_term_put_run( str, run - str );
+                str = run;
+                continue;
+            }
         }
-    }
 
-    // Already at the final letter
-    state_fun_final_letter( ch, state );
-    return 1;
-}
+        const char ch = *str++;
+        const unsigned char t = scn_table[state->state][scn_class[(unsigned char)ch]];
+        state->state = t & 0x0F;
+        switch( t >> 4 )
+        {
+            case SCN_ACT_PRINT:
+                gfx_term_put_run( &ch, 1 );
+                break;
 
-/** Right after ESC, wait for a [.
- *  The special case ESC ESC is displaying ESC character and end the sequence.
- */
-int state_fun_waitsquarebracket( char ch, scn_state *state )
-{
-    if( ch=='[' )
-    {
-        state->cmd_params[0]=1;
-        state->private_mode_char=0; // reset private mode char
-        state->next = state_fun_selectescape;
-        return 1;
-    }
+            case SCN_ACT_EXECUTE:
+                gfx_term_execute( ch );
+                break;
 
-    if( ch==TERM_ESCAPE_CHAR ) // Double ESCAPE prints the ESC character
-    {
-        gfx_putc( ctx.term.cursor_row, ctx.term.cursor_col, ch );
-        ++ctx.term.cursor_col;
-        gfx_term_render_cursor();
-    }
+            case SCN_ACT_CLEAR:
+                state->cmd_params[0] = 1;
+                state->cmd_params_size = 0;
+                state->private_mode_char = 0;
+                state->intermediate = 0;
+                break;
 
-    state->next = state_fun_normaltext;
-    return 1;
-}
+            case SCN_ACT_COLLECT:
+                state->intermediate = ch;
+                break;
 
-/** Starting state when receiving a character to display.
- *  If the character is ESC, a sequence parsing state is entered.
- *  If none of the previous happened, the character is displayed using current font.
- */
-int state_fun_normaltext( char ch, scn_state *state )
-{
-    if( ch==TERM_ESCAPE_CHAR )
-    {
-        state->next = state_fun_waitsquarebracket;
-        return 1;
-    }
+            case SCN_ACT_PRIVATE:
+                state->private_mode_char = ch;
+                break;
 
-    gfx_putc( ctx.term.cursor_row, ctx.term.cursor_col, ch );
-    ++ctx.term.cursor_col;
-    gfx_term_render_cursor();
-    return 1;
-}
+            case SCN_ACT_PARAM:
+            {
+                if( state->cmd_params_size == 0 )
+                {
+                    state->cmd_params_size = 1;
+                    state->cmd_params[0] = 0;
+                }
+                // saturates instead of wrapping around, so no handler sees a huge or negative count
+                unsigned int* param = &state->cmd_params[ state->cmd_params_size-1 ];
+                *param = *param*10 + (ch-'0');
+                if( *param > SCN_PARAM_MAX ) *param = SCN_PARAM_MAX;
+                break;
+            }
 
-/** This can be used to flip the framebuffer
-    Tests have showed that this is quite slow actually
-    For the moment I'm going to disable this
-**/
-void gfx_switch_framebuffer()
-{
-    // Change FB write pointer
-    unsigned char* showingFb = ctx.pfb;     // this fb is now not showing, but gets changed now to be showing
-    if (ctx.pfb == ctx.pFirstFb) ctx.pfb = ctx.pSecondFb;
-    else ctx.pfb = ctx.pFirstFb;
+            case SCN_ACT_SEPARATE:
+                // an empty parameter is 0, a sequence with more than SCN_MAX_PARAMS is ignored
+                if( state->cmd_params_size == 0 )
+                {
+                    state->cmd_params_size = 1;
+                    state->cmd_params[0] = 0;
+                }
+                if( state->cmd_params_size < SCN_MAX_PARAMS )
+                    state->cmd_params[ state->cmd_params_size++ ] = 0;
+                else
+                    state->state = SCN_CSI_IGNORE;
+                break;
 
-    // Change y offset of framebuffer to other buffer
-    if (ctx.fb_yOffset == 0) ctx.fb_yOffset = ctx.H;
-    else ctx.fb_yOffset = 0;
-    fb_switch_framebuffer(ctx.fb_yOffset);
+            case SCN_ACT_ESC_DISPATCH:
+                gfx_term_esc_dispatch( ch, state );
+                break;
 
-    // Copy all data of the now showing framebuffer part to the not showing framebuffer part
-    dma_memcpy_32(showingFb, ctx.pfb, ctx.size);
+            case SCN_ACT_CSI_DISPATCH:
+                if( state->intermediate == 0 )
+                    gfx_term_csi_dispatch( ch, state );
+                break;
+        }
+    }
 }
 
-/** Gets the size in bytes needed for a screen buffer. */
+
+/** Gets the size in bytes needed for a screen buffer.
+ *  The screen is saved as its cells plus the terminal size, not as pixels.
+ */
 unsigned int gfx_get_screen_buffer_size()
 {
-    return ctx.size;
+    return 2 * sizeof(unsigned int) + ctx.term.WIDTH * ctx.term.HEIGHT * sizeof(GFX_CELL);
 }
 
 /** Saves the current screen content to a buffer. */
@@ -1513,43 +2931,129 @@ void gfx_save_screen_buffer(void* buffer)
 {
     if (buffer != 0)
     {
-        if (PiVT100Config.disableGfxDMA)
-        {
-            // Simple memory copy
-            unsigned char* src = ctx.pfb;
-            unsigned char* dst = (unsigned char*)buffer;
-            for (unsigned int i = 0; i < ctx.size; i++)
-            {
-                *dst++ = *src++;
-            }
-        }
-        else
+        unsigned int* size = (unsigned int*)buffer;
+        GFX_CELL* cells = (GFX_CELL*)(size + 2);
+        size[0] = ctx.term.WIDTH;
+        size[1] = ctx.term.HEIGHT;
+        for (unsigned int row = 0; row < ctx.term.HEIGHT; row++)
         {
-            // Use DMA for faster copy
-            dma_memcpy_32(buffer, ctx.pfb, ctx.size);
+            pivt100_memcpy(cells + row * ctx.term.WIDTH, gfx_term_cell_row(row), ctx.term.WIDTH * sizeof(GFX_CELL));
         }
     }
 }
 
-/** Restores screen content from a buffer. */
+/** Restores screen content from a buffer and redraws the screen.
+ *  If the terminal size changed in the meantime, the overlapping part is restored.
+ */
 void gfx_restore_screen_buffer(void* buffer)
 {
     if (buffer != 0)
     {
-        if (PiVT100Config.disableGfxDMA)
-        {
-            // Simple memory copy
-            unsigned char* src = (unsigned char*)buffer;
-            unsigned char* dst = ctx.pfb;
-            for (unsigned int i = 0; i < ctx.size; i++)
-            {
-                *dst++ = *src++;
-            }
-        }
-        else
+        const unsigned int* size = (const unsigned int*)buffer;
+        const GFX_CELL* cells = (const GFX_CELL*)(size + 2);
+        const unsigned int width = MIN(size[0], ctx.term.WIDTH);
+        for (unsigned int row = 0; row < MIN(size[1], ctx.term.HEIGHT); row++)
         {
-            // Use DMA for faster copy
-            dma_memcpy_32(buffer, ctx.pfb, ctx.size);
+            pivt100_memcpy(gfx_term_cell_row(row), cells + row * size[0], width * sizeof(GFX_CELL));
         }
+        gfx_term_redraw();
     }
 }
+
+/** Swaps the terminal context in ctx with the overlay context. */
+static void gfx_overlay_swap()
+{
+    static FRAMEBUFFER_CTX other;
+    pivt100_memcpy(&other, &overlay.ctx, sizeof(other));
+    pivt100_memcpy(&overlay.ctx, &ctx, sizeof(ctx));
+    pivt100_memcpy(&ctx, &other, sizeof(ctx));
+
+    draw_putc_fun (*putc) = overlay.putc;
+    overlay.putc = gfx_putc;
+    gfx_putc = putc;
+}
+
+/** Shows the overlay page with the font font_type for drawing on it.
+ *  The overlay gets a display context of its own without character cells,
+ *  cursor, glyph cache or row compositor; the terminal keeps its page, cells
+ *  and cursor and goes on drawing there while the overlay is shown.
+ *  Nothing is copied or allocated. Returns 0 if the framebuffer has no
+ *  overlay page, the font does not exist or an overlay is already open.
+ */
+int gfx_overlay_open( int font_type )
+{
+    const font_descriptor_t* fontInfo = font_registry_get_info(font_type);
+    if (ctx.overlay_line == 0 || fontInfo == 0 || overlay.open || overlay.drawing)
+        return 0;
+
+    pivt100_memcpy(&overlay.ctx, &ctx, sizeof(ctx));
+    overlay.putc = gfx_putc;
+    gfx_overlay_swap();
+
+    // a single screen, it never pans nor flips
+    ctx.pfb = ctx.pFirstFb + (ctx.overlay_line - ctx.page.line[ctx.page.back]) * ctx.Pitch;
+    ctx.pFirstFb = ctx.pfb;
+    ctx.fb_yOffset = ctx.overlay_line;
+    ctx.fb_lines = ctx.H;
+    pivt100_memset(&ctx.page, 0, sizeof(ctx.page));
+    pivt100_memset(&ctx.term, 0, sizeof(ctx.term));
+    pivt100_memset(&ctx.glyph_cache, 0, sizeof(ctx.glyph_cache));
+    pivt100_memset(&ctx.compose, 0, sizeof(ctx.compose));
+    gfx_set_font_metrics(fontInfo);
+    ctx.term.scroll_bottom = ctx.term.HEIGHT-1;
+    ctx.term.state.state = SCN_GROUND;
+    gfx_select_putc();
+
+    gfx_overlay_swap();
+    overlay.open = 1;
+    fb_switch_framebuffer(ctx.overlay_line);
+    return 1;
+}
+
+/** Directs the drawing functions to the overlay page until gfx_overlay_end().
+ *  Does nothing if no overlay is open. */
+void gfx_overlay_begin()
+{
+    if (!overlay.open || overlay.drawing) return;
+    overlay.drawing = 1;
+    gfx_overlay_swap();
+}
+
+/** Directs the drawing functions back to the terminal. */
+void gfx_overlay_end()
+{
+    if (!overlay.drawing) return;
+    overlay.drawing = 0;
+    gfx_overlay_swap();
+}
+
+/** Shows the terminal page again, which is up to date. With page flipping
+ *  that is the page shown last, the back page follows with the next flip. */
+void gfx_overlay_close()
+{
+    if (!overlay.open) return;
+    gfx_overlay_end();
+    overlay.open = 0;
+    gfx_dma_sync();
+    if (ctx.page.count < 2)
+        fb_switch_framebuffer(ctx.fb_yOffset);
+    else
+        fb_switch_framebuffer(ctx.page.line[ctx.page.back ^ 1] + ctx.page.yOffset[ctx.page.back ^ 1]);
+}
+
+/** Copies the engine counters to out. They stay 0 unless GFX_STATISTICS is
+ *  enabled, except for the glyph cache counters which are always kept. */
+void gfx_get_stats(gfx_stats_t* out)
+{
+    *out = stats;
+    out->glyph_cache_hits = ctx.glyph_cache.hits;
+    out->glyph_cache_misses = ctx.glyph_cache.misses;
+}
+
+/** Resets all engine counters. */
+void gfx_reset_stats()
+{
+    pivt100_memset(&stats, 0, sizeof(stats));
+    ctx.glyph_cache.hits = 0;
+    ctx.glyph_cache.misses = 0;
+}
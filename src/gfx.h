@@ -12,6 +12,7 @@
 
 #define DEPRICATED
 
+#include <stddef.h>
 #include "gfx_types.h"
 #include "font_registry.h"
 
@@ -187,6 +188,33 @@ extern void gfx_scroll_down( unsigned int npixels );
  */
 extern void gfx_scroll_up( unsigned int npixels );
 
+/*!
+ * @brief Scroll part of the screen content up
+ * 
+ * Moves the pixel lines from top to bottom-1 up by npixels, filling the
+ * bottom of the region with the background color. Lines outside the
+ * region are not touched. Used for scrolling regions (DECSTBM) and
+ * deleting lines.
+ * 
+ * @param top First pixel line of the region
+ * @param bottom Pixel line below the region
+ * @param npixels Number of pixels to scroll
+ */
+extern void gfx_scroll_region_down( unsigned int top, unsigned int bottom, unsigned int npixels );
+
+/*!
+ * @brief Scroll part of the screen content down
+ * 
+ * Moves the pixel lines from top to bottom-1 down by npixels, filling the
+ * top of the region with the background color. Used for scrolling regions
+ * (DECSTBM) and inserting lines.
+ * 
+ * @param top First pixel line of the region
+ * @param bottom Pixel line below the region
+ * @param npixels Number of pixels to scroll
+ */
+extern void gfx_scroll_region_up( unsigned int top, unsigned int bottom, unsigned int npixels );
+
 // Sprite API removed.
 
 //==============================================================================
@@ -203,6 +231,70 @@ extern void gfx_scroll_up( unsigned int npixels );
  */
 extern void gfx_term_putstring( const char* str );
 
+/*!
+ * @brief Output a byte buffer to the terminal
+ * 
+ * Same as gfx_term_putstring() but takes an explicit length, so the
+ * caller can hand over a whole run of received bytes at once. NUL bytes
+ * are ignored instead of terminating the output.
+ * 
+ * @param buf Bytes to output (no terminating NUL needed)
+ * @param len Number of bytes in buf
+ */
+extern void gfx_term_write( const char* buf, size_t len );
+
+/*!
+ * @brief Finish a batch of terminal output
+ * 
+ * gfx_term_write() lifts the cursor and leaves it hidden so a whole batch
+ * of characters is rendered without touching the cursor cell each time.
+ * This draws the cursor once at its final position. Call it when the input
+ * goes idle or the frame deadline is reached. gfx_term_putstring() calls
+ * it on its own. With page flipping (pageFlip) the page drawn on is shown
+ * afterwards, unless the last flip was less than a display refresh ago;
+ * then a later call shows it.
+ */
+extern void gfx_term_flush();
+
+/*!
+ * @brief Draw the character cells changed since the last call
+ * 
+ * Terminal output only updates the cell grid and marks the touched rows
+ * dirty. This draws the dirty part of each row to the framebuffer.
+ * gfx_term_flush() calls it, as does every operation that moves pixels.
+ */
+extern void gfx_term_render_dirty();
+
+/*!
+ * @brief Redraw the whole screen from the character cells
+ * 
+ * Clears the framebuffer and draws every cell again, e.g. after a font
+ * change or when the framebuffer content was lost.
+ */
+extern void gfx_term_redraw();
+
+/*!
+ * @brief Get the character cells of a screen row
+ * 
+ * The cells are the terminal's own copy of the screen: character, colors
+ * and attributes for every position. They don't include the cursor.
+ * 
+ * @param row Screen row (0-based)
+ * @return Pointer to the cells of the row (terminal width entries) or 0 if row is out of range
+ */
+extern const GFX_CELL* gfx_term_get_cells( unsigned int row );
+
+/*!
+ * @brief Set the scrolling region (DECSTBM)
+ * 
+ * Line feeds on the bottom margin scroll only the rows from top to bottom,
+ * insert and delete line stay inside the region. The cursor moves home.
+ * 
+ * @param top First row of the region (0-based)
+ * @param bottom Last row of the region (0-based, inclusive)
+ */
+extern void gfx_term_set_scroll_region( unsigned int top, unsigned int bottom );
+
 /*!
  * @brief Set cursor visibility on/off
  * 
@@ -418,7 +510,8 @@ extern void gfx_term_set_cursor_blinking(unsigned char blink);
  * @brief Get the size needed for screen buffer storage
  * 
  * Returns the number of bytes required to store the entire screen content
- * for save/restore operations.
+ * for save/restore operations. The screen is stored as character cells,
+ * so this is a few kilobytes regardless of the resolution.
  * 
  * @return Number of bytes needed for screen buffer
  */
@@ -437,11 +530,101 @@ extern void gfx_save_screen_buffer(void* buffer);
 /*!
  * @brief Restore screen content from buffer
  * 
- * Restores previously saved screen content from the provided buffer.
+ * Restores previously saved screen content from the provided buffer
+ * and redraws the screen with the current font.
  * Used primarily by the setup dialog system.
  * 
  * @param buffer Pointer to buffer containing saved screen content
  */
 extern void gfx_restore_screen_buffer(void* buffer);
 
+//==============================================================================
+// Overlay Page
+//==============================================================================
+
+/*!
+ * @brief Show the overlay page
+ * 
+ * The last screen of the virtual framebuffer is kept as overlay page when the
+ * framebuffer holds two screens or more. Opening the overlay shows that page by
+ * moving the display offset; the terminal page is left as it is and the
+ * terminal goes on drawing received text there. Drawing on the overlay is done
+ * between gfx_overlay_begin() and gfx_overlay_end() with the given font.
+ * Used by the setup dialog, nothing is copied or allocated.
+ * 
+ * @param font_type Registry index of the font for the overlay
+ * @return 1 if the overlay is shown, 0 if there is no overlay page
+ */
+extern int gfx_overlay_open( int font_type );
+
+/*!
+ * @brief Draw on the overlay page
+ * 
+ * Drawing functions (gfx_putc, gfx_fill_rect, colors, gfx_get_term_size ...)
+ * work on the overlay until gfx_overlay_end() is called. The overlay has no
+ * character cells and no cursor. Does nothing if no overlay is open.
+ */
+extern void gfx_overlay_begin();
+
+/*!
+ * @brief Draw on the terminal page again
+ */
+extern void gfx_overlay_end();
+
+/*!
+ * @brief Hide the overlay page
+ * 
+ * Shows the terminal page again by moving the display offset back.
+ */
+extern void gfx_overlay_close();
+
+//==============================================================================
+// Statistics
+//==============================================================================
+
+/*!
+ * @brief Counters of the terminal engine
+ * 
+ * Only maintained when GFX_STATISTICS is enabled in pivt100_config.h,
+ * which is done by the host benchmarks, except for the glyph cache
+ * counters which are always kept. Byte counts are estimates of
+ * the framebuffer memory touched by each drawing primitive.
+ */
+typedef struct
+{
+    unsigned long long bytes_in;        /// Bytes handed to gfx_term_write()
+    unsigned long long glyphs;          /// Characters rendered
+    unsigned long long scrolls;         /// Whole screen scroll operations
+    unsigned long long cursor_draws;    /// Times the cursor was painted
+    unsigned long long fb_read;         /// Framebuffer bytes read
+    unsigned long long fb_written;      /// Framebuffer bytes written
+    unsigned long long fb_write_runs;   /// Runs of consecutive framebuffer bytes written, e.g. one per glyph line
+    unsigned long long glyph_cache_hits;    /// Glyphs copied from the colored glyph cache (always counted)
+    unsigned long long glyph_cache_misses;  /// Glyphs drawn into the cache first (always counted)
+    unsigned long long page_flips;      /// Back pages shown (pageFlip)
+    unsigned long long page_copied;     /// Bytes copied to bring the back page up to the page shown
+} gfx_stats_t;
+
+/*!
+ * @brief Drop all glyphs of the colored glyph cache
+ * 
+ * The cache keeps glyphs drawn in a fg/bg color pair, keyed by glyph and
+ * colors. Font and mode changes flush it by themselves; code that changes
+ * what a glyph or color index looks like in another way (custom palette
+ * in a direct color mode, glyph data edited in place) must call this.
+ */
+extern void gfx_glyph_cache_invalidate();
+
+/*!
+ * @brief Get a copy of the engine counters
+ * 
+ * @param out Receives the current counter values
+ */
+extern void gfx_get_stats( gfx_stats_t* out );
+
+/*!
+ * @brief Reset all engine counters to 0
+ */
+extern void gfx_reset_stats();
+
 #endif
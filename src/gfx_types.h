@@ -38,6 +38,19 @@ typedef enum
 	WHITE			= 0x0F
 } DRAWING_COLOR; // compatible with GFX_COL
 
+/** Attribute flags of a character cell */
+#define GFX_ATTR_REVERSE	0x01	// cell was written in reverse video (fg/bg are already swapped)
+
+/** One character cell of the terminal screen */
+typedef struct
+{
+	unsigned short glyph;	// character code in the current font
+	GFX_COL fg;				// foreground color
+	GFX_COL bg;				// background color
+	unsigned char attr;		// GFX_ATTR_xxx flags
+	unsigned char reserved;
+} GFX_CELL;
+
 // Function type for the functions drawing a character in each mode (normal, xor, transparent)
 typedef void draw_putc_fun( unsigned int row, unsigned int col, unsigned char c );
 
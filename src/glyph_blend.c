@@ -0,0 +1,250 @@
+//
+// glyph_blend.c
+// Glyph composition: foreground/background selection by pixel mask
+//
+// PiGFX is a bare metal kernel for the Raspberry Pi
+// that implements a basic ANSI terminal emulator with
+// the additional support of some primitive graphics functions.
+// Copyright (C) 2020 Christian Lehner
+
+#include "glyph_blend.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(GLYPH_BLEND_NEON_EMULATION)
+#include "neon_emu.h"           // host tests only
+#elif defined(GLYPH_BLEND_NEON)
+#error "GLYPH_BLEND_NEON needs the NEON compiler flags (SIMD_CFLAGS in the Makefile)"
+#endif
+
+const unsigned int glyph_nibble_mask[16] =
+{
+    0x00000000, 0xFF000000, 0x00FF0000, 0xFFFF0000,
+    0x0000FF00, 0xFF00FF00, 0x00FFFF00, 0xFFFFFF00,
+    0x000000FF, 0xFF0000FF, 0x00FF00FF, 0xFFFF00FF,
+    0x0000FFFF, 0xFF00FFFF, 0x00FFFFFF, 0xFFFFFFFF
+};
+
+const unsigned int glyph_pair_mask[4] = { 0x0000, 0xFF00, 0x00FF, 0xFFFF };
+
+/** Masks for 2 pixels of 16 bits, bit 1 is the left pixel (low half word). */
+static const unsigned int glyph_pair_mask16[4] = { 0x00000000, 0xFFFF0000, 0x0000FFFF, 0xFFFFFFFF };
+
+#if defined(GLYPH_BLEND_NEON)
+
+/** Bit of a packed glyph byte for each of 8 pixels, leftmost first. */
+static const unsigned char glyph_bit_select[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+
+void glyph_blend_bytes( unsigned char* dst, unsigned int pitch, const unsigned char* glyph,
+                        unsigned int width, unsigned int height, unsigned int fg32, unsigned int bg32 )
+{
+    const uint8x16_t FG = vdupq_n_u8(fg32);
+    const uint8x16_t BG = vdupq_n_u8(bg32);
+    const unsigned char fg = fg32, bg = bg32;
+
+    while (height--)
+    {
+        unsigned int x = 0;
+        for (; x + 16 <= width; x += 16)
+            vst1q_u8(dst + x, vbslq_u8(vld1q_u8(glyph + x), FG, BG));
+        if (x + 8 <= width)
+        {
+            vst1_u8(dst + x, vbsl_u8(vld1_u8(glyph + x), vget_low_u8(FG), vget_low_u8(BG)));
+            x += 8;
+        }
+        for (; x < width; x++)
+            dst[x] = bg ^ (glyph[x] & (fg ^ bg));
+        glyph += width;
+        dst += pitch;
+    }
+}
+
+void glyph_blend_packed( unsigned char* dst, unsigned int pitch, const unsigned char* glyph,
+                         unsigned int width, unsigned int height, unsigned int fg32, unsigned int bg32 )
+{
+    const uint8x16_t FG = vdupq_n_u8(fg32);
+    const uint8x16_t BG = vdupq_n_u8(bg32);
+    const uint8x8_t BITS = vld1_u8(glyph_bit_select);
+    const unsigned int row_bytes = (width + 7) / 8;
+
+    while (height--)
+    {
+        unsigned int x = 0;
+        const unsigned char* g = glyph;
+        for (; x + 16 <= width; x += 16, g += 2)
+        {
+            // every lane tests its bit: 0xFF for foreground pixels
+            const uint8x16_t m = vcombine_u8(vtst_u8(vdup_n_u8(g[0]), BITS), vtst_u8(vdup_n_u8(g[1]), BITS));
+            vst1q_u8(dst + x, vbslq_u8(m, FG, BG));
+        }
+        for (; x < width; x += 8, g++)
+        {
+            const uint8x8_t pix = vbsl_u8(vtst_u8(vdup_n_u8(g[0]), BITS), vget_low_u8(FG), vget_low_u8(BG));
+            if (x + 8 <= width)
+            {
+                vst1_u8(dst + x, pix);
+            }
+            else
+            {
+                unsigned char tail[8];
+                vst1_u8(tail, pix);
+                for (unsigned int i = 0; x + i < width; i++)
+                    dst[x + i] = tail[i];
+            }
+        }
+        glyph += row_bytes;
+        dst += pitch;
+    }
+}
+
+#else
+
+/** Reads 4 mask bytes from any address. */
+static inline unsigned int glyph_load4(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+void glyph_blend_bytes( unsigned char* dst, unsigned int pitch, const unsigned char* glyph,
+                        unsigned int width, unsigned int height, unsigned int fg32, unsigned int bg32 )
+{
+    while (height--)
+    {
+        unsigned int x = 0;
+        // single pixels up to the first aligned word, then 4 pixels per store
+        for (; x < width && ((unsigned int)(dst + x) & 3); x++)
+            dst[x] = glyph_select4(glyph[x], fg32, bg32);
+        for (; x + 4 <= width; x += 4)
+            *(unsigned int*)(dst + x) = glyph_select4(glyph_load4(glyph + x), fg32, bg32);
+        for (; x < width; x++)
+            dst[x] = glyph_select4(glyph[x], fg32, bg32);
+        glyph += width;
+        dst += pitch;
+    }
+}
+
+void glyph_blend_packed( unsigned char* dst, unsigned int pitch, const unsigned char* glyph,
+                         unsigned int width, unsigned int height, unsigned int fg32, unsigned int bg32 )
+{
+    const unsigned int row_bytes = (width + 7) / 8;
+    const unsigned int aligned = (unsigned int)dst | pitch;
+
+    while (height--)
+    {
+        if ((aligned & 3) == 0 && (width & 3) == 0)
+        {
+            // 4 pixels per nibble of the glyph line
+            unsigned int* p32 = (unsigned int*)dst;
+            for (unsigned int x = 0; x < width; x += 8)
+            {
+                const unsigned int gv = glyph[x / 8];
+                *p32++ = glyph_select4(glyph_nibble_mask[gv >> 4], fg32, bg32);
+                if (x + 4 < width)
+                    *p32++ = glyph_select4(glyph_nibble_mask[gv & 0x0F], fg32, bg32);
+            }
+        }
+        else if ((aligned & 1) == 0 && (width & 1) == 0)
+        {
+            // 2 pixels per store
+            unsigned short* p16 = (unsigned short*)dst;
+            for (unsigned int x = 0; x < width; x += 2)
+            {
+                const unsigned int pair = (glyph[x / 8] >> (6 - (x & 7))) & 0x03;
+                *p16++ = glyph_select4(glyph_pair_mask[pair], fg32, bg32);
+            }
+        }
+        else
+        {
+            for (unsigned int x = 0; x < width; x++)
+                dst[x] = glyph_select4(-((glyph[x / 8] >> (7 - (x & 7))) & 1), fg32, bg32);
+        }
+        glyph += row_bytes;
+        dst += pitch;
+    }
+}
+
+#endif
+
+void glyph_blend_bytes16( unsigned char* dst, unsigned int pitch, const unsigned char* glyph,
+                          unsigned int width, unsigned int height, unsigned int fg32, unsigned int bg32 )
+{
+    const unsigned int aligned = (unsigned int)dst | pitch;
+
+    while (height--)
+    {
+        if ((aligned & 3) == 0 && (width & 1) == 0)
+        {
+            // 2 pixels per store
+            unsigned int* p32 = (unsigned int*)dst;
+            for (unsigned int x = 0; x < width; x += 2)
+                *p32++ = glyph_select4((glyph[x] * 0x0101u) | (glyph[x + 1] * 0x01010000u), fg32, bg32);
+        }
+        else
+        {
+            unsigned short* p16 = (unsigned short*)dst;
+            for (unsigned int x = 0; x < width; x++)
+                p16[x] = glyph_select4(glyph[x] * 0x0101u, fg32, bg32);
+        }
+        glyph += width;
+        dst += pitch;
+    }
+}
+
+void glyph_blend_packed16( unsigned char* dst, unsigned int pitch, const unsigned char* glyph,
+                           unsigned int width, unsigned int height, unsigned int fg32, unsigned int bg32 )
+{
+    const unsigned int row_bytes = (width + 7) / 8;
+    const unsigned int aligned = (unsigned int)dst | pitch;
+
+    while (height--)
+    {
+        if ((aligned & 3) == 0 && (width & 1) == 0)
+        {
+            unsigned int* p32 = (unsigned int*)dst;
+            for (unsigned int x = 0; x < width; x += 2)
+                *p32++ = glyph_select4(glyph_pair_mask16[(glyph[x / 8] >> (6 - (x & 7))) & 0x03], fg32, bg32);
+        }
+        else
+        {
+            unsigned short* p16 = (unsigned short*)dst;
+            for (unsigned int x = 0; x < width; x++)
+                p16[x] = glyph_select4(-((glyph[x / 8] >> (7 - (x & 7))) & 1), fg32, bg32);
+        }
+        glyph += row_bytes;
+        dst += pitch;
+    }
+}
+
+void glyph_blend_bytes32( unsigned char* dst, unsigned int pitch, const unsigned char* glyph,
+                          unsigned int width, unsigned int height, unsigned int fg32, unsigned int bg32 )
+{
+    while (height--)
+    {
+        unsigned int* p32 = (unsigned int*)dst;
+        for (unsigned int x = 0; x < width; x++)
+            p32[x] = glyph_select4(glyph[x] * 0x01010101u, fg32, bg32);
+        glyph += width;
+        dst += pitch;
+    }
+}
+
+void glyph_blend_packed32( unsigned char* dst, unsigned int pitch, const unsigned char* glyph,
+                           unsigned int width, unsigned int height, unsigned int fg32, unsigned int bg32 )
+{
+    const unsigned int row_bytes = (width + 7) / 8;
+
+    while (height--)
+    {
+        unsigned int* p32 = (unsigned int*)dst;
+        for (unsigned int x = 0; x < width; x += 8)
+        {
+            // one glyph byte, 8 pixels
+            const unsigned int gv = glyph[x / 8];
+            const unsigned int n = (width - x < 8) ? width - x : 8;
+            for (unsigned int i = 0; i < n; i++)
+                *p32++ = glyph_select4(-((gv >> (7 - i)) & 1), fg32, bg32);
+        }
+        glyph += row_bytes;
+        dst += pitch;
+    }
+}
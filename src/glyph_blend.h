@@ -0,0 +1,87 @@
+//
+// glyph_blend.h
+// Glyph composition: foreground/background selection by pixel mask
+//
+// PiGFX is a bare metal kernel for the Raspberry Pi
+// that implements a basic ANSI terminal emulator with
+// the additional support of some primitive graphics functions.
+// Copyright (C) 2020 Christian Lehner
+
+#ifndef _GLYPH_BLEND_H_
+#define _GLYPH_BLEND_H_
+
+// The implementation is chosen at build time:
+//  - NEON (Pi 2/3 with the SIMD flags of the Makefile): 8 or 16 pixels per vbsl
+//  - ARMv6 media instructions (Pi 1/Zero, Pi 2/3 without NEON): USUB8 sets
+//    the GE flags from a mask word, SEL picks 4 fg/bg bytes with them
+//  - plain C otherwise (host build)
+// The host tests emulate the SIMD variants with GLYPH_BLEND_SIMD32_EMULATION
+// and GLYPH_BLEND_NEON_EMULATION and compare them with a reference.
+// On Pi 2/3 only glyph_blend.c is compiled with the NEON flags, the Makefile
+// sets GLYPH_BLEND_NEON for all files so that gfx.c calls into it.
+#if defined(__ARM_NEON) || defined(GLYPH_BLEND_NEON_EMULATION)
+#ifndef GLYPH_BLEND_NEON
+#define GLYPH_BLEND_NEON        1
+#endif
+#endif
+#if defined(__ARM_FEATURE_SIMD32) || defined(GLYPH_BLEND_SIMD32_EMULATION)
+#define GLYPH_BLEND_SIMD32      1
+#endif
+
+/** Masks for 4 pixels of a packed glyph line: nibble bit 3 is the leftmost
+ *  pixel, which is the lowest framebuffer address (little endian). */
+extern const unsigned int glyph_nibble_mask[16];
+
+/** Masks for 2 pixels, bit 1 is the left pixel. */
+extern const unsigned int glyph_pair_mask[4];
+
+#if defined(GLYPH_BLEND_SIMD32_EMULATION)
+extern unsigned int glyph_emu_usub8_sel(unsigned int mask, unsigned int fg, unsigned int bg);
+#endif
+
+/** Picks the bytes of fg where mask has 0xFF and those of bg where it has 0x00. */
+static inline unsigned int glyph_select4(unsigned int mask, unsigned int fg, unsigned int bg)
+{
+#if defined(GLYPH_BLEND_SIMD32_EMULATION)
+    return glyph_emu_usub8_sel(mask, fg, bg);
+#elif defined(GLYPH_BLEND_SIMD32)
+    unsigned int pix;
+    // 0xFF - 1 does not borrow and sets the GE flag of the byte, 0x00 - 1 clears it
+    asm ("usub8 %0, %1, %3\n\t"
+         "sel %0, %2, %4"
+         : "=&r" (pix) : "r" (mask), "r" (fg), "r" (0x01010101), "r" (bg));
+    return pix;
+#else
+    return bg ^ (mask & (fg ^ bg));
+#endif
+}
+
+/** Draws a glyph in the byte per pixel format (0x00 background, 0xFF foreground).
+ *  @param dst    framebuffer address of the top left pixel, any alignment
+ *  @param pitch  bytes from one framebuffer line to the next
+ *  @param glyph  width*height mask bytes
+ *  @param fg32   foreground color in all 4 bytes
+ *  @param bg32   background color in all 4 bytes
+ */
+extern void glyph_blend_bytes( unsigned char* dst, unsigned int pitch, const unsigned char* glyph,
+                               unsigned int width, unsigned int height, unsigned int fg32, unsigned int bg32 );
+
+/** Draws a glyph in the packed format: (width+7)/8 bytes per line, leftmost pixel in bit 7.
+ *  Parameters as for glyph_blend_bytes().
+ */
+extern void glyph_blend_packed( unsigned char* dst, unsigned int pitch, const unsigned char* glyph,
+                                unsigned int width, unsigned int height, unsigned int fg32, unsigned int bg32 );
+
+/** Function type of the glyph kernels, one pair per color depth. */
+typedef void glyph_blend_fun( unsigned char* dst, unsigned int pitch, const unsigned char* glyph,
+                              unsigned int width, unsigned int height, unsigned int fg32, unsigned int bg32 );
+
+// 16 and 32 bits per pixel are plain C with glyph_select4() on all targets.
+// For 16 bpp dst and pitch are 2 byte aligned and fg32/bg32 hold the pixel
+// twice, for 32 bpp they are 4 byte aligned and fg32/bg32 are the pixel.
+extern glyph_blend_fun glyph_blend_bytes16;
+extern glyph_blend_fun glyph_blend_packed16;
+extern glyph_blend_fun glyph_blend_bytes32;
+extern glyph_blend_fun glyph_blend_packed32;
+
+#endif
@@ -119,6 +119,15 @@ void __attribute__((interrupt("IRQ"))) irq_handler_(void)
         IntHandler* hnd = _irq_handlers[9];
         hnd( _irq_handlers_data[9] );
 
+    }
+    // Bit 16 in pending 0 means IRQ 16
+    // IRQ 16 is the interrupt of DMA channel 0
+    else if( R32(INTERRUPT_IRQ_PENDING_0) & RPI_DMA0_IRQ && _irq_handlers[IRQ_DMA_0] )
+    {
+        // IRQ 16
+        IntHandler* hnd = _irq_handlers[IRQ_DMA_0];
+        hnd( _irq_handlers_data[IRQ_DMA_0] );
+
     }
     else
     {
@@ -38,6 +38,7 @@
 #define RPI_GPIO3_INTERRUPT_IRQ         (1 << 20) /* 20 for IRQ register 2 means IRQ 52 in the table */
 #define RPI_UART_INTERRUPT_IRQ          (1 << 25) /* 25 for IRQ register 2 means IRQ 57 in the table */
 #define RPI_USB_IRQ                     (1 << 9)  /* 9 for IRQ register 0 means IRQ 9 in the table */
+#define RPI_DMA0_IRQ                    (1 << 16) /* 16 for IRQ register 0 means IRQ 16 in the table */
 #define RPI_BASIC_ARM_TIMER_IRQ         (1 << 0)
 #define RPI_SYSTEM_TIMER_3_IRQ          (1 << 3)
 
@@ -47,6 +48,7 @@
 #define NBROFIRQ    80
 #endif
 
+#define IRQ_DMA_0  16
 #define IRQ_GPIO_0 49
 
 #define MAX_GPIO_HANDLER    64
@@ -48,6 +48,48 @@ void CreatePageTable(unsigned int nMemSize)
 	CleanDataCache ();
 }
 
+// sections currently mapped write-combining by MapFramebufferWriteCombined()
+static unsigned int nWcFirst = 0;
+static unsigned int nWcEnd = 0;
+
+void MapFramebufferWriteCombined(void* pBase, unsigned int nSize)
+{
+	unsigned int* pPageTable = (unsigned int*)MEM_PAGE_TABLE1;
+	const unsigned int nFirst = (unsigned int) pBase / MEGABYTE;
+	unsigned int nEnd = ((unsigned int) pBase + nSize + MEGABYTE - 1) / MEGABYTE;
+
+	// pixels written through the old mapping must reach memory first
+	DataSyncBarrier ();
+
+	for (unsigned int nEntry = nWcFirst; nEntry < nWcEnd; nEntry++)
+	{
+		pPageTable[nEntry] = MEGABYTE * nEntry | ARMV6MMUL1SECTION_DEVICE;
+	}
+	nWcFirst = nWcEnd = 0;
+
+	// never touch the sections of kernel and heap
+	if (nSize == 0 || (unsigned int) pBase < ARM_MEMSIZE || nEnd > 4096)
+	{
+		nEnd = nFirst;
+	}
+	for (unsigned int nEntry = nFirst; nEntry < nEnd; nEntry++)
+	{
+		pPageTable[nEntry] = MEGABYTE * nEntry | ARMV6MMUL1SECTION_WRITE_COMBINE;
+	}
+	if (nFirst < nEnd)
+	{
+		nWcFirst = nFirst;
+		nWcEnd = nEnd;
+	}
+
+	// the table walk reads memory, drop the old translations afterwards
+	CleanDataCache ();
+	DataSyncBarrier ();
+	asm volatile ("mcr p15, 0, %0, c8, c7,  0" : : "r" (0));	// invalidate unified TLB
+	DataSyncBarrier ();
+	FlushPrefetchBuffer ();
+}
+
 void EnableMMU()
 {
 	unsigned int nAuxControl;
@@ -29,6 +29,8 @@
 #define ARMV6MMUL1SECTION_NORMAL_NS 0x1040A					//	normal cache no share   1 0000 0100 0000 1010
 #define ARMV6MMUL1SECTION_DEVICE	0x10416		// shared device                        1 0000 0100 0001 0110
 #define ARMV6MMUL1SECTION_COHERENT	0x10412		// strongly ordered                     1 0000 0100 0001 0010
+#define ARMV6MMUL1SECTION_WRITE_COMBINE	0x11412	// normal non-cacheable (TEX=001 C=0 B=0)  1 0001 0100 0001 0010
+							// + shareable and execute never, stores are merged in the write buffer
 
 // (System) Control register
 #define ARM_CONTROL_MMU			(1 << 0)
@@ -67,4 +69,9 @@
 void CreatePageTable(unsigned int nMemSize);
 void EnableMMU();
 
+/** Maps the sections covering [pBase, pBase+nSize) write-combining and gives a
+ *  range mapped by an earlier call back to device memory. For the GPU framebuffer,
+ *  call after fb_init(). */
+void MapFramebufferWriteCombined(void* pBase, unsigned int nSize);
+
 #endif // MMU_H__
@@ -37,6 +37,7 @@
 #include "timer.h"
 #include "console.h"
 #include "gfx.h"
+#include "present.h"
 #include "framebuffer.h"
 #include "irq.h"
 #include "dma.h"
@@ -62,8 +63,11 @@
 #include "uart.h"
 #include "gpio.h"
 #include "pwm.h"
+#include "synchronize.h"
+#include "uart_ring.h"
 
 #define UART_BUFFER_SIZE 16384 /* 16k */
+#define UART_SPAN_MAX    1024  /* bytes rendered before the ring is released */
 
 // Direct usage of the new bitmap-based debug system
 // No wrapper macros needed - use LogNotice, LogError, LogDebug, LogWarning directly
@@ -262,19 +266,8 @@ void switch_uart_pins()
 void uart_fill_queue(__attribute__((unused)) void *data)
 {
     while (!(*pUART0_FR & 0x10))
-    {
-        *uart_buffer_end++ = (char)(*pUART0_DR & 0xFF);
-
-        if (uart_buffer_end >= uart_buffer_limit)
-            uart_buffer_end = uart_buffer;
-
-        if (uart_buffer_end == uart_buffer_start)
-        {
-            uart_buffer_start++;
-            if (uart_buffer_start >= uart_buffer_limit)
-                uart_buffer_start = uart_buffer;
-        }
-    }
+        uart_ring_put(&uart_buffer_start, &uart_buffer_end, uart_buffer, uart_buffer_limit,
+                      (char)(*pUART0_DR & 0xFF));
 
     /* Clear UART0 interrupts */
     *pUART0_ICR = 0xFFFFFFFF;
@@ -344,21 +337,42 @@ void display_system_banner()
     gfx_set_bg(BLACK);
 }
 
+#if ENABLED(FRAMEBUFFER_DEBUG)
+/** Draws a few screens of glyphs straight to the framebuffer and clears it again.
+ *  @return glyphs drawn per second */
+static unsigned int glyph_rate()
+{
+    unsigned int rows, cols;
+    gfx_get_term_size(&rows, &cols);
+
+    const unsigned int t0 = time_microsec();
+    for (unsigned int n = 0; n < 4; n++)
+        for (unsigned int row = 0; row < rows; row++)
+            for (unsigned int col = 0; col < cols; col++)
+                gfx_putc(row, col, 'A' + (row + col + n) % 26);
+    const unsigned int usec = time_microsec() - t0;
+
+    gfx_clear();
+    return usec ? (unsigned int)(4ULL * rows * cols * 1000000 / usec) : 0;
+}
+#endif
+
 /**
  * @brief Initialize framebuffer and graphics subsystem
  *
  * Sets up the display framebuffer with specified dimensions and configures
  * the graphics environment for terminal operations. This function:
  * - Releases any existing framebuffer
- * - Allocates new framebuffer with given parameters
- * - Sets up color palette for 8-bit mode
+ * - Allocates new framebuffer with given parameters, FB_VIRTUAL_SCREENS
+ *   screens high so text can scroll by panning
+ * - Sets up the color palette, which gfx.c converts itself in 16 and 32 bit mode
  * - Configures graphics context (pitch, size, etc.)
  * - Sets default drawing mode, font, and tabulation
  * - Clears the screen
  *
  * @param width  Display width in pixels
  * @param height Display height in pixels
- * @param bpp    Bits per pixel (typically 8 for indexed color)
+ * @param bpp    Bits per pixel: 8 (indexed color), 16 or 32 (colorDepth)
  *
  * @note Sets font to 8x16 pixels by default
  * @note Sets tabulation to 8 characters
@@ -378,12 +392,23 @@ void initialize_framebuffer(unsigned int width, unsigned int height, unsigned in
     unsigned int v_w = p_w;
     unsigned int v_h = p_h;
 
-    fb_init(p_w, p_h,
-            v_w, v_h,
-            bpp,
-            (void *)&p_fb,
-            &fbsize,
-            &pitch);
+    // The virtual framebuffer is FB_VIRTUAL_SCREENS screens high, gfx.c scrolls by panning through it
+    // and keeps the last screen for the setup dialog.
+    // If the GPU can't provide that much memory, fall back to a single screen.
+    if (fb_init(p_w, p_h,
+                v_w, v_h * FB_VIRTUAL_SCREENS,
+                bpp,
+                (void *)&p_fb,
+                &fbsize,
+                &pitch) != FB_SUCCESS)
+    {
+        fb_init(p_w, p_h,
+                v_w, v_h,
+                bpp,
+                (void *)&p_fb,
+                &fbsize,
+                &pitch);
+    }
 
     if (fb_set_palette(0) != 0)
     {
@@ -393,6 +418,18 @@ void initialize_framebuffer(unsigned int width, unsigned int height, unsigned in
     }
 
     gfx_set_env(p_fb, v_w, v_h, bpp, pitch, fbsize);
+
+#if ENABLED(FRAMEBUFFER_DEBUG)
+    const unsigned int device_rate = glyph_rate();
+#endif
+    // The GPU memory is mapped as device memory, every pixel store would be a
+    // single bus write. Normal non-cacheable memory lets the write buffer merge them.
+#if ENABLED(FB_WRITE_COMBINE)
+    MapFramebufferWriteCombined(p_fb, fbsize);
+#endif
+#if ENABLED(FRAMEBUFFER_DEBUG)
+    LogNotice("Glyphs/s: %u before, %u after mapping the framebuffer\n", device_rate, glyph_rate());
+#endif
 }
 
 /**
@@ -404,16 +441,21 @@ void initialize_framebuffer(unsigned int width, unsigned int height, unsigned in
  * 1. Applies user display configuration after safe system initialization
  * 2. Waits for initial UART data while polling timers and keyboards
  * 3. Enters the main processing loop that:
- *    - Reads characters from the UART buffer
+ *    - Takes the largest contiguous span of the UART ring buffer, at most
+ *      UART_SPAN_MAX bytes, so the IRQ handler cannot overrun it while it
+ *      is rendered
  *    - Processes backspace echo skipping if enabled
- *    - Sends characters to the graphics terminal for display
- *    - Polls timers and keyboard handlers
+ *    - Sends the whole span to the graphics terminal with gfx_term_write()
+ *    - Shows the changes once per frame (present_poll()): when the ring is
+ *      empty, at most maxFPS times per second, and at the latest after
+ *      maxLatency ms while data keeps coming
+ *    - Polls timers and keyboard handlers once per span
  *
  * This function never returns and runs the terminal until system reset.
  *
  * @note User configuration is applied after the "Waiting for UART" message
  * @note Supports both PS/2 and USB keyboard input
- * @note Handles ANSI escape sequences through gfx_term_putstring()
+ * @note Handles ANSI escape sequences through gfx_term_write()
  * @note Implements backspace echo suppression for better terminal experience
  */
 
@@ -441,17 +483,21 @@ void term_main_loop()
     gfx_term_putstring("\x1B[2J");
     gfx_term_putstring("\x07"); // BEL to signal ready
     
-    char strb[2] = {0, 0};
+    present_init();
 
     while (1)
     {
         if (uart_buffer_start != uart_buffer_end)
         {
-            strb[0] = *uart_buffer_start++;
-            if (uart_buffer_start >= uart_buffer_limit)
-                uart_buffer_start = uart_buffer;
+            // Largest contiguous readable span of the ring, split at the wrap point.
+            // Both ends are sampled together, the IRQ handler may advance them meanwhile.
+            unsigned int cpsr = SaveAndDisableIRQs();
+            const char *span = (const char *)uart_buffer_start;
+            const char *end = (const char *)uart_buffer_end;
+            RestoreIRQs(cpsr);
+            size_t len = uart_ring_span(span, end, uart_buffer_limit, UART_SPAN_MAX);
+            present_input();
 
-            // Process character directly - no bitmap/palette handling
             if (PiVT100Config.skipBackspaceEcho)
             {
                 if (time_microsec() - last_backspace_t > 50000)
@@ -459,18 +505,33 @@ void term_main_loop()
 
                 if (backspace_n_skip > 0)
                 {
-                    // LogDebug("Skip %c",strb[0]);
-                    strb[0] = 0; // Skip this char
+                    // Skip the echoed char, the last skipped one becomes a backspace
+                    len = 1;
                     backspace_n_skip--;
                     if (backspace_n_skip == 0)
-                        strb[0] = 0x7F; // Add backspace instead
+                        gfx_term_write("\x7F", 1);
                 }
+                else
+                    gfx_term_write(span, len);
             }
+            else
+                gfx_term_write(span, len);
 
-            gfx_term_putstring(strb);
+            // On overflow the IRQ handler may have moved the start meanwhile
+            cpsr = SaveAndDisableIRQs();
+            uart_buffer_start = uart_ring_release(uart_buffer_start, span, len, uart_buffer, uart_buffer_limit);
+            RestoreIRQs(cpsr);
         }
 
-        uart_fill_queue(0);
+        // Pixels and cursor follow the cells once per frame
+        present_poll(uart_buffer_start == uart_buffer_end);
+
+        {
+            // Same ring pointers as the IRQ handler
+            const unsigned int cpsr = SaveAndDisableIRQs();
+            uart_fill_queue(0);
+            RestoreIRQs(cpsr);
+        }
 
         timer_poll();
 
@@ -9,6 +9,16 @@
 
 /* Feature toggles */
 // Sprite support removed
+#ifndef GFX_STATISTICS
+#define GFX_STATISTICS          OFF             /* Count glyphs, scrolls and framebuffer traffic in gfx.c (host benchmarks) */
+#endif
+#ifndef FB_VIRTUAL_SCREENS
+#define FB_VIRTUAL_SCREENS      5               /* Virtual framebuffer height in screens; the last is the setup overlay page, text scrolls by panning through the others, with 1 or 2 every scroll copies */
+#endif
+#define FB_WRITE_COMBINE        ON              /* Map the framebuffer write-combining instead of as device memory */
+#ifndef GLYPH_CACHE_ENTRIES
+#define GLYPH_CACHE_ENTRIES     128             /* Default size of the colored glyph cache, glyphCacheSize in pivt100.txt; 0 disables it */
+#endif
 
 #define PIGFX_MAJVERSION        2               /* Major version number */
 #define PIGFX_MINVERSION        0               /* Minor version number */
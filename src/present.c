@@ -0,0 +1,75 @@
+//
+// present.c
+// Frame pacing: when received text is shown on the display
+//
+// PiGFX is a bare metal kernel for the Raspberry Pi
+// that implements a basic ANSI terminal emulator with
+// the additional support of some primitive graphics functions.
+// Copyright (C) 2025
+
+#include "present.h"
+#include "gfx.h"
+#include "framebuffer.h"
+#include "timer.h"
+#include "config.h"
+
+static struct
+{
+    unsigned int period_us;         // 1 / maxFPS
+    unsigned int latency_us;        // maxLatency
+    unsigned int last;              // time_microsec() of the last frame
+    unsigned int pending_since;     // time_microsec() of the first input not shown yet
+    unsigned char pending;          // 1 if input arrived since the last frame
+    unsigned char vsync;            // 0 once the firmware failed to wait for vertical sync
+    unsigned char aligned;          // 1 if the last frame started at a vertical sync
+} frame;
+
+void present_init(void)
+{
+    const unsigned int fps = PiVT100Config.maxFPS ? PiVT100Config.maxFPS : 60;
+    frame.period_us = 1000000 / fps;
+    frame.latency_us = PiVT100Config.maxLatency * 1000;
+    frame.last = time_microsec() - frame.period_us;
+    frame.pending = 0;
+    frame.vsync = 1;
+    frame.aligned = 0;
+}
+
+void present_input(void)
+{
+    if (frame.pending) return;
+    frame.pending = 1;
+    frame.pending_since = time_microsec();
+}
+
+int present_poll(int idle)
+{
+    unsigned int now = time_microsec();
+
+    // After a frame aligned to the vertical sync the next one may start a
+    // little early, the wait below makes up the rest of the period
+    const unsigned int period = frame.aligned ? frame.period_us - frame.period_us / 8 : frame.period_us;
+    if (now - frame.last < period)
+        return 0;
+    if (!idle && !(frame.pending && now - frame.pending_since >= frame.latency_us))
+        return 0;
+
+    // Only wait while there is nothing to parse; with page flipping gfx.c
+    // waits by itself before it draws on the page shown last
+    frame.aligned = 0;
+    if (idle && frame.pending && frame.vsync && !PiVT100Config.pageFlip)
+    {
+        if (fb_wait_vsync() == FB_SUCCESS)
+        {
+            now = time_microsec();
+            frame.aligned = 1;
+        }
+        else
+            frame.vsync = 0;
+    }
+
+    gfx_term_flush();
+    frame.last = now;
+    frame.pending = 0;
+    return 1;
+}
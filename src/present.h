@@ -0,0 +1,31 @@
+//
+// present.h
+// Frame pacing: when received text is shown on the display
+//
+// PiGFX is a bare metal kernel for the Raspberry Pi
+// that implements a basic ANSI terminal emulator with
+// the additional support of some primitive graphics functions.
+// Copyright (C) 2025
+
+#ifndef _PRESENT_H_
+#define _PRESENT_H_
+
+// Received bytes only update the character cells (gfx_term_write()); the
+// pixels follow once per frame with gfx_term_flush(). A frame is shown
+//  - at most maxFPS times per second, aligned to the vertical sync if the
+//    firmware can wait for it, else paced by the timer
+//  - as soon as the UART ring runs empty and the frame period has passed
+//  - while data keeps coming, when the oldest change not shown is
+//    maxLatency ms old; until then the time goes into parsing
+
+// Takes maxFPS and maxLatency from PiVT100Config and starts the frame clock
+extern void present_init(void);
+
+// Records that bytes were handed to the terminal
+extern void present_input(void);
+
+// Shows a frame if one is due. idle is 1 when no received byte waits in
+// the ring. Returns 1 if gfx_term_flush() was called.
+extern int present_poll(int idle);
+
+#endif
@@ -11,40 +11,38 @@
 #ifndef SRC_SCN_STATE_H_
 #define SRC_SCN_STATE_H_
 
-
-/** Forward declarations needed for function type used in scn_state structure. */
-struct SCN_STATE;
-typedef struct SCN_STATE scn_state;
-
-/** Function type for scanning state.
- *	@param ch the character to scan
- *	@param state points to the current state structure
- *	@return true if the terminal should handle line break and screen scroll returning from this call.
+/** Parser states, after the state diagram of the DEC VT500 series.
+ *  DCS, SOS, PM and APC strings are not interpreted and share one state.
  */
-typedef int state_fun( char ch, scn_state *state );
+typedef enum
+{
+    SCN_GROUND = 0,                 // printable text and control characters
+    SCN_ESCAPE,                     // after ESC
+    SCN_ESCAPE_INTERMEDIATE,        // after ESC and an intermediate (0x20-0x2F)
+    SCN_CSI_ENTRY,                  // after ESC [
+    SCN_CSI_PARAM,                  // reading parameters
+    SCN_CSI_INTERMEDIATE,           // after parameters and an intermediate
+    SCN_CSI_IGNORE,                 // malformed sequence, up to its final character
+    SCN_OSC_STRING,                 // after ESC ], up to BEL or ST
+    SCN_STRING,                     // DCS, SOS, PM or APC string, up to ST
+    SCN_STATE_COUNT
+} scn_state_id;
+
+#define SCN_MAX_PARAMS  20          // a sequence with more parameters is ignored
+#define SCN_PARAM_MAX   65535       // larger parameter values saturate here
 
 /** Scanning state. Contains the status of the input sequence scanning. */
 typedef struct SCN_STATE
 {
-	/*
-	 * Parsing functions
-	 */
-    state_fun (*next);
-    state_fun (*after_read_digit);
+    unsigned char state;            // scn_state_id
 
     /*
      * ANSI term mode (normal ESC[ sequences and ANSI private mode sequences)
      */
-    unsigned int cmd_params[20];	// Scanned parameters after escape sequence start
-    unsigned int cmd_params_size;	// Number of parameters after escape sequence start
-    char private_mode_char;			// Escape private mode character (ESC followed by not '[')
-
-    /*
-     * TODO: Graphic Extension mode (private mode GPH8 or GPH16)
-     *
-    unsigned int gph_params_size;	// 8 for 1-byte coordinates, 16 for 2-bytes
-    unsigned int gph_commandcode;	// 0-255
-    */
+    unsigned int cmd_params[SCN_MAX_PARAMS];    // Scanned parameters after escape sequence start
+    unsigned int cmd_params_size;   // Number of parameters after escape sequence start
+    char private_mode_char;         // Private mode character right after ESC[ ('?', '=', '#'...), 0 if none
+    char intermediate;              // Last intermediate character (0x20-0x2F), 0 if none
 } scn_state;
 
 
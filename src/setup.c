@@ -28,6 +28,7 @@ extern void switch_uart_pins(void);
 
 static unsigned char setup_mode_active = 0;
 static void* saved_screen_buffer = 0;
+static unsigned char overlay_shown = 0;  // dialog is on the overlay page, the terminal page is untouched
 static unsigned char saved_cursor_visibility = 0;
 static GFX_COL saved_fg_color = 0;
 static GFX_COL saved_bg_color = 0;
@@ -92,6 +93,8 @@ static const unsigned int resolution_heights[] = {
 };
 static const unsigned int num_resolutions = sizeof(available_resolutions) / sizeof(available_resolutions[0]);
 
+static void setup_mode_draw_dialog(void);
+
 // Font switching function that uses font registry
 /**
  * @brief Switch to a specific font by registry index
@@ -356,8 +359,9 @@ static unsigned int find_current_resolution_index(void)
  * - Saves current terminal state (cursor, colors, font, screen content)
  * - Initializes setup menu state with current configuration values
  * - Disables keyboard autorepeat to prevent navigation issues
- * - Switches to a suitable dialog font for the setup interface
- * - Saves screen buffer for restoration when exiting setup mode
+ * - Shows the overlay page of the framebuffer and draws the dialog there with
+ *   a suitable dialog font; the terminal page stays untouched
+ * - Without an overlay page: saves the screen content and draws over it
  * 
  * The setup mode allows configuration of:
  * - UART baud rate
@@ -369,15 +373,14 @@ static unsigned int find_current_resolution_index(void)
  * - Keyboard repeat settings
  * 
  * @note Only enters setup mode if not already active
- * @note Screen buffer saving may fail on memory constraints
+ * @note Without overlay page screen buffer saving may fail on memory constraints
  */
 void setup_mode_enter(void)
        
 {
     if (!setup_mode_active)
     {
-        // Save cursor position and visibility state
-        gfx_term_save_cursor();
+        // Save cursor visibility state
         saved_cursor_visibility = gfx_term_get_cursor_visibility();
         
         // Save current colors
@@ -412,22 +415,31 @@ void setup_mode_enter(void)
         // Reset the settings changed flag
         settings_changed = 0;
         
-        // Hide cursor during setup mode
-        gfx_term_set_cursor_visibility(0);
-        
-        // Allocate buffer for screen content and save BEFORE switching fonts
-        unsigned int buffer_size = gfx_get_screen_buffer_size();
-        saved_screen_buffer = nmalloc_malloc(buffer_size);
-        
-        if (saved_screen_buffer != 0)
+        // Draw the dialog with the system default font (8x16 System Font at index 0) on the
+        // overlay page. The terminal page, its font and cursor stay as they are and text
+        // received during setup is drawn there.
+        overlay_shown = gfx_overlay_open(0);
+        if (!overlay_shown)
         {
-            // Save current screen content with original font
-            gfx_save_screen_buffer(saved_screen_buffer);
+            // No overlay page: the dialog is drawn over the terminal
+            gfx_term_save_cursor();
+            
+            // Hide cursor during setup mode
+            gfx_term_set_cursor_visibility(0);
+            
+            // Allocate buffer for screen content and save BEFORE switching fonts
+            unsigned int buffer_size = gfx_get_screen_buffer_size();
+            saved_screen_buffer = nmalloc_malloc(buffer_size);
+            
+            if (saved_screen_buffer != 0)
+            {
+                // Save current screen content with original font
+                gfx_save_screen_buffer(saved_screen_buffer);
+            }
+            
+            switch_to_font_by_index(0);
         }
         
-        // Switch to system default font (8x16 System Font at index 0) for dialog display
-        switch_to_font_by_index(0);
-        
         setup_mode_active = 1;
         needs_redraw = 1;
         setup_mode_draw();
@@ -441,7 +453,8 @@ void setup_mode_enter(void)
  * before setup mode was entered. This function:
  * - Restores original font, colors, and cursor settings
  * - Applies any configuration changes made during setup
- * - Restores screen content from saved buffer (if available)
+ * - Flips back to the terminal page, or restores screen content from the
+ *   saved buffer (if available) when there was no overlay page
  * - Re-enables keyboard autorepeat if it was enabled
  * - Clears any setup mode visual artifacts
  * 
@@ -459,42 +472,61 @@ void setup_mode_exit(void)
     {
         setup_mode_active = 0;
         
-        // First restore the original font before any screen operations
-        switch_to_font_by_index(saved_font_type);
-        
-        // Restore original colors
-        gfx_set_fg(saved_fg_color);
-        gfx_set_bg(saved_bg_color);
-        
-        // Make sure cursor is hidden and clear any cursor artifacts
-        gfx_term_set_cursor_visibility(0);
-        
-       
-        // Try to restore screen content if buffer exists, otherwise just clear
-        if (saved_screen_buffer != 0)
+        if (overlay_shown)
         {
-            gfx_restore_screen_buffer(saved_screen_buffer);
-            nmalloc_free(saved_screen_buffer);
-            saved_screen_buffer = 0;
+            // Flip back to the terminal page, which kept its content, cursor and font
+            overlay_shown = 0;
+            gfx_overlay_close();
+            
+            // Only settings saved in the dialog are applied
+            if (saved_font_type != font_registry_get_current_index())
+            {
+                switch_to_font_by_index(saved_font_type);
+            }
+            if (settings_changed)
+            {
+                gfx_set_fg(saved_fg_color);
+                gfx_set_bg(saved_bg_color);
+            }
         }
         else
         {
-            // Fallback: just clear screen if buffer allocation failed
-            gfx_term_clear_screen();
+            // First restore the original font before any screen operations
+            switch_to_font_by_index(saved_font_type);
+            
+            // Restore original colors
+            gfx_set_fg(saved_fg_color);
+            gfx_set_bg(saved_bg_color);
+            
+            // Make sure cursor is hidden and clear any cursor artifacts
+            gfx_term_set_cursor_visibility(0);
+            
+            // Try to restore screen content if buffer exists, otherwise just clear
+            if (saved_screen_buffer != 0)
+            {
+                gfx_restore_screen_buffer(saved_screen_buffer);
+                nmalloc_free(saved_screen_buffer);
+                saved_screen_buffer = 0;
+            }
+            else
+            {
+                // Fallback: just clear screen if buffer allocation failed
+                gfx_term_clear_screen();
+            }
+            
+            // Restore cursor position and visibility
+            gfx_term_restore_cursor();
+            gfx_term_set_cursor_visibility(saved_cursor_visibility);
+            
+            // Force cursor rendering if cursor should be visible
+            if (saved_cursor_visibility)
+            {
+                gfx_term_render_cursor();
+            }
         }
         
-        // Restore cursor position and visibility
-        gfx_term_restore_cursor();
-        gfx_term_set_cursor_visibility(saved_cursor_visibility);
-        
         // Re-enable keyboard autorepeat after setup mode
         keyboard_enable_autorepeat();
-        
-        // Force cursor rendering if cursor should be visible
-        if (saved_cursor_visibility)
-        {
-            gfx_term_render_cursor();
-        }
     }
 }
 
@@ -928,7 +960,7 @@ void setup_mode_handle_key(unsigned short key)
                     gfx_term_putstring("Changing display resolution, please wait...\r\n");
 
                     // Re-initialize framebuffer with new resolution
-                    initialize_framebuffer(PiVT100Config.displayWidth, PiVT100Config.displayHeight, 8);
+                    initialize_framebuffer(PiVT100Config.displayWidth, PiVT100Config.displayHeight, PiVT100Config.colorDepth);
                     gfx_term_clear_screen();
                     gfx_term_move_cursor(1, 1); // Move to row 1, column 1 (top-left)
                     
@@ -1144,6 +1176,15 @@ static void draw_color_menu_item(unsigned int row, unsigned int content_col, uns
  * - Color previews: actual colors for foreground/background selection
  */
 void setup_mode_draw(void)
+{
+    // Drawing goes to the overlay page if the dialog has one
+    gfx_overlay_begin();
+    setup_mode_draw_dialog();
+    gfx_overlay_end();
+}
+
+/** Draws the dialog, see setup_mode_draw(). */
+static void setup_mode_draw_dialog(void)
 {
     unsigned int screen_width, screen_height;
     unsigned int term_rows, term_cols;
@@ -32,6 +32,16 @@
 #define	EnableInterrupts()	EnableIRQs()			// deprecated
 #define	DisableInterrupts()	DisableIRQs()			// deprecated
 
+// Disables IRQs and returns the CPSR from before, for RestoreIRQs(): code that
+// may be called with IRQs off leaves them off
+static inline unsigned int SaveAndDisableIRQs (void)
+{
+	unsigned int cpsr;
+	asm volatile ("mrs %0, cpsr\n\tcpsid i" : "=r" (cpsr) : : "memory");
+	return cpsr;
+}
+#define	RestoreIRQs(cpsr)	asm volatile ("msr cpsr_c, %0" : : "r" (cpsr) : "memory")
+
 #define	EnableFIQs()		asm volatile ("cpsie f")
 #define	DisableFIQs()		asm volatile ("cpsid f")
 
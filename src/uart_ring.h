@@ -0,0 +1,60 @@
+//
+// uart_ring.h
+// Ring buffer of the bytes received on the UART
+//
+// PiGFX is a bare metal kernel for the Raspberry Pi
+// that implements a basic ANSI terminal emulator with
+// the additional support of some primitive graphics functions.
+// Copyright (C) 2025
+
+#ifndef _UART_RING_H_
+#define _UART_RING_H_
+
+#include <stddef.h>
+
+// The IRQ handler stores received bytes at the end of the ring
+// [buffer, limit); when it catches up with the start it drops the oldest
+// byte by moving the start on. The main loop renders a contiguous span from
+// the start and releases it afterwards. Both sides run the pointer updates
+// below with IRQs masked; they are kept free of hardware access so the host
+// tests can run them.
+
+// Stores c at *end. On overflow *start moves past the dropped byte.
+static inline void uart_ring_put(volatile char **start, volatile char **end,
+                                 volatile char *buffer, volatile char *limit, char c)
+{
+    *(*end)++ = c;
+    if (*end >= limit)
+        *end = buffer;
+
+    if (*end == *start)
+    {
+        (*start)++;
+        if (*start >= limit)
+            *start = buffer;
+    }
+}
+
+// Length of the readable span from start, split at the wrap point and
+// capped to max bytes
+static inline size_t uart_ring_span(const volatile char *start, const volatile char *end,
+                                    const volatile char *limit, size_t max)
+{
+    const size_t len = (end >= start) ? (size_t)(end - start) : (size_t)(limit - start);
+    return (len > max) ? max : len;
+}
+
+// New start after the span [taken, taken + len) was rendered; start is the
+// current one. If the IRQ handler dropped bytes meanwhile, start lies in the
+// span (the bytes it skipped were rendered anyway) or past its end (the
+// bytes in between are lost and the IRQ handler's start is kept).
+static inline volatile char *uart_ring_release(volatile char *start, const char *taken, size_t len,
+                                               volatile char *buffer, volatile char *limit)
+{
+    const char *span_end = taken + len;
+    if ((const char *)start < taken || (const char *)start >= span_end)
+        return start;
+    return (span_end >= (const char *)limit) ? buffer : (volatile char *)span_end;
+}
+
+#endif